@@ -0,0 +1,67 @@
+/**
+ * @file benchstats.h
+ *
+ * @brief Latency percentiles for the publish benchmarks.
+ *
+ * Shared by the firmware benchmark (publishbench.cpp) and the host benchmark
+ * (tools/bench/publish_bench.cpp), so both report the same figures.
+ *
+ */
+
+#ifndef BENCHSTATS_H_
+#define BENCHSTATS_H_
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*---------------------  Definitions ---------------------*/
+/**
+ * @brief Result of one benchmark case.
+ *
+ */
+typedef struct
+{
+  uint32_t messages;    /*!< Messages published successfully */
+  uint32_t errors;      /*!< Failed publishes */
+  uint32_t elapsedUs;   /*!< Wall time of the whole case */
+  uint32_t msgPerSec;   /*!< Throughput in messages */
+  uint32_t bytesPerSec; /*!< Throughput in payload bytes */
+  uint32_t p50Ns;       /*!< Median publish latency */
+  uint32_t p99Ns;       /*!< 99th percentile publish latency */
+  uint32_t p999Ns;      /*!< 99.9th percentile publish latency */
+  uint32_t maxNs;       /*!< Worst publish latency */
+} bench_result_t;
+/*------------------------------------------------*/
+
+/*---------------------  Functions ---------------------*/
+static inline int benchCompareU32(const void *a, const void *b)
+{
+  uint32_t x = *static_cast<const uint32_t *>(a);
+  uint32_t y = *static_cast<const uint32_t *>(b);
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Fill the result from the latency samples of a case.
+ *
+ * @param samples Latency of every successful publish in ns. Sorted in place.
+ * @param count Number of samples
+ * @param payloadLen Payload bytes per message
+ * @param elapsedUs Wall time of the case
+ * @param result Result to fill. messages and errors must already be set.
+ */
+static inline void benchSummarize(uint32_t *samples, uint32_t count, uint32_t payloadLen, uint32_t elapsedUs, bench_result_t &result)
+{
+  qsort(samples, count, sizeof(samples[0]), benchCompareU32);
+
+  result.elapsedUs = elapsedUs;
+  result.msgPerSec = (elapsedUs > 0) ? static_cast<uint32_t>((static_cast<uint64_t>(result.messages) * 1000000ULL) / elapsedUs) : 0;
+  result.bytesPerSec = result.msgPerSec * payloadLen;
+  result.p50Ns = (count > 0) ? samples[(count * 50) / 100] : 0;
+  result.p99Ns = (count > 0) ? samples[(count * 99) / 100] : 0;
+  result.p999Ns = (count > 0) ? samples[(static_cast<uint64_t>(count) * 999) / 1000] : 0;
+  result.maxNs = (count > 0) ? samples[count - 1] : 0;
+}
+/*------------------------------------------------*/
+
+#endif /* BENCHSTATS_H_ */
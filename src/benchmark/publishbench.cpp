@@ -0,0 +1,264 @@
+/**
+ * @file publishbench.cpp
+ *
+ * @brief End-to-end publish throughput and latency benchmark
+ *
+ */
+
+#include <NBMQTTCycleCounter.h>
+
+#include <publishbench.h>
+#include <benchstats.h>
+#include <ubidotspool.h>
+
+/*---------------------  Globals ---------------------*/
+static const uint32_t payloadSizes[] = {16, 64, 256, 900}; // Raw client payload sizes
+static const uint32_t variableSizes[] = {4, 54, 246, 890}; // Ubidots variable name sizes, payload is {"<var>": 1.00}
+static const MQTT::QoS qosLevels[] = {MQTT::QOS0, MQTT::QOS1};
+
+// On the heap while the benchmark runs, so an image without it keeps the RAM
+typedef MQTT::Client<NBMQTTSocket, NBMQTTCountdown, UBIDOTS_MSG_MAX_LEN> bench_client_t;
+static uint32_t *samples = nullptr;         // Latency of every publish in a case, PUBLISH_BENCH_MESSAGES
+static char *payload = nullptr;             // Raw client payload / Ubidots variable name, UBIDOTS_MSG_MAX_LEN
+static bench_client_t *rawClient = nullptr; // Raw client
+/*------------------------------------------------*/
+
+/*---------------------  Private functions ---------------------*/
+static void printHeader()
+{
+  iprintf("%-8s %4s %7s %6s %6s %8s %9s %8s %8s %8s %8s\r\n",
+          "api", "qos", "payload", "msgs", "errors", "msg/s", "bytes/s", "p50_us", "p99_us", "p999_us", "max_us");
+}
+
+static void printResult(const char *api, MQTT::QoS qos, uint32_t payloadLen, const bench_result_t &result)
+{
+  iprintf("%-8s %4d %7lu %6lu %6lu %8lu %9lu %8lu %8lu %8lu %8lu\r\n",
+          api, qos, payloadLen, result.messages, result.errors, result.msgPerSec, result.bytesPerSec,
+          result.p50Ns / 1000, result.p99Ns / 1000, result.p999Ns / 1000, result.maxNs / 1000);
+}
+
+static void benchUbidots(Ubidots &ubidots, MQTT::QoS qos, uint32_t variableLen)
+{
+  bench_result_t result = {};
+  uint32_t count = 0;
+
+  memset(payload, 'v', variableLen);
+  payload[variableLen] = '\0';
+  ubidots.setPublishQoS(qos);
+
+  uint32_t start = NBMQTTCycleCounter::now();
+  for (uint32_t i = 0; i < PUBLISH_BENCH_MESSAGES; i++)
+  {
+    uint32_t t0 = NBMQTTCycleCounter::now();
+    if (ubidots.publish(payload, 1.0f))
+    {
+      samples[count++] = NBMQTTCycleCounter::toNanos(NBMQTTCycleCounter::now() - t0);
+    }
+    else
+    {
+      result.errors++;
+    }
+  }
+
+  if (qos == MQTT::QOS0)
+  { // Wait for the broker to take everything before stopping the clock
+    ubidots.setPublishQoS(MQTT::QOS1);
+    ubidots.publish(payload, 1.0f);
+  }
+
+  result.messages = count;
+  benchSummarize(samples, count, variableLen + 10, NBMQTTCycleCounter::toMicros(NBMQTTCycleCounter::now() - start), result);
+  printResult("ubidots", qos, variableLen + 10, result);
+}
+
+static void benchRawClient(MQTT::QoS qos, uint32_t payloadLen)
+{
+  bench_result_t result = {};
+  uint32_t count = 0;
+
+  memset(payload, 'x', payloadLen);
+
+  uint32_t start = NBMQTTCycleCounter::now();
+  for (uint32_t i = 0; i < PUBLISH_BENCH_MESSAGES; i++)
+  {
+    uint32_t t0 = NBMQTTCycleCounter::now();
+    if (rawClient->publish(PUBLISH_BENCH_TOPIC, payload, payloadLen, qos) == MQTT::SUCCESS)
+    {
+      samples[count++] = NBMQTTCycleCounter::toNanos(NBMQTTCycleCounter::now() - t0);
+    }
+    else
+    {
+      result.errors++;
+    }
+  }
+
+  if (qos == MQTT::QOS0)
+  { // Wait for the broker to take everything before stopping the clock
+    rawClient->publish(PUBLISH_BENCH_TOPIC, payload, payloadLen, MQTT::QOS1);
+  }
+
+  result.messages = count;
+  benchSummarize(samples, count, payloadLen, NBMQTTCycleCounter::toMicros(NBMQTTCycleCounter::now() - start), result);
+  printResult("client", qos, payloadLen, result);
+}
+
+/**
+ * @brief QoS0 publishes through a pool of connections from this task, each
+ * variable on its own connection. The pool is built on the first call and
+ * left connected, the benchmark runs once at start up.
+ *
+ * @param host Local broker host
+ * @param port Local broker port
+ */
+static void benchPool(const char *host, uint16_t port)
+{
+  static UbidotsPool<PUBLISH_BENCH_POOL_SIZE> *pool = nullptr;
+  bench_result_t result = {};
+  uint32_t count = 0;
+  char variable[8];
+  char api[12];
+
+  if (pool == nullptr)
+  { // On the heap, only when the benchmark runs
+    pool = new UbidotsPool<PUBLISH_BENCH_POOL_SIZE>(PUBLISH_BENCH_POOL_TOKEN, PUBLISH_BENCH_POOL_DEVICE, false, false);
+    pool->setBroker(host, port);
+  }
+  pool->setPublishQoS(MQTT::QOS0);
+  if (!pool->connect())
+  {
+    iprintf("Pool connection to the benchmark broker failed\r\n");
+    return;
+  }
+
+  uint32_t start = NBMQTTCycleCounter::now();
+  for (uint32_t i = 0; i < PUBLISH_BENCH_MESSAGES; i++)
+  {
+    siprintf(variable, "var%02lu", i % PUBLISH_BENCH_POOL_VARIABLES);
+    uint32_t t0 = NBMQTTCycleCounter::now();
+    if (pool->publish(variable, 1.0f))
+    {
+      samples[count++] = NBMQTTCycleCounter::toNanos(NBMQTTCycleCounter::now() - t0);
+    }
+    else
+    {
+      result.errors++;
+    }
+  }
+
+  // Wait for the broker to take everything on every connection before stopping the clock
+  pool->setPublishQoS(MQTT::QOS1);
+  for (int i = 0; i < PUBLISH_BENCH_POOL_SIZE; i++)
+  {
+    pool->shard(i).publish("var00", 1.0f);
+  }
+
+  result.messages = count;
+  siprintf(api, "pool-%d", PUBLISH_BENCH_POOL_SIZE);
+  benchSummarize(samples, count, 15, NBMQTTCycleCounter::toMicros(NBMQTTCycleCounter::now() - start), result);
+  printResult(api, MQTT::QOS0, 15, result);
+}
+
+#if MQTTCLIENT_PROFILE
+/**
+ * @brief Print how the raw client time splits into stages, over every case.
+ *
+ */
+static void printProfile()
+{
+  static NBMQTTProfile profile; // Static, too large for the stack of the calling task
+
+  rawClient->getProfile(profile);
+  iprintf("\r\n%-10s %8s %8s %8s %8s\r\n", "stage", "count", "p50_ns", "p99_ns", "max_ns");
+  for (int i = 0; i < NBMQTT_STAGES; i++)
+  {
+    const NBMQTTHistogram &stage = profile.stages[i];
+    iprintf("%-10s %8lu %8lu %8lu %8lu\r\n", NBMQTTProfile::name(i), stage.count, stage.percentile(50),
+            stage.percentile(99), stage.max);
+  }
+}
+#endif
+
+/**
+ * @brief Raw MQTT::Client::publish cases, on a client and socket that only
+ * live for the cases.
+ *
+ * @param host Local broker host
+ * @param port Local broker port
+ */
+static void benchRaw(const char *host, uint16_t port)
+{
+  NBMQTTSocket *rawSocket = new NBMQTTSocket();
+  MQTTPacket_connectData options = MQTTPacket_connectData_initializer;
+  options.clientID.cstring = (char *)PUBLISH_BENCH_CLIENT_ID;
+  options.keepAliveInterval = 0;
+
+  rawClient = new bench_client_t(*rawSocket);
+  if (rawSocket->connect((char *)host, port) != 0 || rawClient->connect(options) != MQTT::SUCCESS)
+  {
+    iprintf("Raw client connection to the benchmark broker failed\r\n");
+  }
+  else
+  {
+    for (size_t q = 0; q < sizeof(qosLevels) / sizeof(qosLevels[0]); q++)
+    {
+      for (size_t s = 0; s < sizeof(payloadSizes) / sizeof(payloadSizes[0]); s++)
+      {
+        benchRawClient(qosLevels[q], payloadSizes[s]);
+      }
+    }
+#if MQTTCLIENT_PROFILE
+    printProfile();
+#endif
+    rawClient->disconnect();
+  }
+  rawSocket->disconnect();
+
+  delete rawClient;
+  delete rawSocket;
+  rawClient = nullptr;
+}
+/*------------------------------------------------*/
+
+/*---------------------  Public functions ---------------------*/
+void RunPublishBenchmark(Ubidots &ubidots, const char *host, uint16_t port)
+{
+  bool connected = true;
+
+  NBMQTTCycleCounter::init();
+  samples = new uint32_t[PUBLISH_BENCH_MESSAGES];
+  payload = new char[UBIDOTS_MSG_MAX_LEN];
+
+  iprintf("Publish benchmark against %s:%d, %d messages per case\r\n", host, port, PUBLISH_BENCH_MESSAGES);
+  printHeader();
+
+  // --- Ubidots::publish --- //
+  for (size_t q = 0; connected && q < sizeof(qosLevels) / sizeof(qosLevels[0]); q++)
+  {
+    for (size_t s = 0; s < sizeof(variableSizes) / sizeof(variableSizes[0]); s++)
+    {
+      if (!ubidots.isConnected() && !ubidots.connect())
+      {
+        iprintf("Ubidots connection to the benchmark broker failed\r\n");
+        connected = false;
+        break;
+      }
+      benchUbidots(ubidots, qosLevels[q], variableSizes[s]);
+    }
+  }
+  ubidots.setPublishQoS(MQTT::QOS0);
+
+  if (connected)
+  {
+    // --- UbidotsPool::publish --- //
+    benchPool(host, port);
+
+    // --- Raw MQTT::Client::publish --- //
+    benchRaw(host, port);
+  }
+
+  delete[] samples;
+  delete[] payload;
+  samples = nullptr;
+  payload = nullptr;
+}
+/*------------------------------------------------*/
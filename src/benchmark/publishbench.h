@@ -0,0 +1,45 @@
+/**
+ * @file publishbench.h
+ *
+ * @brief End-to-end publish throughput and latency benchmark
+ *
+ * Drives Ubidots::publish and a raw MQTT::Client::publish against a local
+ * broker (see tools/loopback-broker) and prints messages/s, bytes/s and the
+ * p50/p99/p999 publish latency for QoS0 and QoS1. For QoS1 the latency is
+ * publish to PUBACK; for QoS0 it is the time spent in publish (serialize and
+ * write), since there is no ack.
+ *
+ * The pool case publishes QoS0 from this task through an UbidotsPool of
+ * PUBLISH_BENCH_POOL_SIZE connections, to compare with the single connection
+ * ubidots rows. tools/build/publish-bench -P measures the QoS1 scaling, one
+ * thread per connection.
+ *
+ */
+
+#ifndef PUBLISHBENCH_H_
+#define PUBLISHBENCH_H_
+
+#include <ubidots.h>
+
+/*---------------------  Definitions ---------------------*/
+#define PUBLISH_BENCH_MESSAGES 1000               /*!< Messages per benchmark case */
+#define PUBLISH_BENCH_TOPIC "/v1.6/devices/bench" /*!< Topic used by the raw client cases */
+#define PUBLISH_BENCH_CLIENT_ID "NETBURNER-BENCH" /*!< Client ID of the raw client */
+#define PUBLISH_BENCH_POOL_SIZE 4                 /*!< Connections of the pool case */
+#define PUBLISH_BENCH_POOL_DEVICE "bench"         /*!< Device of the pool case, client IDs bench-<n> */
+#define PUBLISH_BENCH_POOL_TOKEN "BBFF-bench"     /*!< Token of the pool case, the loopback broker takes any without -t */
+#define PUBLISH_BENCH_POOL_VARIABLES 16           /*!< Variables spread over the pool connections */
+/*------------------------------------------------*/
+
+/*---------------------  Functions ---------------------*/
+/**
+ * @brief Run every benchmark case and print the results to the console.
+ *
+ * @param ubidots Ubidots object, already pointed to the local broker with setBroker()
+ * @param host Local broker host, used by the raw client cases
+ * @param port Local broker port
+ */
+void RunPublishBenchmark(Ubidots &ubidots, const char *host, uint16_t port);
+/*------------------------------------------------*/
+
+#endif /* PUBLISHBENCH_H_ */
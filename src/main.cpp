@@ -7,6 +7,8 @@
 #include <system.h>
 #include <nettypes.h>
 #include <netinterface.h>
+#include <http.h>
+#include <iosys.h>
 
 #include <MQTTClient.h>
 #include <NBMQTTSocket.h>
@@ -14,6 +16,8 @@
 #include <NBMQTTCountdown.h>
 
 #include <ubidots.h>
+#include <ubidotsstats.h>
+#include <publishbench.h>
 
 /*---------------------  Globals ---------------------*/
 const char *AppName = "NetBurner-Ubidots-MQTT";
@@ -30,12 +34,42 @@ const char *AppName = "NetBurner-Ubidots-MQTT";
  */
 #define UBIDOTS_DEVICE_NAME "Add the device name here"
 
+/**
+ * @brief Define to run the publish benchmark against a local broker (tools/loopback-broker)
+ * instead of the demo. Start the broker with -b 0.0.0.0 so the module can reach it.
+ *
+ */
+// #define UBIDOTS_BENCHMARK_BROKER "192.168.1.10"
+#define UBIDOTS_BENCHMARK_PORT 1883
+
+/**
+ * @brief Define to capture the MQTT packets into a buffer of this size, served
+ * as capture.bin for tools/build/mqtt-replay.
+ *
+ */
+// #define UBIDOTS_CAPTURE_LEN (64 * 1024)
+
 /**
  * @brief Global object to create Ubidots instance.
  *
  */
 /*               Token,         Device,Name,         SSL, Console log */
 Ubidots ubidots(UBIDOTS_TOKEN, UBIDOTS_DEVICE_NAME, false, true); // Init ubidots object
+
+#if defined(UBIDOTS_CAPTURE_LEN)
+/**
+ * @brief MQTT packet capture, from the first connection until the buffer is full.
+ *
+ */
+unsigned char captureBuffer[UBIDOTS_CAPTURE_LEN];
+NBMQTTCapture capture(captureBuffer, sizeof(captureBuffer));
+#endif
+
+/**
+ * @brief Relay state, set from the "relay" variable.
+ *
+ */
+bool relayState = false;
 /*------------------------------------------------*/
 
 /*---------------------  Callbacks ---------------------*/
@@ -50,12 +84,32 @@ void ubidotsSubscribeHandler(MQTT::MessageData &md)
 
   MQTT::Message &message = md.message;
   MQTTString &topic = md.topicName;
-  reinterpret_cast<char *>(message.payload)[message.payloadlen] = 0;
+  ubidots_value_t value;
 
-  iprintf("Message %d arrived: qos %d, retained %d, dup %d, packetid %d\r\nPayload: %s\r\n",
-          ++arrivedcount, message.qos, message.retained, message.dup, message.id, (char *)message.payload);
+  iprintf("Message %d arrived: qos %d, retained %d, dup %d, packetid %d\r\nPayload: %.*s\r\n",
+          ++arrivedcount, message.qos, message.retained, message.dup, message.id, (int)message.payloadlen, (char *)message.payload);
 
   iprintf("Topic %.*s\r\n", topic.lenstring.len, (char *)topic.lenstring.data);
+
+  if (ubidotsParseValue(message, &value))
+  { // iprintf has no floating point, print it in hundredths
+    long hundredths = (long)(value.value * 100.0 + ((value.value < 0) ? -0.5 : 0.5));
+    iprintf("Value %s%ld.%02ld\r\n", (hundredths < 0) ? "-" : "", labs(hundredths) / 100, labs(hundredths) % 100);
+  }
+}
+
+/**
+ * @brief Callback to handle a typed subscription, the value is already parsed.
+ *
+ * @param ctx Context given to subscribe, the relay state
+ * @param value New relay state
+ * @param timestamp Milliseconds since the epoch, 0 when absent
+ */
+void ubidotsRelayHandler(void *ctx, bool value, int64_t timestamp)
+{
+  bool *relay = static_cast<bool *>(ctx);
+  *relay = value;
+  iprintf("Relay %s\r\n", value ? "on" : "off");
 }
 
 /**
@@ -69,6 +123,7 @@ void cb_connected(void *pvParameter)
 
   // NOTE: Subscribtions MUST be performed after sucessfull conection
   ubidots.subscribe("leds", ubidotsSubscribeHandler);
+  ubidots.subscribe("relay", ubidotsRelayHandler, &relayState);
 }
 
 /**
@@ -82,32 +137,124 @@ void cb_error(void *pvParameter)
   iprintf("  ---> Ubidots broker error[%d] <--- \n", state);
 }
 
+/**
+ * @brief Serve the statistics polled by the dashboard page (html/index.html).
+ *
+ * @param sock HTTP socket
+ * @param request HTTP request
+ * @retval int 1, request handled
+ */
+int statsJsonHandler(int sock, HTTP_Request &request)
+{
+  static ubidots_stats_t stats;                 // Static, the web server handles one request at a time
+  static char json[UBIDOTS_STATS_JSON_MAX_LEN]; // JSON of the snapshot
+
+  ubidots.getStats(stats);
+  int len = ubidotsStatsJson(json, sizeof(json), &stats);
+
+  writestring(sock, "HTTP/1.0 200 OK\r\nContent-Type: application/json\r\nCache-Control: no-store\r\n\r\n");
+  if (len > 0)
+    writeall(sock, json, len);
+  return 1;
+}
+
+/**
+ * @brief GET stats.json, ahead of the compiled pages.
+ *
+ */
+CallBackFunctionPageHandler statsJsonPage("stats.json", statsJsonHandler, tGet, 0, true);
+
+#if MQTTCLIENT_TRACE
+/**
+ * @brief Serve the last MQTT packets, decoded now, one per line.
+ *
+ * @param sock HTTP socket
+ * @param request HTTP request
+ * @retval int 1, request handled
+ */
+int traceTextHandler(int sock, HTTP_Request &request)
+{
+  char line[200];
+  uint32_t cursor = 0;
+
+  writestring(sock, "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\nCache-Control: no-store\r\n\r\n");
+  while (ubidots.readTrace(cursor, line, sizeof(line)))
+  {
+    writestring(sock, line);
+    writestring(sock, "\r\n");
+  }
+  return 1;
+}
+
+/**
+ * @brief GET trace.txt, ahead of the compiled pages.
+ *
+ */
+CallBackFunctionPageHandler traceTextPage("trace.txt", traceTextHandler, tGet, 0, true);
+#endif
+
+#if defined(UBIDOTS_CAPTURE_LEN)
+/**
+ * @brief Serve the packet capture as it stands, whole packets only.
+ *
+ * @param sock HTTP socket
+ * @param request HTTP request
+ * @retval int 1, request handled
+ */
+int captureBinHandler(int sock, HTTP_Request &request)
+{
+  writestring(sock, "HTTP/1.0 200 OK\r\nContent-Type: application/octet-stream\r\n"
+                    "Content-Disposition: attachment; filename=\"capture.bin\"\r\nCache-Control: no-store\r\n\r\n");
+  writeall(sock, (const char *)capture.data(), capture.size());
+  return 1;
+}
+
+/**
+ * @brief GET capture.bin, ahead of the compiled pages.
+ *
+ */
+CallBackFunctionPageHandler captureBinPage("capture.bin", captureBinHandler, tGet, 0, true);
+#endif
+
 /*------------------------------------------------*/
 
 void UserMain(void *pd)
 {
   init();
+  StartHttp(); // Dashboard on the on-chip web pages
   WaitForActiveNetwork(TICKS_PER_SECOND * 10); // Wait for DHCP address
   iprintf("Application started\n");
 
   ubidots.registerCallback(UBIDOTS_EVENT_CONNECTED, cb_connected); // Register connected callback
   ubidots.registerCallback(UBIDOTS_EVENT_ERROR, cb_error);         // Register error callback
 
+#if defined(UBIDOTS_BENCHMARK_BROKER)
+  ubidots.setBroker(UBIDOTS_BENCHMARK_BROKER, UBIDOTS_BENCHMARK_PORT); // Use the local broker
+  RunPublishBenchmark(ubidots, UBIDOTS_BENCHMARK_BROKER, UBIDOTS_BENCHMARK_PORT);
+#endif
+
+  ubidots.setRateLimit(0.5f); // One message every 2 seconds
+#if defined(UBIDOTS_CAPTURE_LEN)
+  ubidots.setCapture(&capture); // Before the first connect()
+#endif
+
   float demo = 0;
 
   while (1)
   {
     if (ubidots.isConnected())
     { // Is Ubidots MQTT connected?
-      demo += 2;
-      ubidots.publish("demo", demo); // Send data to Ubidots
-      ubidots.keepAlive();           // Issue keep alive and receive data
+      if (ubidots.publishWaitMs() == 0)
+      { // Within the publish rate
+        demo += 2;
+        ubidots.publish("demo", demo); // Send data to Ubidots
+      }
+      ubidots.keepAlive(); // Issue keep alive and receive data
     }
     else
     {
       ubidots.connect(); // Try to connect
+      OSTimeDly(TICKS_PER_SECOND * 2);
     }
-
-    OSTimeDly(TICKS_PER_SECOND * 2);
   }
 }
@@ -27,7 +27,6 @@
 #include "FP.h"
 #include "MQTTPacket.h"
 #include <stdio.h>
-#include "MQTTLogging.h"
 
 #if !defined(MQTTCLIENT_QOS1)
 #define MQTTCLIENT_QOS1 1
@@ -35,6 +34,47 @@
 #if !defined(MQTTCLIENT_QOS2)
 #define MQTTCLIENT_QOS2 0
 #endif
+#if !defined(MQTTCLIENT_BATCH)
+#define MQTTCLIENT_BATCH 0  // batch receive mode, needs Network::available()
+#endif
+#if !defined(MQTTCLIENT_BATCH_MAX_MESSAGES)
+#define MQTTCLIENT_BATCH_MAX_MESSAGES 16  // max messages handed to the batch handler at once
+#endif
+#if !defined(MQTTCLIENT_BATCH_BUFFER_SIZE)
+#define MQTTCLIENT_BATCH_BUFFER_SIZE 2048  // bytes of PUBLISH packets kept for one batch
+#endif
+#if !defined(MQTTCLIENT_TOPIC_ALIASES)
+#define MQTTCLIENT_TOPIC_ALIASES 4  // MQTT 5 topic aliases used for publishing, 0 to disable
+#endif
+#if !defined(MQTTCLIENT_TOPIC_ALIAS_LEN)
+#define MQTTCLIENT_TOPIC_ALIAS_LEN 64  // longest topic, with the terminator, given an alias
+#endif
+#if !defined(MQTTCLIENT_STATS)
+#define MQTTCLIENT_STATS 1  // packet counters and timing histograms, needs Timer::stamp() and Timer::us_since()
+#endif
+
+#if !defined(MQTTCLIENT_CAPTURE)
+#define MQTTCLIENT_CAPTURE 1  // setCapture() records the packets for a host replay, needs Timer::now_ms()
+#endif
+#if !defined(MQTTCLIENT_TRACE)
+#define MQTTCLIENT_TRACE 1  // ring of the last packets sent and received, decoded when read, needs Timer::stamp()
+#endif
+#if !defined(MQTTCLIENT_PROFILE)
+#define MQTTCLIENT_PROFILE 0  // per stage timing histograms of publish, cycle and delivery, needs Timer::ns_since()
+#endif
+
+#if MQTTCLIENT_STATS
+#include "NBMQTTStats.h"
+#endif
+#if MQTTCLIENT_TRACE
+#include "NBMQTTTrace.h"
+#endif
+#if MQTTCLIENT_CAPTURE
+#include "NBMQTTCapture.h"
+#endif
+#if MQTTCLIENT_PROFILE
+#include "NBMQTTProfile.h"
+#endif
 
 namespace MQTT {
 
@@ -63,6 +103,12 @@ struct MessageData {
   MQTTString& topicName;
 };
 
+// one message of a batch, topic and payload point into the client's batch buffer
+struct MessageView {
+  MQTTString topicName;
+  struct Message message;
+};
+
 struct connackData {
   int rc;
   bool sessionPresent;
@@ -87,6 +133,76 @@ class PacketId {
   int next;
 };
 
+// set of packet ids, open addressed with linear probing in a power of two table at least twice
+// CAPACITY, so lookups stay O(1) whatever the ids are; id 0 is never valid in MQTT and marks a free slot
+template <int CAPACITY>
+class PacketIdSet {
+ public:
+  PacketIdSet() {
+    clear();
+  }
+
+  void clear() {
+    for (int i = 0; i < SIZE; ++i)
+      ids[i] = 0;
+    count = 0;
+  }
+
+  bool contains(unsigned short id) const {
+    for (int i = slot(id); ids[i] != 0; i = (i + 1) & MASK)
+      if (ids[i] == id)
+        return true;
+    return false;
+  }
+
+  // false only when the set is full
+  bool insert(unsigned short id) {
+    int i = slot(id);
+    for (; ids[i] != 0; i = (i + 1) & MASK)
+      if (ids[i] == id)
+        return true;
+    if (count == CAPACITY)
+      return false;
+    ids[i] = id;
+    ++count;
+    return true;
+  }
+
+  void remove(unsigned short id) {
+    int i = slot(id);
+    for (; ids[i] != id; i = (i + 1) & MASK)
+      if (ids[i] == 0)
+        return;
+    ids[i] = 0;
+    --count;
+    // shift back the rest of the run, so no lookup stops early at the hole
+    for (int j = (i + 1) & MASK; ids[j] != 0; j = (j + 1) & MASK) {
+      int k = slot(ids[j]);
+      if ((j > i) ? (i < k && k <= j) : (i < k || k <= j))
+        continue;  // home slot is after the hole, the entry stays
+      ids[i] = ids[j];
+      ids[j] = 0;
+      i = j;
+    }
+  }
+
+  int size() const {
+    return count;
+  }
+
+ private:
+  enum { N = 2 * CAPACITY - 1,
+         SIZE = (N | N >> 1 | N >> 2 | N >> 4 | N >> 8 | N >> 16) + 1,
+         MASK = SIZE - 1 };
+
+  static int slot(unsigned short id) {
+    return (int)(((unsigned long)(unsigned short)(id * 40503u) * SIZE) >> 16);  // Fibonacci hash
+  }
+
+  unsigned short ids[SIZE];
+  int count;
+};
+
 /**
  * @class Client
  * @brief blocking, non-threaded MQTT client API
@@ -100,6 +216,8 @@ template <class Network, class Timer, int MAX_MQTT_PACKET_SIZE = 100, int MAX_ME
 class Client {
  public:
   typedef void (*messageHandler)(MessageData&);
+  typedef void (*batchMessageHandler)(MessageView* messages, int count);
+  typedef int (*payloadProducer)(void* context, unsigned char* buf, int buflen, size_t offset);
 
   /** Construct the client
      *  @param network - pointer to an instance of the Network class - must be connected to the endpoint
@@ -118,12 +236,36 @@ class Client {
       defaultMessageHandler.detach();
   }
 
+#if MQTTCLIENT_BATCH
+  /** Set the batch message handler - when set, incoming PUBLISH packets are not delivered one by one to the
+     *  subscription handlers: every complete PUBLISH already buffered by the network is parsed and the whole
+     *  span is handed to this callback in one call, then acknowledged with a single write.
+     *  The views are only valid during the call.
+     *  @param bh - pointer to the callback function.  Set to 0 to go back to per message delivery.
+     */
+  void setBatchMessageHandler(batchMessageHandler bh) {
+    batchHandler = bh;
+  }
+#endif
+
   /** Set a message handling callback.  This can be used outside of the the subscribe method.
      *  @param topicFilter - a topic pattern which can include wildcards
      *  @param mh - pointer to the callback function. If 0, removes the callback if any
      */
   int setMessageHandler(const char* topicFilter, messageHandler mh);
 
+  /** Set a message handling callback to a member function.
+     *  @param topicFilter - a topic pattern which can include wildcards
+     *  @param item - the object the method is called on
+     *  @param method - the member function to be invoked when a message is received
+     */
+  template <class T>
+  int setMessageHandler(const char* topicFilter, T* item, void (T::*method)(MessageData&)) {
+    FP<void, MessageData&> fp;
+    fp.attach(item, method);
+    return setMessageHandler(topicFilter, fp);
+  }
+
   /** MQTT Connect - send an MQTT connect packet down the network and wait for a Connack
      *  The nework object must be connected to the network endpoint before calling this
      *  Default connect options are used
@@ -174,6 +316,21 @@ class Client {
      */
   int publish(const char* topicName, void* payload, size_t payloadlen, unsigned short& id, enum QoS qos = QOS1, bool retained = false);
 
+  /** MQTT Publish - stream a payload that does not have to fit in the send buffer, then wait for all acks
+     *  to complete for all QoSs.  The header and topic are written first, then the payload is written in
+     *  chunks the producer fills in the send buffer.  A streamed publish is not kept for resending on reconnect.
+     *  @param topic - the topic to publish to
+     *  @param payloadlen - the total length of the data
+     *  @param producer - called until payloadlen bytes are produced, with the payload offset to continue from.
+     *  It fills up to buflen bytes of buf and returns how many, or <= 0 to abort, which closes the connection
+     *  as the packet is already partly sent.
+     *  @param context - passed to the producer
+     *  @param qos - the QoS to send the publish at
+     *  @param retained - whether the message should be retained
+     *  @return success code -
+     */
+  int publish(const char* topicName, size_t payloadlen, payloadProducer producer, void* context, enum QoS qos = QOS0, bool retained = false);
+
   /** MQTT Subscribe - send an MQTT subscribe packet and wait for the suback
      *  @param topicFilter - a topic pattern which can include wildcards
      *  @param qos - the MQTT QoS to subscribe at
@@ -191,6 +348,21 @@ class Client {
      */
   int subscribe(const char* topicFilter, enum QoS qos, messageHandler mh, subackData& data);
 
+  /** MQTT Subscribe with a member function callback, so the handler can reach its object's state
+     *  @param topicFilter - a topic pattern which can include wildcards
+     *  @param qos - the MQTT QoS to subscribe at
+     *  @param item - the object the method is called on
+     *  @param method - the member function to be invoked when a message is received for this subscription
+     *  @return success code -
+     */
+  template <class T>
+  int subscribe(const char* topicFilter, enum QoS qos, T* item, void (T::*method)(MessageData&)) {
+    FP<void, MessageData&> fp;
+    subackData data;
+    fp.attach(item, method);
+    return subscribe(topicFilter, qos, fp, data);
+  }
+
   /** MQTT Unsubscribe - send an MQTT unsubscribe packet and wait for the unsuback
      *  @param topicFilter - a topic pattern which can include wildcards
      *  @return success code -
@@ -217,6 +389,57 @@ class Client {
     return isconnected;
   }
 
+  /** The limits the server sent in its MQTT 5 CONNACK.  publish waits for the acks of each QoS 1 or 2
+     *  publish before returning, so the client never has more than one in flight, within any receive maximum.
+     *  @return receive maximum, topic alias maximum and maximum packet size, 0 for the ones not sent
+     */
+  const MQTTProperties& getServerProperties() {
+    return serverProperties;
+  }
+
+#if MQTTCLIENT_STATS
+  /** Copy the counters and histograms, safe while another task uses the client
+     *  @param out - the snapshot
+     */
+  void getStats(NBMQTTStats& out) const {
+    stats.snapshot(out);
+  }
+#endif
+
+#if MQTTCLIENT_PROFILE
+  /** Copy the per stage histograms, safe while another task uses the client
+     *  @param out - the snapshot
+     */
+  void getProfile(NBMQTTProfile& out) const {
+    profile.snapshot(out);
+  }
+#endif
+
+#if MQTTCLIENT_CAPTURE
+  /** Record every packet sent and read from now on, for tools/replay; call it from the task using the client
+     *  @param capture - where to, 0 to stop
+     */
+  void setCapture(NBMQTTCapture* capture) {
+    this->capture = capture;
+  }
+#endif
+
+#if MQTTCLIENT_TRACE
+  /** Read the packet trace, oldest first, safe while another task uses the client
+     *  @param cursor - 0 for the oldest packet kept, then left as returned to read the next ones
+     *  @param line - the packet, decoded with MQTTFormat
+     *  @param lineLen - size of line
+     *  @return false once there is no newer packet
+     */
+  bool readTrace(uint32_t& cursor, char* line, int lineLen) const {
+    NBMQTTTraceEntry entry;
+    if (!trace.read(cursor, entry))
+      return false;
+    NBMQTTTrace::format(line, lineLen, entry, Timer::us_since(entry.stamp));
+    return true;
+  }
+#endif
+
  private:
   void closeSession();
   void cleanSession();
@@ -224,12 +447,25 @@ class Client {
   int waitfor(int packet_type, Timer& timer);
   int keepalive();
   int publish(int len, Timer& timer, enum QoS qos);
+  int publishAck(Timer& timer, enum QoS qos);
 
   int decodePacket(int* value, int timeout);
   int readPacket(Timer& timer);
   int sendPacket(int length, Timer& timer);
+  int sendBytes(unsigned char* buf, int length, Timer& timer);
   int deliverMessage(MQTTString& topicName, Message& message);
+#if MQTTCLIENT_BATCH
+  int deliverBatch(Timer& timer, int& packet_type);
+#endif
   bool isTopicMatched(char* topicFilter, MQTTString& topicName);
+  void updateHandlerPrefix();
+  int setMessageHandler(const char* topicFilter, FP<void, MessageData&> fp);
+  int subscribe(const char* topicFilter, enum QoS qos, FP<void, MessageData&> fp, subackData& data);
+  unsigned short useTopicAlias(MQTTString& topicName, bool omitTopic);
+
+  MQTTProperties* v5(MQTTProperties& properties) {  // properties for the codecs, which take NULL before MQTT 5
+    return (mqttVersion == 5) ? &properties : 0;
+  }
 
   Network& ipstack;
   unsigned long command_timeout_ms;
@@ -246,13 +482,44 @@ class Client {
 
   struct MessageHandlers {
     const char* topicFilter;
+    int topicFilterLen;
     FP<void, MessageData&> fp;
   } messageHandlers[MAX_MESSAGE_HANDLERS];  // Message handlers are indexed by subscription topic
 
+  const char* handlerPrefix;  // literal levels every topic filter starts with, compared once per message
+  int handlerPrefixLen;
+
   FP<void, MessageData&> defaultMessageHandler;
 
+#if MQTTCLIENT_BATCH
+  batchMessageHandler batchHandler;
+  unsigned char batchbuf[MQTTCLIENT_BATCH_BUFFER_SIZE];
+  MessageView batchMessages[MQTTCLIENT_BATCH_MAX_MESSAGES];
+  unsigned short batchAckIds[MQTTCLIENT_BATCH_MAX_MESSAGES];
+  unsigned char batchAckTypes[MQTTCLIENT_BATCH_MAX_MESSAGES];
+#endif
+
   bool isconnected;
 
+  unsigned char mqttVersion;
+  MQTTProperties serverProperties;  // from the MQTT 5 CONNACK
+#if MQTTCLIENT_STATS
+  NBMQTTStats stats;
+#endif
+#if MQTTCLIENT_TRACE
+  NBMQTTTrace trace;
+#endif
+#if MQTTCLIENT_CAPTURE
+  NBMQTTCapture* capture;
+#endif
+#if MQTTCLIENT_PROFILE
+  NBMQTTProfile profile;
+#endif
+#if MQTTCLIENT_TOPIC_ALIASES > 0
+  char topicAliases[MQTTCLIENT_TOPIC_ALIASES][MQTTCLIENT_TOPIC_ALIAS_LEN];  // topic of alias i + 1, empty when unused
+  int nextTopicAlias;                                                       // the alias to (re)assign next
+#endif
+
 #if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
   unsigned char pubbuf[MAX_MQTT_PACKET_SIZE];  // store the last publish for sending on reconnect
   int inflightLen;
@@ -263,12 +530,9 @@ class Client {
 #if MQTTCLIENT_QOS2
   bool pubrel;
 #if !defined(MAX_INCOMING_QOS2_MESSAGES)
-#define MAX_INCOMING_QOS2_MESSAGES 10
+#define MAX_INCOMING_QOS2_MESSAGES 10  // incoming QoS 2 ids tracked between PUBLISH and PUBREL
 #endif
-  unsigned short incomingQoS2messages[MAX_INCOMING_QOS2_MESSAGES];
-  bool isQoS2msgidFree(unsigned short id);
-  bool useQoS2msgid(unsigned short id);
-  void freeQoS2msgid(unsigned short id);
+  PacketIdSet<MAX_INCOMING_QOS2_MESSAGES> incomingQoS2messages;  // ids received but not yet released
 #endif
 };
 
@@ -278,6 +542,7 @@ template <class Network, class Timer, int a, int MAX_MESSAGE_HANDLERS>
 void MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::cleanSession() {
   for (int i = 0; i < MAX_MESSAGE_HANDLERS; ++i)
     messageHandlers[i].topicFilter = 0;
+  updateHandlerPrefix();
 
 #if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
   inflightMsgid = 0;
@@ -286,8 +551,7 @@ void MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::cleanSession() {
 
 #if MQTTCLIENT_QOS2
   pubrel = false;
-  for (int i = 0; i < MAX_INCOMING_QOS2_MESSAGES; ++i)
-    incomingQoS2messages[i] = 0;
+  incomingQoS2messages.clear();
 #endif
 }
 
@@ -303,62 +567,70 @@ template <class Network, class Timer, int a, int MAX_MESSAGE_HANDLERS>
 MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::Client(Network& network, unsigned int command_timeout_ms) : ipstack(network), packetid() {
   this->command_timeout_ms = command_timeout_ms;
   cleansession = true;
+  mqttVersion = 4;
+#if MQTTCLIENT_BATCH
+  batchHandler = 0;
+#endif
+#if MQTTCLIENT_CAPTURE
+  capture = 0;
+#endif
   closeSession();
 }
 
-#if MQTTCLIENT_QOS2
-template <class Network, class Timer, int a, int b>
-bool MQTT::Client<Network, Timer, a, b>::isQoS2msgidFree(unsigned short id) {
-  for (int i = 0; i < MAX_INCOMING_QOS2_MESSAGES; ++i) {
-    if (incomingQoS2messages[i] == id)
-      return false;
-  }
-  return true;
-}
-
-template <class Network, class Timer, int a, int b>
-bool MQTT::Client<Network, Timer, a, b>::useQoS2msgid(unsigned short id) {
-  for (int i = 0; i < MAX_INCOMING_QOS2_MESSAGES; ++i) {
-    if (incomingQoS2messages[i] == 0) {
-      incomingQoS2messages[i] = id;
-      return true;
-    }
-  }
-  return false;
-}
-
 template <class Network, class Timer, int a, int b>
-void MQTT::Client<Network, Timer, a, b>::freeQoS2msgid(unsigned short id) {
-  for (int i = 0; i < MAX_INCOMING_QOS2_MESSAGES; ++i) {
-    if (incomingQoS2messages[i] == id) {
-      incomingQoS2messages[i] = 0;
-      return;
-    }
-  }
-}
-#endif
-
-template <class Network, class Timer, int a, int b>
-int MQTT::Client<Network, Timer, a, b>::sendPacket(int length, Timer& timer) {
+int MQTT::Client<Network, Timer, a, b>::sendBytes(unsigned char* buf, int length, Timer& timer) {
   int rc = FAILURE,
       sent = 0;
 
   while (sent < length && !timer.expired()) {
-    rc = ipstack.write(&sendbuf[sent], length - sent, timer.left_ms());
+    rc = ipstack.write(&buf[sent], length - sent, timer.left_ms());
     if (rc < 0)  // there was an error writing the data
       break;
     sent += rc;
   }
+#if MQTTCLIENT_STATS
+  NBMQTTStats::count(stats.bytesOut, sent);
+#endif
   if (sent == length) {
     if (this->keepAliveInterval > 0)
-      last_sent.countdown(this->keepAliveInterval);  // record the fact that we have successfully sent the packet
+      last_sent.countdown(this->keepAliveInterval);  // record the fact that we have successfully sent the data
     rc = SUCCESS;
   } else
     rc = FAILURE;
+  return rc;
+}
+
+template <class Network, class Timer, int a, int b>
+int MQTT::Client<Network, Timer, a, b>::sendPacket(int length, Timer& timer) {
+#if MQTTCLIENT_STATS
+  unsigned int start = Timer::stamp();
+#endif
+  int rc = sendBytes(sendbuf, length, timer);
 
-#if defined(MQTT_DEBUG)
-  char printbuf[150];
-  DEBUG("Rc %d from sending packet %s\n", rc, MQTTFormat_toServerString(printbuf, sizeof(printbuf), sendbuf, length));
+#if MQTTCLIENT_STATS
+  stats.sendUs.record(Timer::us_since(start));
+  if (rc != SUCCESS)
+    NBMQTTStats::count(stats.sendErrors);
+#endif
+
+#if MQTTCLIENT_STATS || MQTTCLIENT_TRACE || MQTTCLIENT_CAPTURE
+  // the buffer can hold several packets, as the acks of a batch
+  for (int pos = 0; pos < length;) {
+    int rem_len = 0;
+    int packet_len = 1 + MQTTPacket_decodeBuf(sendbuf + pos + 1, &rem_len) + rem_len;
+#if MQTTCLIENT_STATS
+    if (rc == SUCCESS)
+      NBMQTTStats::count(stats.packetsOut[sendbuf[pos] >> 4]);
+#endif
+#if MQTTCLIENT_TRACE
+    trace.record(NBMQTT_TRACE_SENT, sendbuf + pos, packet_len, packet_len, rc, Timer::stamp());
+#endif
+#if MQTTCLIENT_CAPTURE
+    if (capture != 0 && rc == SUCCESS)
+      capture->packet<Timer>(NBMQTT_CAPTURE_SENT, sendbuf + pos, packet_len);
+#endif
+    pos += packet_len;
+  }
 #endif
   return rc;
 }
@@ -400,11 +672,17 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::readPacket(Timer& tim
   MQTTHeader header = {0};
   int len = 0;
   int rem_len = 0;
+#if MQTTCLIENT_PROFILE
+  unsigned int start;
+#endif
 
   /* 1. read the header byte.  This has the packet type in it */
   rc = ipstack.read(readbuf, 1, timer.left_ms());
   if (rc != 1)
     goto exit;
+#if MQTTCLIENT_PROFILE
+  start = Timer::stamp();
+#endif
 
   len = 1;
   /* 2. read the remaining length.  This is variable in itself */
@@ -422,16 +700,24 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::readPacket(Timer& tim
 
   header.byte = readbuf[0];
   rc = header.bits.type;
+#if MQTTCLIENT_STATS
+  NBMQTTStats::count(stats.packetsIn[rc]);
+  NBMQTTStats::count(stats.bytesIn, len + rem_len);
+#endif
+#if MQTTCLIENT_CAPTURE
+  if (capture != 0)
+    capture->packet<Timer>(NBMQTT_CAPTURE_RECEIVED, readbuf, len + rem_len);
+#endif
   if (this->keepAliveInterval > 0)
     last_received.countdown(this->keepAliveInterval);  // record the fact that we have successfully received a packet
+#if MQTTCLIENT_PROFILE
+  profile.stages[NBMQTT_STAGE_READ].record(Timer::ns_since(start));
+#endif
 exit:
-
-#if defined(MQTT_DEBUG)
-  if (rc >= 0) {
-    char printbuf[50];
-    DEBUG("Rc %d from receiving packet %s\n", rc,
-          MQTTFormat_toClientString(printbuf, sizeof(printbuf), readbuf, len));
-  }
+#if MQTTCLIENT_TRACE
+  if (len > 0)  // nothing when no packet started, as on a cycle() timeout
+    trace.record(NBMQTT_TRACE_RECEIVED, readbuf, (header.byte != 0) ? len + rem_len : len, len + rem_len,
+                 (header.byte != 0) ? SUCCESS : ((rc < 0) ? rc : FAILURE), Timer::stamp());
 #endif
   return rc;
 }
@@ -441,39 +727,87 @@ exit:
 // + and # can only be next to separator
 template <class Network, class Timer, int a, int b>
 bool MQTT::Client<Network, Timer, a, b>::isTopicMatched(char* topicFilter, MQTTString& topicName) {
-  char* curf = topicFilter;
-  char* curn = topicName.lenstring.data;
-  char* curn_end = curn + topicName.lenstring.len;
+  return MQTTTopic_matches(topicFilter, strlen(topicFilter), topicName.lenstring.data, topicName.lenstring.len);
+}
 
-  while (*curf && curn < curn_end) {
-    if (*curn == '/' && *curf != '/')
-      break;
-    if (*curf != '+' && *curf != '#' && *curf != *curn)
-      break;
-    if (*curf == '+') {  // skip until we meet the next separator, or end of string
-      char* nextpos = curn + 1;
-      while (nextpos < curn_end && *nextpos != '/')
-        nextpos = ++curn + 1;
-    } else if (*curf == '#')
-      curn = curn_end - 1;  // skip until end of string
-    curf++;
-    curn++;
-  };
+// Find the literal levels all the message handler topic filters share
+template <class Network, class Timer, int a, int MAX_MESSAGE_HANDLERS>
+void MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::updateHandlerPrefix() {
+  handlerPrefix = 0;
+  handlerPrefixLen = 0;
+  for (int i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
+    const char* filter = messageHandlers[i].topicFilter;
+    int len = messageHandlers[i].topicFilterLen;
+    if (filter == 0)
+      continue;
+    if (handlerPrefix == 0) {
+      handlerPrefix = filter;
+      handlerPrefixLen = MQTTTopic_levelPrefix(filter, len, filter, len);
+    } else {
+      int prefixLen = MQTTTopic_levelPrefix(handlerPrefix, strlen(handlerPrefix), filter, len);
+      if (prefixLen < handlerPrefixLen)
+        handlerPrefixLen = prefixLen;
+    }
+  }
+}
 
-  return (curn == curn_end) && (*curf == '\0');
+/**
+ * Pick the MQTT 5 topic alias of a publish.  A topic seen before in this connection goes out as
+ * its alias alone, a new one gets the next alias, reassigning the oldest once all are in use.
+ * @param topicName the topic, emptied when the alias alone is enough
+ * @param omitTopic whether the alias alone may be sent
+ * @return the alias, 0 for none
+ */
+template <class Network, class Timer, int a, int b>
+unsigned short MQTT::Client<Network, Timer, a, b>::useTopicAlias(MQTTString& topicName, bool omitTopic) {
+#if MQTTCLIENT_TOPIC_ALIASES > 0
+  int count = (serverProperties.topicAliasMaximum < MQTTCLIENT_TOPIC_ALIASES) ? serverProperties.topicAliasMaximum : MQTTCLIENT_TOPIC_ALIASES;
+  size_t len = strlen(topicName.cstring);
+
+  if (mqttVersion != 5 || count == 0 || len >= MQTTCLIENT_TOPIC_ALIAS_LEN)
+    return 0;
+  for (int i = 0; i < count; ++i) {
+    if (strcmp(topicAliases[i], topicName.cstring) == 0) {
+      if (omitTopic)
+        topicName.cstring = (char*)"";
+      return i + 1;
+    }
+  }
+  int i = nextTopicAlias;
+  nextTopicAlias = (nextTopicAlias + 1) % count;
+  memcpy(topicAliases[i], topicName.cstring, len + 1);
+  return i + 1;
+#else
+  return 0;
+#endif
 }
 
 template <class Network, class Timer, int a, int MAX_MESSAGE_HANDLERS>
 int MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::deliverMessage(MQTTString& topicName, Message& message) {
   int rc = FAILURE;
+#if MQTTCLIENT_PROFILE
+  unsigned int start = Timer::stamp();
+#endif
 
-  // we have to find the right message handler - indexed by topic
-  for (int i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
-    if (messageHandlers[i].topicFilter != 0 && (MQTTPacket_equals(&topicName, (char*)messageHandlers[i].topicFilter) ||
-                                                isTopicMatched((char*)messageHandlers[i].topicFilter, topicName))) {
+  // we have to find the right message handler - indexed by topic. The prefix shared by all topic
+  // filters is compared once, then each filter only matches the rest of the topic
+  const char* name = topicName.lenstring.data;
+  int namelen = topicName.lenstring.len;
+  int skip = handlerPrefixLen;
+  bool prefixMatched = (handlerPrefix != 0 && namelen >= skip && MQTTTopic_compare(name, handlerPrefix, skip) == skip);
+
+  for (int i = 0; prefixMatched && i < MAX_MESSAGE_HANDLERS; ++i) {
+    if (messageHandlers[i].topicFilter != 0 && MQTTTopic_matches(messageHandlers[i].topicFilter + skip, messageHandlers[i].topicFilterLen - skip,
+                                                                 name + skip, namelen - skip)) {
       if (messageHandlers[i].fp.attached()) {
         MessageData md(topicName, message);
+#if MQTTCLIENT_PROFILE
+        unsigned int called = Timer::stamp();
+#endif
         messageHandlers[i].fp(md);
+#if MQTTCLIENT_PROFILE
+        profile.stages[NBMQTT_STAGE_HANDLER].record(Timer::ns_since(called));
+#endif
         rc = SUCCESS;
       }
     }
@@ -481,12 +815,113 @@ int MQTT::Client<Network, Timer, a, MAX_MESSAGE_HANDLERS>::deliverMessage(MQTTSt
 
   if (rc == FAILURE && defaultMessageHandler.attached()) {
     MessageData md(topicName, message);
+#if MQTTCLIENT_PROFILE
+    unsigned int called = Timer::stamp();
+#endif
     defaultMessageHandler(md);
+#if MQTTCLIENT_PROFILE
+    profile.stages[NBMQTT_STAGE_HANDLER].record(Timer::ns_since(called));
+#endif
     rc = SUCCESS;
   }
 
+#if MQTTCLIENT_PROFILE
+  profile.stages[NBMQTT_STAGE_DELIVER].record(Timer::ns_since(start));
+#endif
+  return rc;
+}
+
+#if MQTTCLIENT_BATCH
+/**
+ * Deliver the PUBLISH waiting in readbuf together with every further PUBLISH the network has already
+ * buffered, in one call to the batch handler, then send all their acks with one write.
+ * @param packet_type returns 0, or the type of a packet read but not part of the batch, left in readbuf
+ * @return success code
+ */
+template <class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::deliverBatch(Timer& timer, int& packet_type) {
+  int rc = SUCCESS;
+  int count = 0, acks = 0, used = 0, len = 0;
+
+  while (true) {
+    int rem_len = 0;
+    int pktlen = 1 + MQTTPacket_decodeBuf(readbuf + 1, &rem_len) + rem_len;
+    unsigned char* pkt = readbuf;  // larger than the batch buffer: a batch of its own, left in readbuf
+    if (pktlen <= MQTTCLIENT_BATCH_BUFFER_SIZE - used) {
+      pkt = batchbuf + used;
+      memcpy(pkt, readbuf, pktlen);
+      used += pktlen;
+    } else if (used > 0) {
+      packet_type = PUBLISH;  // no room left, this one starts the next batch
+      break;
+    }
+
+    MessageView& view = batchMessages[count];
+    MQTTString topicName = MQTTString_initializer;
+    int intQoS;
+    view.topicName = topicName;
+    view.message.payloadlen = 0;
+    MQTTProperties properties;
+    if (MQTTV5Deserialize_publish((unsigned char*)&view.message.dup, &intQoS, (unsigned char*)&view.message.retained,
+                                  (unsigned short*)&view.message.id, &view.topicName, v5(properties), (unsigned char**)&view.message.payload,
+                                  (int*)&view.message.payloadlen, pkt, pktlen) != 1) {
+      rc = FAILURE;
+      packet_type = 0;
+      break;
+    }
+    view.message.qos = (enum QoS)intQoS;
+
+    bool deliver = true;
+#if MQTTCLIENT_QOS2
+    if (view.message.qos == QOS2) {
+      if (incomingQoS2messages.contains(view.message.id))
+        deliver = false;  // duplicate, only ack it again
+      else if (!incomingQoS2messages.insert(view.message.id)) {
+#if MQTTCLIENT_TRACE
+        trace.record(NBMQTT_TRACE_QOS2_FULL, pkt, pktlen, pktlen, SUCCESS, Timer::stamp());
+#endif
+        deliver = false;
+      }
+    }
+#endif
+    if (view.message.qos != QOS0) {
+      batchAckIds[acks] = view.message.id;
+      batchAckTypes[acks++] = (view.message.qos == QOS1) ? PUBACK : PUBREC;
+    }
+    if (deliver)
+      ++count;
+
+    packet_type = 0;
+    if (pkt == readbuf || count == MQTTCLIENT_BATCH_MAX_MESSAGES || acks == MQTTCLIENT_BATCH_MAX_MESSAGES || ipstack.available() <= 0)
+      break;
+    if ((packet_type = readPacket(timer)) != PUBLISH)
+      break;  // nothing more, an error, or another packet type to handle after the batch
+  }
+
+  if (count > 0) {
+#if MQTTCLIENT_PROFILE
+    unsigned int called = Timer::stamp();
+#endif
+    batchHandler(batchMessages, count);
+#if MQTTCLIENT_PROFILE
+    profile.stages[NBMQTT_STAGE_HANDLER].record(Timer::ns_since(called));
+#endif
+  }
+
+  for (int i = 0; i < acks; ++i) {
+    if (len + 4 > MAX_MQTT_PACKET_SIZE) {
+      if (sendPacket(len, timer) != SUCCESS)
+        return FAILURE;
+      len = 0;
+    }
+    len += MQTTSerialize_ack(sendbuf + len, MAX_MQTT_PACKET_SIZE - len, batchAckTypes[i], 0, batchAckIds[i]);
+  }
+  if (len > 0 && sendPacket(len, timer) != SUCCESS)
+    rc = FAILURE;
+
   return rc;
 }
+#endif
 
 template <class Network, class Timer, int a, int b>
 int MQTT::Client<Network, Timer, a, b>::yield(unsigned long timeout_ms) {
@@ -511,7 +946,13 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::cycle(Timer& timer) {
       rc = SUCCESS;
 
   int packet_type = readPacket(timer);  // read the socket, see what work is due
+#if MQTTCLIENT_PROFILE
+  unsigned int start = Timer::stamp();
+#endif
 
+#if MQTTCLIENT_BATCH
+dispatch:
+#endif
   switch (packet_type) {
     default:
       // no more data to read, unrecoverable. Or read packet fails due to unexpected network error
@@ -524,12 +965,23 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::cycle(Timer& timer) {
     case SUBACK:
       break;
     case PUBLISH: {
+#if MQTTCLIENT_BATCH
+      if (batchHandler != 0) {
+        if ((rc = deliverBatch(timer, packet_type)) != SUCCESS)
+          goto exit;
+        if (packet_type != 0)
+          goto dispatch;  // a packet that ended the batch is waiting in readbuf
+        packet_type = PUBLISH;
+        break;
+      }
+#endif
       MQTTString topicName = MQTTString_initializer;
       Message msg;
       int intQoS;
+      MQTTProperties properties;
       msg.payloadlen = 0; /* this is a size_t, but deserialize publish sets this as int */
-      if (MQTTDeserialize_publish((unsigned char*)&msg.dup, &intQoS, (unsigned char*)&msg.retained, (unsigned short*)&msg.id, &topicName,
-                                  (unsigned char**)&msg.payload, (int*)&msg.payloadlen, readbuf, MAX_MQTT_PACKET_SIZE) != 1)
+      if (MQTTV5Deserialize_publish((unsigned char*)&msg.dup, &intQoS, (unsigned char*)&msg.retained, (unsigned short*)&msg.id, &topicName,
+                                    v5(properties), (unsigned char**)&msg.payload, (int*)&msg.payloadlen, readbuf, MAX_MQTT_PACKET_SIZE) != 1)
         goto exit;
       msg.qos = (enum QoS)intQoS;
 #if MQTTCLIENT_QOS2
@@ -537,11 +989,16 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::cycle(Timer& timer) {
 #endif
         deliverMessage(topicName, msg);
 #if MQTTCLIENT_QOS2
-      else if (isQoS2msgidFree(msg.id)) {
-        if (useQoS2msgid(msg.id))
+      else if (!incomingQoS2messages.contains(msg.id)) {
+        if (incomingQoS2messages.insert(msg.id))
           deliverMessage(topicName, msg);
-        else
-          WARN("Maximum number of incoming QoS2 messages exceeded");
+#if MQTTCLIENT_TRACE
+        else {
+          int rem_len = 0;
+          int pktlen = 1 + MQTTPacket_decodeBuf(readbuf + 1, &rem_len) + rem_len;
+          trace.record(NBMQTT_TRACE_QOS2_FULL, readbuf, pktlen, pktlen, SUCCESS, Timer::stamp());
+        }
+#endif
       }
 #endif
 #if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
@@ -575,7 +1032,7 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::cycle(Timer& timer) {
       if (rc == FAILURE)
         goto exit;  // there was a problem
       if (packet_type == PUBREL)
-        freeQoS2msgid(mypacketid);
+        incomingQoS2messages.remove(mypacketid);
       break;
 
     case PUBCOMP:
@@ -585,6 +1042,10 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::cycle(Timer& timer) {
       ping_outstanding = false;
       break;
   }
+#if MQTTCLIENT_PROFILE
+  if (packet_type > 0)
+    profile.stages[NBMQTT_STAGE_DISPATCH].record(Timer::ns_since(start));
+#endif
 
   if (keepalive() != SUCCESS)
     //check only keepalive FAILURE status so that previous FAILURE status can be considered as FAULT
@@ -608,9 +1069,8 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::keepalive() {
   if (last_sent.expired() || last_received.expired()) {
     if (ping_outstanding) {
       rc = FAILURE;  // session failure
-#if defined(MQTT_DEBUG)
-      char printbuf[150];
-      DEBUG("PINGRESP not received in keepalive interval\n");
+#if MQTTCLIENT_TRACE
+      trace.record(NBMQTT_TRACE_PING_TIMEOUT, 0, 0, 0, FAILURE, Timer::stamp());
 #endif
     } else {
       Timer timer(1000);
@@ -649,8 +1109,18 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::connect(MQTTPacket_co
 
   this->keepAliveInterval = options.keepAliveInterval;
   this->cleansession = options.cleansession;
-  if ((len = MQTTSerialize_connect(sendbuf, MAX_MQTT_PACKET_SIZE, &options)) <= 0)
-    goto exit;
+  this->mqttVersion = options.MQTTVersion;
+  {
+    // MQTT 5: the server must not send packets larger than readbuf, nor more unacknowledged
+    // QoS 2 publishes than the client can track
+    MQTTProperties properties = MQTTProperties_initializer;
+    properties.maximumPacketSize = MAX_MQTT_PACKET_SIZE;
+#if MQTTCLIENT_QOS2
+    properties.receiveMaximum = MAX_INCOMING_QOS2_MESSAGES;
+#endif
+    if ((len = MQTTV5Serialize_connect(sendbuf, MAX_MQTT_PACKET_SIZE, &options, &properties)) <= 0)
+      goto exit;
+  }
   if ((rc = sendPacket(len, connect_timer)) != SUCCESS)  // send the connect packet
     goto exit;                                           // there was a problem
 
@@ -660,8 +1130,13 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::connect(MQTTPacket_co
   if (waitfor(CONNACK, connect_timer) == CONNACK) {
     data.rc = 0;
     data.sessionPresent = false;
-    if (MQTTDeserialize_connack((unsigned char*)&data.sessionPresent,
-                                (unsigned char*)&data.rc, readbuf, MAX_MQTT_PACKET_SIZE) == 1)
+    memset(&serverProperties, 0, sizeof(serverProperties));
+#if MQTTCLIENT_TOPIC_ALIASES > 0
+    memset(topicAliases, 0, sizeof(topicAliases));  // aliases only last for the connection
+    nextTopicAlias = 0;
+#endif
+    if (MQTTV5Deserialize_connack(v5(serverProperties), (unsigned char*)&data.sessionPresent,
+                                  (unsigned char*)&data.rc, readbuf, MAX_MQTT_PACKET_SIZE) == 1)
       rc = data.rc;
     else
       rc = FAILURE;
@@ -706,23 +1181,32 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::connect() {
 
 template <class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
 int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::setMessageHandler(const char* topicFilter, messageHandler messageHandler) {
+  FP<void, MessageData&> fp;
+  if (messageHandler != 0)
+    fp.attach(messageHandler);
+  return setMessageHandler(topicFilter, fp);
+}
+
+template <class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::setMessageHandler(const char* topicFilter, FP<void, MessageData&> fp) {
   int rc = FAILURE;
   int i = -1;
 
   // first check for an existing matching slot
   for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
     if (messageHandlers[i].topicFilter != 0 && strcmp(messageHandlers[i].topicFilter, topicFilter) == 0) {
-      if (messageHandler == 0)  // remove existing
+      if (!fp.attached())  // remove existing
       {
         messageHandlers[i].topicFilter = 0;
         messageHandlers[i].fp.detach();
+        updateHandlerPrefix();
       }
       rc = SUCCESS;  // return i when adding new subscription
       break;
     }
   }
   // if no existing, look for empty slot (unless we are removing)
-  if (messageHandler != 0) {
+  if (fp.attached()) {
     if (rc == FAILURE) {
       for (i = 0; i < MAX_MESSAGE_HANDLERS; ++i) {
         if (messageHandlers[i].topicFilter == 0) {
@@ -733,7 +1217,9 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::se
     }
     if (i < MAX_MESSAGE_HANDLERS) {
       messageHandlers[i].topicFilter = topicFilter;
-      messageHandlers[i].fp.attach(messageHandler);
+      messageHandlers[i].topicFilterLen = strlen(topicFilter);
+      messageHandlers[i].fp = fp;
+      updateHandlerPrefix();
     }
   }
   return rc;
@@ -742,15 +1228,25 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::se
 template <class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
 int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::subscribe(const char* topicFilter,
                                                                                         enum QoS qos, messageHandler messageHandler, subackData& data) {
+  FP<void, MessageData&> fp;
+  if (messageHandler != 0)
+    fp.attach(messageHandler);
+  return subscribe(topicFilter, qos, fp, data);
+}
+
+template <class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int MAX_MESSAGE_HANDLERS>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::subscribe(const char* topicFilter,
+                                                                                        enum QoS qos, FP<void, MessageData&> fp, subackData& data) {
   int rc = FAILURE;
   Timer timer(command_timeout_ms);
   int len = 0;
   MQTTString topic = {(char*)topicFilter, {0, 0}};
+  MQTTProperties properties = MQTTProperties_initializer;
 
   if (!isconnected)
     goto exit;
 
-  len = MQTTSerialize_subscribe(sendbuf, MAX_MQTT_PACKET_SIZE, 0, packetid.getNext(), 1, &topic, (int*)&qos);
+  len = MQTTV5Serialize_subscribe(sendbuf, MAX_MQTT_PACKET_SIZE, 0, packetid.getNext(), v5(properties), 1, &topic, (int*)&qos);
   if (len <= 0)
     goto exit;
   if ((rc = sendPacket(len, timer)) != SUCCESS)  // send the subscribe packet
@@ -761,9 +1257,9 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::su
     int count = 0;
     unsigned short mypacketid;
     data.grantedQoS = 0;
-    if (MQTTDeserialize_suback(&mypacketid, 1, &count, &data.grantedQoS, readbuf, MAX_MQTT_PACKET_SIZE) == 1) {
-      if (data.grantedQoS != 0x80)
-        rc = setMessageHandler(topicFilter, messageHandler);
+    if (MQTTV5Deserialize_suback(&mypacketid, v5(properties), 1, &count, &data.grantedQoS, readbuf, MAX_MQTT_PACKET_SIZE) == 1) {
+      if (data.grantedQoS < 0x80)  // 0x80 and up are failures, MQTT 5 has more than one
+        rc = setMessageHandler(topicFilter, fp);
     }
   } else
     rc = FAILURE;
@@ -785,12 +1281,13 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, MAX_MESSAGE_HANDLERS>::un
   int rc = FAILURE;
   Timer timer(command_timeout_ms);
   MQTTString topic = {(char*)topicFilter, {0, 0}};
+  MQTTProperties properties = MQTTProperties_initializer;
   int len = 0;
 
   if (!isconnected)
     goto exit;
 
-  if ((len = MQTTSerialize_unsubscribe(sendbuf, MAX_MQTT_PACKET_SIZE, 0, packetid.getNext(), 1, &topic)) <= 0)
+  if ((len = MQTTV5Serialize_unsubscribe(sendbuf, MAX_MQTT_PACKET_SIZE, 0, packetid.getNext(), v5(properties), 1, &topic)) <= 0)
     goto exit;
   if ((rc = sendPacket(len, timer)) != SUCCESS)  // send the unsubscribe packet
     goto exit;                                   // there was a problem
@@ -813,9 +1310,40 @@ exit:
 template <class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
 int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(int len, Timer& timer, enum QoS qos) {
   int rc;
+#if MQTTCLIENT_STATS || MQTTCLIENT_PROFILE
+  unsigned int start = Timer::stamp();
+#endif
+#if MQTTCLIENT_PROFILE
+  unsigned int sent;
+#endif
 
   if ((rc = sendPacket(len, timer)) != SUCCESS)  // send the publish packet
     goto exit;                                   // there was a problem
+#if MQTTCLIENT_PROFILE
+  profile.stages[NBMQTT_STAGE_SEND].record(Timer::ns_since(start));
+  sent = Timer::stamp();
+#endif
+
+  rc = publishAck(timer, qos);
+#if MQTTCLIENT_STATS
+  if (rc == SUCCESS && qos != QOS0)
+    stats.ackUs.record(Timer::us_since(start));
+#endif
+#if MQTTCLIENT_PROFILE
+  if (rc == SUCCESS && qos != QOS0)
+    profile.stages[NBMQTT_STAGE_ACK_WAIT].record(Timer::ns_since(sent));
+#endif
+
+exit:
+  if (rc != SUCCESS)
+    closeSession();
+  return rc;
+}
+
+// wait for the acks of the publish just sent
+template <class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publishAck(Timer& timer, enum QoS qos) {
+  int rc = SUCCESS;
 
 #if MQTTCLIENT_QOS1
   if (qos == QOS1) {
@@ -844,9 +1372,6 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(int len, Time
   }
 #endif
 
-exit:
-  if (rc != SUCCESS)
-    closeSession();
   return rc;
 }
 
@@ -855,7 +1380,11 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(const char* t
   int rc = FAILURE;
   Timer timer(command_timeout_ms);
   MQTTString topicString = MQTTString_initializer;
+  MQTTProperties properties = MQTTProperties_initializer;
   int len = 0;
+#if MQTTCLIENT_PROFILE
+  unsigned int start = Timer::stamp();
+#endif
 
   if (!isconnected)
     goto exit;
@@ -867,10 +1396,17 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(const char* t
     id = packetid.getNext();
 #endif
 
-  len = MQTTSerialize_publish(sendbuf, MAX_MQTT_PACKET_SIZE, 0, qos, retained, id,
-                              topicString, (unsigned char*)payload, payloadlen);
-  if (len <= 0)
+  // the stored copy of a publish to resend after reconnecting must carry its topic
+  properties.topicAlias = useTopicAlias(topicString, cleansession || qos == QOS0);
+  len = MQTTV5Serialize_publish(sendbuf, MAX_MQTT_PACKET_SIZE, 0, qos, retained, id,
+                                topicString, v5(properties), (unsigned char*)payload, payloadlen);
+  if (len <= 0 || (serverProperties.maximumPacketSize > 0 && (unsigned int)len > serverProperties.maximumPacketSize)) {
+#if MQTTCLIENT_TOPIC_ALIASES > 0
+    if (properties.topicAlias > 0 && topicString.cstring[0] != '\0')
+      topicAliases[properties.topicAlias - 1][0] = '\0';  // never sent, so the server does not know it
+#endif
     goto exit;
+  }
 
 #if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
   if (!cleansession) {
@@ -883,6 +1419,9 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(const char* t
 #endif
   }
 #endif
+#if MQTTCLIENT_PROFILE
+  profile.stages[NBMQTT_STAGE_SERIALIZE].record(Timer::ns_since(start));
+#endif
 
   rc = publish(len, timer, qos);
 exit:
@@ -895,6 +1434,119 @@ int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(const char* t
   return publish(topicName, payload, payloadlen, id, qos, retained);
 }
 
+template <class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
+int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(const char* topicName, size_t payloadlen, payloadProducer producer,
+                                                                   void* context, enum QoS qos, bool retained) {
+  int rc = FAILURE;
+  Timer timer(command_timeout_ms);
+  MQTTString topicString = MQTTString_initializer;
+  MQTTProperties properties = MQTTProperties_initializer;  // no topic alias, the publish might not be sent at all
+  unsigned short id = 0;
+  size_t offset = 0;
+  int len = 0;
+  bool started = false;
+#if MQTTCLIENT_STATS || MQTTCLIENT_PROFILE
+  unsigned int start = 0;
+#endif
+#if MQTTCLIENT_PROFILE
+  unsigned int sent = 0;
+#endif
+#if MQTTCLIENT_TRACE
+  uint32_t packet_len = 0;
+#endif
+#if MQTTCLIENT_CAPTURE
+  bool captured = false;
+#endif
+
+  if (!isconnected || producer == 0)
+    goto exit;
+
+  topicString.cstring = (char*)topicName;
+
+#if MQTTCLIENT_QOS1 || MQTTCLIENT_QOS2
+  if (qos == QOS1 || qos == QOS2)
+    id = packetid.getNext();
+#endif
+
+#if MQTTCLIENT_PROFILE
+  start = Timer::stamp();
+#endif
+  len = MQTTV5Serialize_publishHeader(sendbuf, MAX_MQTT_PACKET_SIZE, 0, qos, retained, id, topicString, v5(properties), payloadlen);
+  if (len <= 0 || (serverProperties.maximumPacketSize > 0 && len + payloadlen > serverProperties.maximumPacketSize))
+    goto exit;
+#if MQTTCLIENT_PROFILE
+  profile.stages[NBMQTT_STAGE_SERIALIZE].record(Timer::ns_since(start));
+#endif
+#if MQTTCLIENT_STATS || MQTTCLIENT_PROFILE
+  start = Timer::stamp();
+#endif
+#if MQTTCLIENT_TRACE
+  packet_len = len + payloadlen;
+#endif
+#if MQTTCLIENT_CAPTURE
+  captured = capture != 0 && capture->begin<Timer>(NBMQTT_CAPTURE_SENT, len + payloadlen);
+#endif
+
+  // the first chunk goes out with the header, the rest a full send buffer at a time
+  while (true) {
+    int chunk = MAX_MQTT_PACKET_SIZE - len;
+    if ((size_t)chunk > payloadlen - offset)
+      chunk = payloadlen - offset;
+    if (chunk > 0) {
+      int produced = producer(context, sendbuf + len, chunk, offset);
+      if (produced <= 0 || produced > chunk) {
+        rc = FAILURE;
+        break;
+      }
+      offset += produced;
+      len += produced;
+    }
+    rc = sendBytes(sendbuf, len, timer);
+#if MQTTCLIENT_CAPTURE
+    if (captured && rc == SUCCESS)
+      capture->append(sendbuf, len);
+#endif
+#if MQTTCLIENT_TRACE
+    if (!started)  // the packet start is in the first chunk only
+      trace.record(NBMQTT_TRACE_SENT, sendbuf, len, packet_len, rc, Timer::stamp());
+#endif
+    started = true;
+    if (rc != SUCCESS || offset == payloadlen)
+      break;
+    len = 0;
+  }
+
+#if MQTTCLIENT_CAPTURE
+  if (captured)
+    capture->end(rc == SUCCESS && offset == payloadlen);
+#endif
+#if MQTTCLIENT_STATS
+  if (started) {
+    stats.sendUs.record(Timer::us_since(start));
+    NBMQTTStats::count((rc == SUCCESS) ? stats.packetsOut[PUBLISH] : stats.sendErrors);
+  }
+#endif
+#if MQTTCLIENT_PROFILE
+  if (rc == SUCCESS)
+    profile.stages[NBMQTT_STAGE_SEND].record(Timer::ns_since(start));
+  sent = Timer::stamp();
+#endif
+  if (rc == SUCCESS)
+    rc = publishAck(timer, qos);
+#if MQTTCLIENT_STATS
+  if (rc == SUCCESS && qos != QOS0)
+    stats.ackUs.record(Timer::us_since(start));
+#endif
+#if MQTTCLIENT_PROFILE
+  if (rc == SUCCESS && qos != QOS0)
+    profile.stages[NBMQTT_STAGE_ACK_WAIT].record(Timer::ns_since(sent));
+#endif
+  if (rc != SUCCESS && started)
+    closeSession();  // a partly sent packet leaves the connection unusable
+exit:
+  return rc;
+}
+
 template <class Network, class Timer, int MAX_MQTT_PACKET_SIZE, int b>
 int MQTT::Client<Network, Timer, MAX_MQTT_PACKET_SIZE, b>::publish(const char* topicName, Message& message) {
   return publish(topicName, message.payload, message.payloadlen, message.qos, message.retained);
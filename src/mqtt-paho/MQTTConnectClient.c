@@ -32,7 +32,7 @@ int MQTTSerialize_connectLength(MQTTPacket_connectData* options)
 
 	if (options->MQTTVersion == 3)
 		len = 12; /* variable depending on MQTT or MQIsdp */
-	else if (options->MQTTVersion == 4)
+	else if (options->MQTTVersion == 4 || options->MQTTVersion == 5)
 		len = 10;
 
 	len += MQTTstrlen(options->clientID)+2;
@@ -56,6 +56,20 @@ int MQTTSerialize_connectLength(MQTTPacket_connectData* options)
   * @return serialized length, or error if 0
   */
 int MQTTSerialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData* options)
+{
+	return MQTTV5Serialize_connect(buf, buflen, options, NULL);
+}
+
+
+/**
+  * Serializes the connect options into the buffer, with MQTT 5 properties when options->MQTTVersion is 5.
+  * @param buf the buffer into which the packet will be serialized
+  * @param len the length in bytes of the supplied buffer
+  * @param options the options to be used to build the connect packet
+  * @param properties the connect properties, NULL for none. Ignored before MQTT 5.
+  * @return serialized length, or error if 0
+  */
+int MQTTV5Serialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData* options, MQTTProperties* properties)
 {
 	unsigned char *ptr = buf;
 	MQTTHeader header = {0};
@@ -64,7 +78,10 @@ int MQTTSerialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData
 	int rc = -1;
 
 	FUNC_ENTRY;
-	if (MQTTPacket_len(len = MQTTSerialize_connectLength(options)) > buflen)
+	len = MQTTSerialize_connectLength(options);
+	if (options->MQTTVersion == 5)
+		len += MQTTProperties_len(properties) + (options->willFlag ? MQTTProperties_len(NULL) : 0);
+	if (MQTTPacket_len(len) > buflen)
 	{
 		rc = MQTTPACKET_BUFFER_TOO_SHORT;
 		goto exit;
@@ -76,10 +93,10 @@ int MQTTSerialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData
 
 	ptr += MQTTPacket_encode(ptr, len); /* write remaining length */
 
-	if (options->MQTTVersion == 4)
+	if (options->MQTTVersion == 4 || options->MQTTVersion == 5)
 	{
 		writeCString(&ptr, "MQTT");
-		writeChar(&ptr, (char) 4);
+		writeChar(&ptr, (char) options->MQTTVersion);
 	}
 	else
 	{
@@ -103,9 +120,13 @@ int MQTTSerialize_connect(unsigned char* buf, int buflen, MQTTPacket_connectData
 
 	writeChar(&ptr, flags.all);
 	writeInt(&ptr, options->keepAliveInterval);
+	if (options->MQTTVersion == 5)
+		MQTTProperties_write(&ptr, properties);
 	writeMQTTString(&ptr, options->clientID);
 	if (options->willFlag)
 	{
+		if (options->MQTTVersion == 5)
+			MQTTProperties_write(&ptr, NULL); /* will properties */
 		writeMQTTString(&ptr, options->will.topicName);
 		writeMQTTString(&ptr, options->will.message);
 	}
@@ -159,6 +180,45 @@ exit:
 }
 
 
+/**
+  * Deserializes the supplied (wire) buffer into MQTT 5 connack data - reason code and properties
+  * @param properties returned properties of the server, 0 for the ones it did not send; NULL for an MQTT 3 connack
+  * @param sessionPresent the session present flag returned
+  * @param reasonCode returned integer value of the connack reason code
+  * @param buf the raw buffer data, of the correct length determined by the remaining length field
+  * @param len the length in bytes of the data in the supplied buffer
+  * @return error code.  1 is success, 0 is failure
+  */
+int MQTTV5Deserialize_connack(MQTTProperties* properties, unsigned char* sessionPresent, unsigned char* reasonCode,
+		unsigned char* buf, int buflen)
+{
+	unsigned char* curdata = buf;
+	unsigned char* enddata = NULL;
+	int rc = 0;
+	int mylen;
+
+	FUNC_ENTRY;
+	if (MQTTDeserialize_connack(sessionPresent, reasonCode, buf, buflen) != 1)
+		goto exit;
+
+	if (properties)
+	{
+		curdata += 1 + MQTTPacket_decodeBuf(curdata + 1, &mylen); /* skip header and remaining length */
+		enddata = curdata + mylen;
+		curdata += 2; /* flags and reason code */
+		if (curdata == enddata)
+			memset(properties, 0, sizeof(*properties)); /* no properties at all, as in an error connack */
+		else if (!MQTTProperties_read(properties, &curdata, enddata))
+			goto exit;
+	}
+
+	rc = 1;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
+
+
 /**
   * Serializes a 0-length packet into the supplied buffer, ready for writing to a socket
   * @param buf the buffer into which the packet will be serialized
@@ -92,10 +92,10 @@ int MQTTDeserialize_connect(MQTTPacket_connectData* data, unsigned char* buf, in
 		}
 		if (flags.bits.username)
 		{
-			if (enddata - curdata < 3 || !readMQTTLenString(&data->username, &curdata, enddata))
+			if (enddata - curdata < 2 || !readMQTTLenString(&data->username, &curdata, enddata))
 				goto exit; /* username flag set, but no username supplied - invalid */
 			if (flags.bits.password &&
-				(enddata - curdata < 3 || !readMQTTLenString(&data->password, &curdata, enddata)))
+				(enddata - curdata < 2 || !readMQTTLenString(&data->password, &curdata, enddata)))
 				goto exit; /* password flag set, but no password supplied - invalid */
 		}
 		else if (flags.bits.password)
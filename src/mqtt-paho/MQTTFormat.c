@@ -138,7 +138,7 @@ char* MQTTFormat_toClientString(char* strbuf, int strbuflen, unsigned char* buf,
 	case PUBLISH:
 	{
 		unsigned char dup, retained, *payload;
-		unsigned short packetid;
+		unsigned short packetid = 0; /* not in a QoS 0 publish */
 		int qos, payloadlen;
 		MQTTString topicName = MQTTString_initializer;
 		if (MQTTDeserialize_publish(&dup, &qos, &retained, &packetid, &topicName,
@@ -199,7 +199,7 @@ char* MQTTFormat_toServerString(char* strbuf, int strbuflen, unsigned char* buf,
 	{
 	case CONNECT:
 	{
-		MQTTPacket_connectData data;
+		MQTTPacket_connectData data = MQTTPacket_connectData_initializer; /* the fields not in the packet */
 		int rc;
 		if ((rc = MQTTDeserialize_connect(&data, buf, buflen)) == 1)
 			strindex = MQTTStringFormat_connect(strbuf, strbuflen, &data);
@@ -208,7 +208,7 @@ char* MQTTFormat_toServerString(char* strbuf, int strbuflen, unsigned char* buf,
 	case PUBLISH:
 	{
 		unsigned char dup, retained, *payload;
-		unsigned short packetid;
+		unsigned short packetid = 0; /* not in a QoS 0 publish */
 		int qos, payloadlen;
 		MQTTString topicName = MQTTString_initializer;
 		if (MQTTDeserialize_publish(&dup, &qos, &retained, &packetid, &topicName,
@@ -17,39 +17,22 @@
 #if !defined(MQTT_LOGGING_H)
 #define MQTT_LOGGING_H
 
-#define STREAM      stdout
+/*
+ * MQTT::Client no longer logs: its packets go to the NBMQTTTrace ring, read
+ * with readTrace(). These stay for other code, empty unless defined before
+ * this header is included, and never write to stdout or exit.
+ */
 #if !defined(DEBUG)
-#define DEBUG(...)    \
-    {\
-    fprintf(STREAM, "DEBUG:   %s L#%d ", __PRETTY_FUNCTION__, __LINE__);  \
-    fprintf(STREAM, ##__VA_ARGS__); \
-    fflush(STREAM); \
-    }
+#define DEBUG(...) do { } while (0)
 #endif
 #if !defined(LOG)
-#define LOG(...)    \
-    {\
-    fprintf(STREAM, "LOG:   %s L#%d ", __PRETTY_FUNCTION__, __LINE__);  \
-    fprintf(STREAM, ##__VA_ARGS__); \
-    fflush(STREAM); \
-    }
+#define LOG(...) do { } while (0)
 #endif
 #if !defined(WARN)
-#define WARN(...)   \
-    { \
-    fprintf(STREAM, "WARN:  %s L#%d ", __PRETTY_FUNCTION__, __LINE__);  \
-    fprintf(STREAM, ##__VA_ARGS__); \
-    fflush(STREAM); \
-    }
-#endif 
+#define WARN(...) do { } while (0)
+#endif
 #if !defined(ERROR)
-#define ERROR(...)  \
-    { \
-    fprintf(STREAM, "ERROR: %s L#%d ", __PRETTY_FUNCTION__, __LINE__); \
-    fprintf(STREAM, ##__VA_ARGS__); \
-    fflush(STREAM); \
-    exit(1); \
-    }
+#define ERROR(...) do { } while (0)
 #endif
 
 #endif
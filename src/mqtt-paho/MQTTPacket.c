@@ -98,22 +98,39 @@ int MQTTPacket_len(int rem_len)
 }
 
 
-static unsigned char* bufptr;
-
-int bufchar(unsigned char* c, int count)
+/**
+ * Decodes the message length according to the MQTT algorithm, straight from a buffer.
+ * Reentrant (no shared state) and without a per byte callback; the 1 and 2 byte
+ * encodings, which cover every packet below 16 KB, are decoded without a loop.
+ * @param buf the buffer holding the encoded remaining length
+ * @param value the decoded length returned
+ * @return the number of bytes read from the buffer
+ */
+int MQTTPacket_decodeBuf(unsigned char* buf, int* value)
 {
-	int i;
-
-	for (i = 0; i < count; ++i)
-		*c = *bufptr++;
-	return count;
-}
+	int len;
+	int multiplier = 128 * 128;
 
+	if ((buf[0] & 128) == 0)
+	{
+		*value = buf[0];
+		return 1;
+	}
+	if ((buf[1] & 128) == 0)
+	{
+		*value = (buf[0] & 127) + (buf[1] << 7);
+		return 2;
+	}
 
-int MQTTPacket_decodeBuf(unsigned char* buf, int* value)
-{
-	bufptr = buf;
-	return MQTTPacket_decode(bufchar, value);
+	*value = (buf[0] & 127) + ((buf[1] & 127) << 7);
+	for (len = 2; len < MAX_NO_OF_REMAINING_LENGTH_BYTES; ++len)
+	{
+		*value += (buf[len] & 127) * multiplier;
+		if ((buf[len] & 128) == 0)
+			return len + 1;
+		multiplier *= 128;
+	}
+	return len + 1; /* bad data, same length as MQTTPacket_decode reports */
 }
 
 
@@ -275,7 +292,7 @@ int MQTTPacket_equals(MQTTString* a, char* bptr)
 	}
 	blen = strlen(bptr);
 	
-	return (alen == blen) && (strncmp(aptr, bptr, alen) == 0);
+	return (alen == blen) && (MQTTTopic_compare(aptr, bptr, alen) == alen);
 }
 
 
@@ -40,6 +40,8 @@ enum errors
 	MQTTPACKET_READ_COMPLETE
 };
 
+#define MQTTPACKET_MAX_REMAINING_LENGTH 268435455 /* the most 4 remaining length bytes can encode */
+
 enum msgTypes
 {
 	CONNECT = 1, CONNACK, PUBLISH, PUBACK, PUBREC, PUBREL,
@@ -88,11 +90,13 @@ typedef struct
 
 int MQTTstrlen(MQTTString mqttstring);
 
+#include "MQTTProperties.h"
 #include "MQTTConnect.h"
 #include "MQTTPublish.h"
 #include "MQTTSubscribe.h"
 #include "MQTTUnsubscribe.h"
 #include "MQTTFormat.h"
+#include "MQTTTopic.h"
 
 DLLExport int MQTTSerialize_ack(unsigned char* buf, int buflen, unsigned char type, unsigned char dup, unsigned short packetid);
 DLLExport int MQTTDeserialize_ack(unsigned char* packettype, unsigned char* dup, unsigned short* packetid, unsigned char* buf, int buflen);
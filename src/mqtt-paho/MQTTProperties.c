@@ -0,0 +1,176 @@
+/**
+ * @file MQTTProperties.c
+ *
+ * Reading and writing of the MQTT 5 properties this client uses.
+ */
+
+#include "StackTrace.h"
+#include "MQTTPacket.h"
+
+#include <string.h>
+
+
+/**
+ * Determines the number of bytes a variable byte integer takes
+ * @param value the integer
+ * @return 1 to 4
+ */
+static int varIntLen(int value)
+{
+	return (value < 128) ? 1 : (value < 16384) ? 2 : (value < 2097152) ? 3 : 4;
+}
+
+
+/**
+ * Determines the length of the properties that are set
+ * @param properties the properties, NULL for none
+ * @return the length, without the property length field
+ */
+static int propertiesLen(MQTTProperties* properties)
+{
+	int len = 0;
+
+	if (properties)
+	{
+		if (properties->receiveMaximum)
+			len += 3;
+		if (properties->topicAliasMaximum)
+			len += 3;
+		if (properties->topicAlias)
+			len += 3;
+		if (properties->maximumPacketSize)
+			len += 5;
+	}
+	return len;
+}
+
+
+/**
+ * Determines the length of the properties as written by MQTTProperties_write
+ * @param properties the properties, NULL for none
+ * @return the length, including the property length field
+ */
+int MQTTProperties_len(MQTTProperties* properties)
+{
+	int len = propertiesLen(properties);
+
+	return varIntLen(len) + len;
+}
+
+
+/**
+ * Writes the property length and the properties that are set
+ * @param pptr pointer to the output buffer - incremented by the number of bytes used & returned
+ * @param properties the properties, NULL for none
+ */
+void MQTTProperties_write(unsigned char** pptr, MQTTProperties* properties)
+{
+	*pptr += MQTTPacket_encode(*pptr, propertiesLen(properties));
+	if (properties == NULL)
+		return;
+	if (properties->receiveMaximum)
+	{
+		writeChar(pptr, MQTTPROPERTY_CODE_RECEIVE_MAXIMUM);
+		writeInt(pptr, properties->receiveMaximum);
+	}
+	if (properties->topicAliasMaximum)
+	{
+		writeChar(pptr, MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM);
+		writeInt(pptr, properties->topicAliasMaximum);
+	}
+	if (properties->topicAlias)
+	{
+		writeChar(pptr, MQTTPROPERTY_CODE_TOPIC_ALIAS);
+		writeInt(pptr, properties->topicAlias);
+	}
+	if (properties->maximumPacketSize)
+	{
+		writeChar(pptr, MQTTPROPERTY_CODE_MAXIMUM_PACKET_SIZE);
+		writeInt(pptr, properties->maximumPacketSize >> 16);
+		writeInt(pptr, properties->maximumPacketSize & 0xFFFF);
+	}
+}
+
+
+/**
+ * Reads the property length and the properties, keeping the ones this client uses
+ * @param properties the properties read, NULL to skip them all
+ * @param pptr pointer to the input buffer - incremented by the number of bytes used & returned
+ * @param enddata pointer to the end of the data: do not read beyond
+ * @return 1 if successful, 0 if the properties are malformed
+ */
+int MQTTProperties_read(MQTTProperties* properties, unsigned char** pptr, unsigned char* enddata)
+{
+	unsigned char* endprops;
+	int len = 0;
+	int rc = 0;
+
+	FUNC_ENTRY;
+	if (properties)
+		memset(properties, 0, sizeof(*properties));
+	if (enddata - *pptr < 1)
+		goto exit;
+	*pptr += MQTTPacket_decodeBuf(*pptr, &len);
+	endprops = *pptr + len;
+	if (endprops > enddata)
+		goto exit;
+
+	while (*pptr < endprops)
+	{
+		int code = (unsigned char)readChar(pptr);
+		int size = 0;
+
+		switch (code)
+		{
+		case 0x01: case 0x17: case 0x19: case 0x24: case 0x25: case 0x28: case 0x29: case 0x2A:
+			size = 1; /* byte */
+			break;
+		case 0x13: case 0x21: case 0x22: case 0x23:
+			size = 2; /* two byte integer */
+			break;
+		case 0x02: case 0x11: case 0x18: case 0x27:
+			size = 4; /* four byte integer */
+			break;
+		case 0x0B: /* variable byte integer */
+			if (endprops - *pptr < 1)
+				goto exit;
+			size = MQTTPacket_decodeBuf(*pptr, &len);
+			break;
+		case 0x03: case 0x08: case 0x09: case 0x12: case 0x15: case 0x16: case 0x1A: case 0x1C: case 0x1F:
+			if (endprops - *pptr < 2)
+				goto exit;
+			size = 2 + (((*pptr)[0] << 8) | (*pptr)[1]); /* UTF-8 string or binary data */
+			break;
+		case 0x26: /* string pair */
+			if (endprops - *pptr < 2)
+				goto exit;
+			size = 2 + (((*pptr)[0] << 8) | (*pptr)[1]);
+			if (endprops - *pptr < size + 2)
+				goto exit;
+			size += 2 + (((*pptr)[size] << 8) | (*pptr)[size + 1]);
+			break;
+		default:
+			goto exit; /* unknown property */
+		}
+		if (endprops - *pptr < size)
+			goto exit;
+
+		if (properties && code == MQTTPROPERTY_CODE_RECEIVE_MAXIMUM)
+			properties->receiveMaximum = readInt(pptr);
+		else if (properties && code == MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM)
+			properties->topicAliasMaximum = readInt(pptr);
+		else if (properties && code == MQTTPROPERTY_CODE_TOPIC_ALIAS)
+			properties->topicAlias = readInt(pptr);
+		else if (properties && code == MQTTPROPERTY_CODE_MAXIMUM_PACKET_SIZE)
+		{
+			properties->maximumPacketSize = (unsigned int)readInt(pptr) << 16;
+			properties->maximumPacketSize |= (unsigned int)readInt(pptr);
+		}
+		else
+			*pptr += size;
+	}
+	rc = 1;
+exit:
+	FUNC_EXIT_RC(rc);
+	return rc;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file MQTTProperties.h
+ *
+ * The MQTT 5 properties this client uses. Any other property in a received
+ * packet is skipped.
+ */
+
+#ifndef MQTTPROPERTIES_H_
+#define MQTTPROPERTIES_H_
+
+#if !defined(DLLImport)
+  #define DLLImport 
+#endif
+#if !defined(DLLExport)
+  #define DLLExport
+#endif
+
+enum MQTTPropertyCodes
+{
+	MQTTPROPERTY_CODE_RECEIVE_MAXIMUM = 0x21,
+	MQTTPROPERTY_CODE_TOPIC_ALIAS_MAXIMUM = 0x22,
+	MQTTPROPERTY_CODE_TOPIC_ALIAS = 0x23,
+	MQTTPROPERTY_CODE_MAXIMUM_PACKET_SIZE = 0x27
+};
+
+typedef struct
+{
+	unsigned short receiveMaximum;		/**< inflight QoS 1 and 2 publishes the sender accepts, 0 when absent */
+	unsigned short topicAliasMaximum;	/**< highest topic alias the sender accepts, 0 when absent */
+	unsigned short topicAlias;			/**< topic alias of a publish, 0 when absent */
+	unsigned int maximumPacketSize;		/**< largest packet the sender accepts, 0 when absent */
+} MQTTProperties;
+
+#define MQTTProperties_initializer {0, 0, 0, 0}
+
+DLLExport int MQTTProperties_len(MQTTProperties* properties);
+DLLExport void MQTTProperties_write(unsigned char** pptr, MQTTProperties* properties);
+DLLExport int MQTTProperties_read(MQTTProperties* properties, unsigned char** pptr, unsigned char* enddata);
+
+#endif /* MQTTPROPERTIES_H_ */
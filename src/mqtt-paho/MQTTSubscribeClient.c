@@ -49,6 +49,19 @@ int MQTTSerialize_subscribeLength(int count, MQTTString topicFilters[])
   */
 int MQTTSerialize_subscribe(unsigned char* buf, int buflen, unsigned char dup, unsigned short packetid, int count,
 		MQTTString topicFilters[], int requestedQoSs[])
+{
+	return MQTTV5Serialize_subscribe(buf, buflen, dup, packetid, NULL, count, topicFilters, requestedQoSs);
+}
+
+
+/**
+  * Serializes the supplied MQTT 5 subscribe data into the supplied buffer, see MQTTSerialize_subscribe.
+  * The requested QoS is the whole subscription options byte.
+  * @param properties the subscribe properties. NULL for an MQTT 3 subscribe, which has no properties field
+  * @return the length of the serialized data.  <= 0 indicates error
+  */
+int MQTTV5Serialize_subscribe(unsigned char* buf, int buflen, unsigned char dup, unsigned short packetid, MQTTProperties* properties,
+		int count, MQTTString topicFilters[], int requestedQoSs[])
 {
 	unsigned char *ptr = buf;
 	MQTTHeader header = {0};
@@ -57,7 +70,8 @@ int MQTTSerialize_subscribe(unsigned char* buf, int buflen, unsigned char dup, u
 	int i = 0;
 
 	FUNC_ENTRY;
-	if (MQTTPacket_len(rem_len = MQTTSerialize_subscribeLength(count, topicFilters)) > buflen)
+	if (MQTTPacket_len(rem_len = MQTTSerialize_subscribeLength(count, topicFilters)
+			+ (properties ? MQTTProperties_len(properties) : 0)) > buflen)
 	{
 		rc = MQTTPACKET_BUFFER_TOO_SHORT;
 		goto exit;
@@ -73,6 +87,9 @@ int MQTTSerialize_subscribe(unsigned char* buf, int buflen, unsigned char dup, u
 
 	writeInt(&ptr, packetid);
 
+	if (properties)
+		MQTTProperties_write(&ptr, properties);
+
 	for (i = 0; i < count; ++i)
 	{
 		writeMQTTString(&ptr, topicFilters[i]);
@@ -98,6 +115,19 @@ exit:
   * @return error code.  1 is success, 0 is failure
   */
 int MQTTDeserialize_suback(unsigned short* packetid, int maxcount, int* count, int grantedQoSs[], unsigned char* buf, int buflen)
+{
+	return MQTTV5Deserialize_suback(packetid, NULL, maxcount, count, grantedQoSs, buf, buflen);
+}
+
+
+/**
+  * Deserializes the supplied (wire) buffer into MQTT 5 suback data, see MQTTDeserialize_suback.
+  * The granted QoSs are reason codes, 0x80 and above are failures.
+  * @param properties returned suback properties. NULL for an MQTT 3 suback, which has no properties field
+  * @return error code.  1 is success, 0 is failure
+  */
+int MQTTV5Deserialize_suback(unsigned short* packetid, MQTTProperties* properties, int maxcount, int* count, int grantedQoSs[],
+		unsigned char* buf, int buflen)
 {
 	MQTTHeader header = {0};
 	unsigned char* curdata = buf;
@@ -117,6 +147,12 @@ int MQTTDeserialize_suback(unsigned short* packetid, int maxcount, int* count, i
 
 	*packetid = readInt(&curdata);
 
+	if (properties && !MQTTProperties_read(properties, &curdata, enddata))
+	{
+		rc = 0;
+		goto exit;
+	}
+
 	*count = 0;
 	while (curdata < enddata)
 	{
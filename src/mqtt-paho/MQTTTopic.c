@@ -0,0 +1,139 @@
+/**
+ * @file MQTTTopic.c
+ *
+ * Topic comparison and wildcard matching, a machine word at a time.
+ *
+ * Ubidots topics are long and mostly share the /v1.6/devices/<device>/ prefix,
+ * so comparing them byte by byte spends most of the time on identical bytes.
+ * These kernels compare, and search for the '/' level separator, one word
+ * (4 bytes on the Cortex-M7) at a time, then finish the last word bytewise.
+ */
+
+#include "MQTTPacket.h"
+
+#include <stdint.h>
+#include <string.h>
+
+typedef uintptr_t MQTTTopic_word;
+
+#define WORD_SIZE ((int)sizeof(MQTTTopic_word))
+#define ONES ((MQTTTopic_word)-1 / 0xFF)	/* 0x01 in every byte */
+#define HIGHS (ONES * 0x80)					/* 0x80 in every byte */
+#define SEPARATORS (ONES * '/')				/* '/' in every byte */
+
+
+/**
+ * Loads a word from a possibly unaligned address. Compiles to a single load on
+ * targets that allow unaligned access, such as the Cortex-M7.
+ */
+static MQTTTopic_word loadWord(const char* ptr)
+{
+	MQTTTopic_word word;
+
+	memcpy(&word, ptr, sizeof(word));
+	return word;
+}
+
+
+/**
+ * Compares two strings of the same length
+ * @param a the first string
+ * @param b the second string
+ * @param len the number of bytes to compare
+ * @return the length of the common prefix, len if the strings are equal
+ */
+int MQTTTopic_compare(const char* a, const char* b, int len)
+{
+	int i = 0;
+
+	while (i + WORD_SIZE <= len && loadWord(a + i) == loadWord(b + i))
+		i += WORD_SIZE;
+	while (i < len && a[i] == b[i])
+		++i;
+	return i;
+}
+
+
+/**
+ * Finds the first level separator in a topic
+ * @param topic the topic
+ * @param len the length of the topic
+ * @return the position of the first '/', len if there is none
+ */
+int MQTTTopic_separator(const char* topic, int len)
+{
+	int i = 0;
+
+	for (; i + WORD_SIZE <= len; i += WORD_SIZE)
+	{
+		MQTTTopic_word word = loadWord(topic + i) ^ SEPARATORS;	/* a '/' becomes a zero byte */
+
+		if ((word - ONES) & ~word & HIGHS)
+			break;
+	}
+	while (i < len && topic[i] != '/')
+		++i;
+	return i;
+}
+
+
+/**
+ * Matches a topic name against a topic filter. Runs of identical bytes are
+ * compared a word at a time, and wildcards are only looked at where the two differ.
+ * '+' matches exactly one level, which may be empty, and '#' matches the
+ * remaining levels, including none ("a/#" matches "a").
+ * @param filter the topic filter, which can include wildcards
+ * @param filterlen the length of the topic filter
+ * @param name the topic name, which cannot include wildcards
+ * @param namelen the length of the topic name
+ * @return boolean - matches or not
+ */
+int MQTTTopic_matches(const char* filter, int filterlen, const char* name, int namelen)
+{
+	int f = 0, n = 0;
+
+	while (1)
+	{
+		int same = MQTTTopic_compare(filter + f, name + n, (filterlen - f < namelen - n) ? filterlen - f : namelen - n);
+
+		f += same;
+		n += same;
+		if (f == filterlen)
+			return n == namelen;
+		if (n == namelen && filterlen - f == 2 && filter[f] == '/' && filter[f + 1] == '#')
+			return 1;
+		if (f > 0 && filter[f - 1] != '/')
+			return 0;	/* wildcards only stand for whole levels */
+		if (filter[f] == '#')
+			return 1;
+		if (filter[f] != '+')
+			return 0;
+		n += MQTTTopic_separator(name + n, namelen - n);
+		++f;
+	}
+}
+
+
+/**
+ * Finds the whole literal levels two topics share, so that matching against several
+ * filters with a common prefix can compare the prefix once
+ * @param a the first topic
+ * @param alen the length of the first topic
+ * @param b the second topic
+ * @param blen the length of the second topic
+ * @return the position of the last '/' within their common prefix, 0 if there is none.
+ * Matching the remainders from there gives the same result as matching the whole topics.
+ */
+int MQTTTopic_levelPrefix(const char* a, int alen, const char* b, int blen)
+{
+	int len = MQTTTopic_compare(a, b, (alen < blen) ? alen : blen);
+	const char* wildcard;
+
+	if ((wildcard = memchr(a, '+', len)) != NULL)
+		len = wildcard - a;	/* a wildcard ends the literal part */
+	if ((wildcard = memchr(a, '#', len)) != NULL)
+		len = wildcard - a;
+	while (len > 0 && a[len - 1] != '/')
+		--len;
+	return (len > 0) ? len - 1 : 0;
+}
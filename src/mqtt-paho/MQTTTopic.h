@@ -0,0 +1,25 @@
+/**
+ * @file MQTTTopic.h
+ *
+ * Topic comparison and wildcard matching, a machine word at a time.
+ */
+
+#ifndef MQTTTOPIC_H_
+#define MQTTTOPIC_H_
+
+#if !defined(DLLImport)
+  #define DLLImport 
+#endif
+#if !defined(DLLExport)
+  #define DLLExport
+#endif
+
+DLLExport int MQTTTopic_compare(const char* a, const char* b, int len);
+
+DLLExport int MQTTTopic_separator(const char* topic, int len);
+
+DLLExport int MQTTTopic_matches(const char* filter, int filterlen, const char* name, int namelen);
+
+DLLExport int MQTTTopic_levelPrefix(const char* a, int alen, const char* b, int blen);
+
+#endif /* MQTTTOPIC_H_ */
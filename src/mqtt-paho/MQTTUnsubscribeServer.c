@@ -54,6 +54,11 @@ int MQTTDeserialize_unsubscribe(unsigned char* dup, unsigned short* packetid, in
 	*count = 0;
 	while (curdata < enddata)
 	{
+		if (*count >= maxcount) /* more topic filters than the caller has room for */
+		{
+			rc = -1;
+			goto exit;
+		}
 		if (!readMQTTLenString(&topicFilters[*count], &curdata, enddata))
 			goto exit;
 		(*count)++;
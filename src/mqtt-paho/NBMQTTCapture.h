@@ -0,0 +1,277 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "MQTTPacket.h"
+
+#define NBMQTT_CAPTURE_MAGIC "NBMQCAP1"  // starts every capture
+#define NBMQTT_CAPTURE_MAGIC_LEN 8
+#define NBMQTT_CAPTURE_DELAY_MAX_LEN 5  // bytes of the largest delay
+
+enum NBMQTTCaptureDirection { NBMQTT_CAPTURE_SENT,      // client to broker
+                              NBMQTT_CAPTURE_RECEIVED,  // broker to client
+};
+
+/**
+ * @brief One packet of a capture, see NBMQTTCapture::next().
+ */
+struct NBMQTTCaptureRecord {
+  uint8_t direction;            // NBMQTT_CAPTURE_x
+  uint64_t atUs;                // microseconds since the first packet
+  const unsigned char* packet;  // as on the wire, in the capture
+  uint32_t len;                 // packet length, fixed header included
+};
+
+/**
+ * @brief Capture of every packet an MQTT::Client sends and reads, with its
+ * time, into a caller buffer, to be replayed on a host (tools/replay).
+ *
+ * The capture is a byte stream, written as is to a file:
+ *
+ *   "NBMQCAP1"
+ *   then for each packet
+ *     direction  1 byte, NBMQTT_CAPTURE_SENT or NBMQTT_CAPTURE_RECEIVED
+ *     delay      microseconds since the previous packet, 0 for the first, as
+ *                an MQTT remaining length of up to 5 bytes
+ *     packet     as on the wire, its fixed header gives its length
+ *
+ * A packet that does not fit in full is left out and counted, so the capture
+ * always reads to its end. The user name and password of a CONNECT are
+ * overwritten with '*', same lengths, the Ubidots token is never kept.
+ *
+ * One client records at a time; any task may read data() up to size(), which
+ * only grows by whole packets.
+ */
+class NBMQTTCapture {
+ public:
+  NBMQTTCapture(unsigned char* buffer, uint32_t bufferLen) : buf(buffer), bufLen(bufferLen) {
+    reset();
+  }
+
+  // Start again from an empty capture
+  void reset() {
+    used = (bufLen >= NBMQTT_CAPTURE_MAGIC_LEN) ? NBMQTT_CAPTURE_MAGIC_LEN : 0;
+    if (used > 0)
+      memcpy(buf, NBMQTT_CAPTURE_MAGIC, NBMQTT_CAPTURE_MAGIC_LEN);
+    start = used;
+    packets = 0;
+    dropped = 0;
+    lastMs = previousMs = 0;
+    lastStamp = previousStamp = 0;
+    __atomic_store_n(&committed, used, __ATOMIC_RELEASE);
+  }
+
+  /**
+   * @brief Start a packet, to be given whole by append() and closed by end().
+   *
+   * @param direction - NBMQTT_CAPTURE_x
+   * @param len - packet length
+   * @return false when it does not fit, then append() and end() are not called
+   */
+  template <class Timer>
+  bool begin(uint8_t direction, uint32_t len) {
+    uint32_t ms = (uint32_t)Timer::now_ms();
+    uint32_t delay = 0;
+
+    if (used == 0 || 1 + NBMQTT_CAPTURE_DELAY_MAX_LEN + len > bufLen - used) {
+      dropped++;
+      return false;
+    }
+    if (packets > 0) {
+      // the stamps wrap, every 14 s with the cycle counter, longer gaps come from the millisecond clock
+      uint32_t gapMs = ms - lastMs;
+      if (gapMs < 10000)
+        delay = Timer::us_since(lastStamp);
+      else
+        delay = (gapMs < 0xFFFFFFFFu / 1000) ? gapMs * 1000 : 0xFFFFFFFFu;
+    }
+    previousMs = lastMs;
+    previousStamp = lastStamp;
+    lastMs = ms;
+    lastStamp = Timer::stamp();
+    buf[used++] = direction;
+    used += encode(buf + used, delay);
+    start = used;
+    return true;
+  }
+
+  void append(const unsigned char* data, uint32_t len) {
+    memcpy(buf + used, data, len);
+    used += len;
+  }
+
+  /**
+   * @brief Close the packet begin() started.
+   *
+   * @param keep - false to leave out a packet that was not sent in full
+   */
+  void end(bool keep) {
+    if (!keep) {
+      used = __atomic_load_n(&committed, __ATOMIC_RELAXED);
+      lastMs = previousMs;  // the next delay runs from the packet before
+      lastStamp = previousStamp;
+      dropped++;
+      return;
+    }
+    if ((buf[start] >> 4) == CONNECT)
+      maskCredentials(buf + start, used - start);
+    packets++;
+    __atomic_store_n(&committed, used, __ATOMIC_RELEASE);
+  }
+
+  // A whole packet
+  template <class Timer>
+  void packet(uint8_t direction, const unsigned char* data, uint32_t len) {
+    if (begin<Timer>(direction, len)) {
+      append(data, len);
+      end(true);
+    }
+  }
+
+  const unsigned char* data() const {
+    return buf;
+  }
+
+  // Bytes of whole packets, the capture as far as it can be read
+  uint32_t size() const {
+    return __atomic_load_n(&committed, __ATOMIC_ACQUIRE);
+  }
+
+  uint32_t getPackets() const {
+    return packets;
+  }
+
+  // Packets left out, the buffer was full
+  uint32_t getDropped() const {
+    return dropped;
+  }
+
+  /**
+   * @brief Read the next packet of a capture.
+   *
+   * @param capture - the capture
+   * @param len - capture length
+   * @param pos - 0 for the first packet, then left as returned
+   * @param record - zeroed for the first packet, then left as returned, atUs adds up the delays
+   * @return false at the end, or on bytes that are not a capture
+   */
+  static bool next(const unsigned char* capture, uint32_t len, uint32_t& pos, NBMQTTCaptureRecord& record) {
+    uint32_t delay = 0, remaining = 0;
+    int n;
+
+    if (pos == 0) {
+      if (len < NBMQTT_CAPTURE_MAGIC_LEN || memcmp(capture, NBMQTT_CAPTURE_MAGIC, NBMQTT_CAPTURE_MAGIC_LEN) != 0)
+        return false;
+      pos = NBMQTT_CAPTURE_MAGIC_LEN;
+    }
+    if (pos + 2 > len || capture[pos] > NBMQTT_CAPTURE_RECEIVED)
+      return false;
+    record.direction = capture[pos++];
+    if ((n = decode(capture + pos, len - pos, NBMQTT_CAPTURE_DELAY_MAX_LEN, delay)) == 0)
+      return false;
+    pos += n;
+    if (pos + 2 > len || (n = decode(capture + pos + 1, len - pos - 1, 4, remaining)) == 0 ||
+        1 + n + remaining > len - pos)
+      return false;
+    record.atUs += delay;
+    record.packet = capture + pos;
+    record.len = 1 + n + remaining;
+    pos += record.len;
+    return true;
+  }
+
+  /**
+   * @brief Overwrite the user name and password of a CONNECT with '*'.
+   * MQTT 3, 3.1.1 and 5 layouts; a packet cut short is masked as far as it goes.
+   *
+   * @param packet - the CONNECT
+   * @param len - packet length
+   */
+  static void maskCredentials(unsigned char* packet, uint32_t len) {
+    uint32_t value, pos;
+    int n;
+    unsigned char version, flags;
+
+    if (len < 2 || (n = decode(packet + 1, len - 1, 4, value)) == 0)
+      return;
+    pos = 1 + n;
+    if (!skipString(packet, len, pos) || pos + 4 > len)  // protocol name
+      return;
+    version = packet[pos];
+    flags = packet[pos + 1];
+    pos += 4;  // version, flags, keep alive
+    if (version == 5 && !skipProperties(packet, len, pos))
+      return;
+    if (!skipString(packet, len, pos))  // client id
+      return;
+    if (flags & 0x04) {  // will
+      if ((version == 5 && !skipProperties(packet, len, pos)) || !skipString(packet, len, pos) || !skipString(packet, len, pos))
+        return;
+    }
+    for (unsigned char flag = 0x80; flag >= 0x40; flag >>= 1) {  // user name, then password
+      uint32_t at = pos + 2;
+      if (!(flags & flag) || !skipString(packet, len, pos))
+        continue;
+      memset(packet + at, '*', pos - at);
+    }
+  }
+
+  /**
+   * @brief Read a variable byte integer, the MQTT remaining length encoding.
+   *
+   * @return bytes read, 0 when cut short or longer than maxLen
+   */
+  static int decode(const unsigned char* data, uint32_t len, int maxLen, uint32_t& value) {
+    uint32_t shift = 0;
+
+    value = 0;
+    for (int i = 0; i < maxLen && (uint32_t)i < len; i++) {
+      value |= (uint32_t)(data[i] & 127) << shift;
+      if ((data[i] & 128) == 0)
+        return i + 1;
+      shift += 7;
+    }
+    return 0;
+  }
+
+ private:
+  static int encode(unsigned char* data, uint32_t value) {
+    int n = 0;
+
+    do {
+      data[n] = value & 127;
+      value >>= 7;
+      if (value > 0)
+        data[n] |= 128;
+      n++;
+    } while (value > 0);
+    return n;
+  }
+
+  static bool skipString(const unsigned char* packet, uint32_t len, uint32_t& pos) {
+    if (pos + 2 > len)
+      return false;
+    pos += 2 + ((packet[pos] << 8) | packet[pos + 1]);
+    return pos <= len;
+  }
+
+  static bool skipProperties(const unsigned char* packet, uint32_t len, uint32_t& pos) {
+    uint32_t value = 0;
+    int n = (pos < len) ? decode(packet + pos, len - pos, 4, value) : 0;
+
+    pos += n + value;
+    return n > 0 && pos <= len;
+  }
+
+  unsigned char* buf;
+  uint32_t bufLen;
+  uint32_t used;       // bytes written, the packet begin() started included
+  uint32_t committed;  // bytes of whole packets
+  uint32_t start;      // where the packet begin() started is
+  uint32_t packets;
+  uint32_t dropped;
+  uint32_t lastMs;     // Timer::now_ms() of the previous packet
+  uint32_t lastStamp;  // Timer::stamp() of the previous packet
+  uint32_t previousMs, previousStamp;  // the ones before, for end(false)
+};
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "NBMQTTCycleCounter.h"
+
 class NBMQTTCountdown
 {
 public:
@@ -42,6 +44,31 @@ public:
     	return ((time-startTime) > delay) ? 0 : delay - (time-startTime);
     }
 
+    // Milliseconds since boot, TICKS_PER_SECOND resolution
+    static uint32_t now_ms()
+    {
+    	return static_cast<uint32_t>((static_cast<uint64_t>(TimeTick) * 1000) / TICKS_PER_SECOND);
+    }
+
+    // Stamp for timing, in cycles; NBMQTTCycleCounter::init() must have run
+    static uint32_t stamp()
+    {
+    	return NBMQTTCycleCounter::now();
+    }
+
+    // Microseconds since a stamp, under 14 s
+    static uint32_t us_since(uint32_t since)
+    {
+    	return NBMQTTCycleCounter::toMicros(NBMQTTCycleCounter::now() - since);
+    }
+
+    // Nanoseconds since a stamp, under 14 s, capped at 4.29 s
+    static uint32_t ns_since(uint32_t since)
+    {
+    	uint64_t ns = (static_cast<uint64_t>(NBMQTTCycleCounter::now() - since) * 1000000000ULL) / NBMQTT_CPU_HZ;
+    	return (ns < 0xFFFFFFFFULL) ? static_cast<uint32_t>(ns) : 0xFFFFFFFFU;
+    }
+
 private:
 
     void init()
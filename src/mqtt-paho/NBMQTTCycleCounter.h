@@ -0,0 +1,59 @@
+#pragma once
+
+#include <stdint.h>
+
+#if !defined(NBMQTT_CPU_HZ)
+#define NBMQTT_CPU_HZ 300000000UL // MODM7AE70 core clock
+#endif
+
+/**
+ * @brief Cortex-M7 DWT cycle counter, used for sub-tick timing.
+ *
+ * TimeTick only has TICKS_PER_SECOND resolution, which is far too coarse to
+ * time a single publish. The cycle counter wraps every 2^32 / NBMQTT_CPU_HZ
+ * seconds (about 14 s at 300 MHz), so only measure intervals shorter than that.
+ */
+class NBMQTTCycleCounter
+{
+public:
+  // Start the counter, once: a running counter is left alone, so intervals
+  // being measured by other code stay valid
+  static void init()
+  {
+    if (reg(DWT_CTRL) & DWT_CTRL_CYCCNTENA)
+      return;
+    reg(DEMCR) |= DEMCR_TRCENA; // enable the trace block
+    reg(DWT_LAR) = DWT_LAR_KEY; // unlock DWT (Cortex-M7)
+    reg(DWT_CYCCNT) = 0;
+    reg(DWT_CTRL) |= DWT_CTRL_CYCCNTENA;
+  }
+
+  static uint32_t now()
+  {
+    return reg(DWT_CYCCNT);
+  }
+
+  static uint32_t toNanos(uint32_t cycles)
+  {
+    return static_cast<uint32_t>((static_cast<uint64_t>(cycles) * 1000000000ULL) / NBMQTT_CPU_HZ);
+  }
+
+  static uint32_t toMicros(uint32_t cycles)
+  {
+    return static_cast<uint32_t>((static_cast<uint64_t>(cycles) * 1000000ULL) / NBMQTT_CPU_HZ);
+  }
+
+private:
+  static const uint32_t DEMCR = 0xE000EDFC;
+  static const uint32_t DWT_CTRL = 0xE0001000;
+  static const uint32_t DWT_CYCCNT = 0xE0001004;
+  static const uint32_t DWT_LAR = 0xE0001FB0;
+  static const uint32_t DEMCR_TRCENA = 1UL << 24;
+  static const uint32_t DWT_CTRL_CYCCNTENA = 1UL << 0;
+  static const uint32_t DWT_LAR_KEY = 0xC5ACCE55;
+
+  static volatile uint32_t &reg(uint32_t address)
+  {
+    return *reinterpret_cast<volatile uint32_t *>(address);
+  }
+};
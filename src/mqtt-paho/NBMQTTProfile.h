@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "NBMQTTStats.h"
+
+/**
+ * @brief Stages of the client hot path timed by NBMQTTProfile.
+ */
+enum NBMQTTProfileStage
+{
+  NBMQTT_STAGE_SERIALIZE, // publish: topic alias, serialization and the copy kept to resend
+  NBMQTT_STAGE_SEND,      // publish: sendPacket, or every chunk of a streamed publish with its producer
+  NBMQTT_STAGE_ACK_WAIT,  // publish: waitfor the PUBACK or PUBCOMP, QoS 1 and 2
+  NBMQTT_STAGE_READ,      // readPacket: from the first byte read to the whole packet
+  NBMQTT_STAGE_DISPATCH,  // cycle: handling of a packet read, deserialization, delivery and the ack sent
+  NBMQTT_STAGE_DELIVER,   // deliverMessage: topic matching and the handlers
+  NBMQTT_STAGE_HANDLER,   // one message handler call, or one batch handler call
+  NBMQTT_STAGES
+};
+
+/**
+ * @brief Per stage timing histograms of an MQTT::Client, built with
+ * MQTTCLIENT_PROFILE; without it no hook is compiled in at all.
+ *
+ * Times are in nanoseconds, from Timer::ns_since(): cycle counter resolution
+ * on the MODM7AE70, microseconds with the POSIX timer. A time above 4.29 s is
+ * recorded as 4.29 s. The stages nest, DISPATCH runs within ACK_WAIT while a
+ * publish waits, HANDLER within DELIVER within DISPATCH, so they do not add up.
+ */
+struct NBMQTTProfile
+{
+  NBMQTTHistogram stages[NBMQTT_STAGES]; // indexed by NBMQTTProfileStage
+
+  NBMQTTProfile()
+  {
+    memset(this, 0, sizeof(*this));
+  }
+
+  void snapshot(NBMQTTProfile &out) const
+  {
+    for (int i = 0; i < NBMQTT_STAGES; i++)
+      stages[i].snapshot(out.stages[i]);
+  }
+
+  static const char *name(int stage)
+  {
+    static const char *const names[NBMQTT_STAGES] = {"serialize", "send", "ackWait", "read", "dispatch", "deliver", "handler"};
+
+    return (stage >= 0 && stage < NBMQTT_STAGES) ? names[stage] : "";
+  }
+};
@@ -38,6 +38,12 @@ public:
     return 0;
   }
 
+  // Nonzero when received data is waiting, so a read will not block
+  int available()
+  {
+    return (mysock > 0) ? dataavail(mysock) : 0;
+  }
+
   int write(unsigned char *buffer, int len, int timeout)
   {
     if (mysock > 0)
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#define NBMQTT_HISTOGRAM_BUCKETS 32 // bucket i holds [2^(i-1), 2^i), bucket 0 holds 0
+#define NBMQTT_PACKET_TYPES 16      // MQTT control packet types, indexed by the header type
+
+/**
+ * @brief Fixed bucket, log2 scale histogram.
+ *
+ * Recording is a few atomic adds, lock free on the Cortex-M7 (LDREX/STREX), so
+ * any task may record while another takes a snapshot. Each field of a snapshot
+ * is exact, the fields together may be one record apart.
+ */
+struct NBMQTTHistogram
+{
+  uint32_t buckets[NBMQTT_HISTOGRAM_BUCKETS];
+  uint32_t count;
+  uint32_t max;
+
+  void record(uint32_t value)
+  {
+    int i = (value == 0) ? 0 : 32 - __builtin_clz(value);
+    if (i >= NBMQTT_HISTOGRAM_BUCKETS)
+      i = NBMQTT_HISTOGRAM_BUCKETS - 1;
+
+    __atomic_fetch_add(&buckets[i], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&count, 1, __ATOMIC_RELAXED);
+
+    uint32_t seen = __atomic_load_n(&max, __ATOMIC_RELAXED);
+    while (value > seen && !__atomic_compare_exchange_n(&max, &seen, value, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+      ;
+  }
+
+  void snapshot(NBMQTTHistogram &out) const
+  {
+    for (int i = 0; i < NBMQTT_HISTOGRAM_BUCKETS; i++)
+      out.buckets[i] = __atomic_load_n(&buckets[i], __ATOMIC_RELAXED);
+    out.count = __atomic_load_n(&count, __ATOMIC_RELAXED);
+    out.max = __atomic_load_n(&max, __ATOMIC_RELAXED);
+  }
+
+  /**
+   * @brief Upper bound of the bucket holding a percentile.
+   *
+   * @param percent 0 to 100
+   * @return the largest value the bucket can hold, never above max, 0 when empty
+   */
+  uint32_t percentile(uint32_t percent) const
+  {
+    uint64_t rank = ((uint64_t)count * percent + 99) / 100; // ceil, so 100 is the last record
+    uint64_t seen = 0;
+
+    if (count == 0)
+      return 0;
+    if (rank == 0)
+      rank = 1;
+    for (int i = 0; i < NBMQTT_HISTOGRAM_BUCKETS; i++)
+    {
+      seen += buckets[i];
+      if (seen >= rank)
+      {
+        uint32_t upper = (i == 0) ? 0 : (uint32_t)((1ULL << i) - 1);
+        return (upper < max) ? upper : max;
+      }
+    }
+    return max;
+  }
+};
+
+/**
+ * @brief Always on counters of an MQTT::Client.
+ *
+ * Packets are counted once sent or read completely, by MQTT packet type
+ * (PUBLISH = 3, PUBACK = 4, ...). Times are in microseconds, from the Timer
+ * policy stamps; on the MODM7AE70 the cycle counter wraps every 14 s, so a
+ * longer ack wait is recorded modulo that.
+ */
+struct NBMQTTStats
+{
+  uint32_t packetsIn[NBMQTT_PACKET_TYPES];  // packets read, by type
+  uint32_t packetsOut[NBMQTT_PACKET_TYPES]; // packets sent, by type
+  uint32_t bytesIn;                         // bytes of the packets read
+  uint32_t bytesOut;                        // bytes written to the network
+  uint32_t sendErrors;                      // packets the network did not take completely
+  NBMQTTHistogram sendUs;                   // time to write one packet, or a streamed publish
+  NBMQTTHistogram ackUs;                    // QoS 1 and 2 publish, from the first byte sent to PUBACK or PUBCOMP
+
+  NBMQTTStats()
+  {
+    memset(this, 0, sizeof(*this));
+  }
+
+  static void count(uint32_t &counter, uint32_t n = 1)
+  {
+    __atomic_fetch_add(&counter, n, __ATOMIC_RELAXED);
+  }
+
+  void snapshot(NBMQTTStats &out) const
+  {
+    for (int i = 0; i < NBMQTT_PACKET_TYPES; i++)
+    {
+      out.packetsIn[i] = __atomic_load_n(&packetsIn[i], __ATOMIC_RELAXED);
+      out.packetsOut[i] = __atomic_load_n(&packetsOut[i], __ATOMIC_RELAXED);
+    }
+    out.bytesIn = __atomic_load_n(&bytesIn, __ATOMIC_RELAXED);
+    out.bytesOut = __atomic_load_n(&bytesOut, __ATOMIC_RELAXED);
+    out.sendErrors = __atomic_load_n(&sendErrors, __ATOMIC_RELAXED);
+    sendUs.snapshot(out.sendUs);
+    ackUs.snapshot(out.ackUs);
+  }
+};
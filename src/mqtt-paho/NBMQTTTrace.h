@@ -0,0 +1,210 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "MQTTPacket.h"
+
+#if !defined(NBMQTT_TRACE_ENTRIES)
+#define NBMQTT_TRACE_ENTRIES 32  // packets kept, a power of 2
+#endif
+#if !defined(NBMQTT_TRACE_BYTES)
+#define NBMQTT_TRACE_BYTES 48  // leading bytes kept of each packet, enough for a short topic
+#endif
+
+enum NBMQTTTraceEvent { NBMQTT_TRACE_SENT,          // packet written, or not, see rc
+                        NBMQTT_TRACE_RECEIVED,      // packet read, or not, see rc
+                        NBMQTT_TRACE_QOS2_FULL,     // incoming QoS 2 publish not delivered, no room for its id
+                        NBMQTT_TRACE_PING_TIMEOUT,  // PINGRESP not received in the keepalive interval
+};
+
+/**
+ * @brief One traced packet, undecoded.
+ */
+struct NBMQTTTraceEntry {
+  uint32_t seq;                              // position + 1 once complete, 0 while written
+  uint32_t stamp;                            // Timer::stamp() when recorded
+  uint32_t len;                              // whole packet length, header included
+  uint16_t id;                               // packet id, 0 for none
+  uint8_t event;                             // NBMQTT_TRACE_x
+  int8_t rc;                                 // SUCCESS or the failure
+  uint8_t captured;                          // bytes kept of the packet
+  unsigned char bytes[NBMQTT_TRACE_BYTES];  // the packet start, fixed header first
+};
+
+/**
+ * @brief Lock free ring of the last NBMQTT_TRACE_ENTRIES packets of a client.
+ *
+ * Recording copies the packet start and takes one atomic add, so it costs
+ * about the same whatever the packet; nothing is formatted until read(), then
+ * format() decodes the kept bytes with MQTTFormat. Any task may record or
+ * read. A reader skips the entries overwritten while it copies them.
+ */
+class NBMQTTTrace {
+ public:
+  NBMQTTTrace() {
+    memset(this, 0, sizeof(*this));
+  }
+
+  void record(uint8_t event, const unsigned char* packet, int available, uint32_t len, int rc, uint32_t stamp) {
+    uint32_t pos = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED);
+    NBMQTTTraceEntry& e = entries[pos % NBMQTT_TRACE_ENTRIES];
+
+    __atomic_store_n(&e.seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);  // readers see 0 before any new byte
+    if (available > NBMQTT_TRACE_BYTES)
+      available = NBMQTT_TRACE_BYTES;
+    if (available < 0)
+      available = 0;
+    if (available > 0)
+      memcpy(e.bytes, packet, available);
+    if (available > 0 && (packet[0] >> 4) == CONNECT)
+      available = connectStart(e.bytes, available);
+    e.stamp = stamp;
+    e.len = len;
+    e.id = packetId(packet, available);
+    e.event = event;
+    e.rc = (int8_t)rc;
+    e.captured = (uint8_t)available;
+    __atomic_store_n(&e.seq, pos + 1, __ATOMIC_RELEASE);
+  }
+
+  /**
+   * @brief Copy the next entry, oldest first.
+   *
+   * @param cursor - 0 to start from the oldest entry kept, then left to read() to advance
+   * @param out - the entry
+   * @return false once there is no newer entry
+   */
+  bool read(uint32_t& cursor, NBMQTTTraceEntry& out) const {
+    uint32_t end = __atomic_load_n(&next, __ATOMIC_ACQUIRE);
+
+    if (end - cursor > NBMQTT_TRACE_ENTRIES)
+      cursor = end - NBMQTT_TRACE_ENTRIES;  // the older ones are overwritten
+    for (; cursor != end; cursor++) {
+      const NBMQTTTraceEntry& e = entries[cursor % NBMQTT_TRACE_ENTRIES];
+      if (__atomic_load_n(&e.seq, __ATOMIC_ACQUIRE) != cursor + 1)
+        continue;  // still being written, or already reused
+      memcpy(&out, &e, sizeof(out));
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&e.seq, __ATOMIC_RELAXED) != cursor + 1)
+        continue;  // reused during the copy
+      out.seq = ++cursor;
+      return true;
+    }
+    return false;
+  }
+
+  /**
+   * @brief Decode an entry into one line.
+   *
+   * The packet is decoded by MQTTFormat_toServerString() when sent and
+   * MQTTFormat_toClientString() when received, available with MQTT_SERVER and
+   * MQTT_CLIENT defined; only the kept bytes are, so a long publish shows a
+   * shortened payload, or its type alone when the topic does not fit.
+   *
+   * @param line - output, NUL terminated
+   * @param lineLen - size of line
+   * @param e - entry from read()
+   * @param ageUs - time since the entry was recorded, Timer::us_since(e.stamp)
+   * @return length of line
+   */
+  static int format(char* line, int lineLen, const NBMQTTTraceEntry& e, uint32_t ageUs) {
+    int captured = (e.captured < NBMQTT_TRACE_BYTES) ? e.captured : NBMQTT_TRACE_BYTES;
+    unsigned char type = (captured > 0) ? e.bytes[0] >> 4 : 0;
+    char decoded[120] = "";
+    int len;
+
+    if (lineLen <= 0)
+      return 0;
+    if (captured > 1 && e.rc >= 0) {
+      // the kept bytes as a packet of their own, so the decoders stay in bounds
+      unsigned char packet[NBMQTT_TRACE_BYTES + 4];
+      int rem_len = 0;
+      int start = 1 + MQTTPacket_decodeBuf((unsigned char*)e.bytes + 1, &rem_len);
+      int kept = (captured > start) ? captured - start : 0;
+      packet[0] = e.bytes[0];
+      int header = 1 + MQTTPacket_encode(packet + 1, kept);
+      memcpy(packet + header, e.bytes + start, kept);
+#if defined(MQTT_SERVER)
+      if (e.event == NBMQTT_TRACE_SENT)
+        MQTTFormat_toServerString(decoded, sizeof(decoded) - 1, packet, header + kept);
+#endif
+#if defined(MQTT_CLIENT)
+      if (e.event != NBMQTT_TRACE_SENT)
+        MQTTFormat_toClientString(decoded, sizeof(decoded) - 1, packet, header + kept);
+#endif
+    }
+
+    if (e.event == NBMQTT_TRACE_SENT || e.event == NBMQTT_TRACE_RECEIVED)
+      len = snprintf(line, lineLen, "%10lu us ago %s %s id %u len %lu", (unsigned long)ageUs,
+                     (e.event == NBMQTT_TRACE_SENT) ? ">" : "<", (type < 15) ? MQTTPacket_getName(type) : "AUTH",
+                     e.id, (unsigned long)e.len);
+    else
+      len = snprintf(line, lineLen, "%10lu us ago %s id %u", (unsigned long)ageUs,
+                     (e.event == NBMQTT_TRACE_QOS2_FULL) ? "QoS 2 ids full" : "PINGRESP missing", e.id);
+    if (e.rc < 0 && len < lineLen)
+      len += snprintf(line + len, lineLen - len, " rc %d", e.rc);
+    if (decoded[0] && len < lineLen)
+      len += snprintf(line + len, lineLen - len, ": %s", decoded);
+    return (len < lineLen) ? len : lineLen - 1;
+  }
+
+ private:
+  /**
+   * Keep a CONNECT up to its client id, its will and credentials flags
+   * cleared, so the user name (the Ubidots token) and password never reach
+   * the trace and the kept bytes still decode.
+   * @return the bytes kept, only the fixed header when the client id was not captured
+   */
+  static int connectStart(unsigned char* bytes, int available) {
+    int rem_len = 0;
+    int header = 1 + MQTTPacket_decodeBuf(bytes + 1, &rem_len);
+    int pos = header;
+
+    if (pos + 2 > available)
+      return header;
+    pos += 2 + ((bytes[pos] << 8) | bytes[pos + 1]);  // protocol name
+    int flags = pos + 1;                              // after the version
+    pos += 4;                                         // version, flags, keep alive
+    if (pos + 2 > available)
+      return header;
+    pos += 2 + ((bytes[pos] << 8) | bytes[pos + 1]);  // client id, MQTT 3 layout
+    if (pos > available)
+      return header;
+    bytes[flags] &= 0x03;  // clean session and reserved only
+    return pos;
+  }
+
+  static uint16_t packetId(const unsigned char* packet, int available) {
+    int rem_len = 0;
+    int pos;
+
+    if (available < 2)
+      return 0;
+    pos = 1 + MQTTPacket_decodeBuf((unsigned char*)packet + 1, &rem_len);
+    switch (packet[0] >> 4) {
+      case PUBLISH:
+        if (((packet[0] >> 1) & 3) == 0 || pos + 2 > available)
+          return 0;  // QoS 0 has none
+        pos += 2 + ((packet[pos] << 8) | packet[pos + 1]);
+        break;
+      case PUBACK:
+      case PUBREC:
+      case PUBREL:
+      case PUBCOMP:
+      case SUBSCRIBE:
+      case SUBACK:
+      case UNSUBSCRIBE:
+      case UNSUBACK:
+        break;
+      default:
+        return 0;
+    }
+    return (pos + 2 <= available) ? (uint16_t)((packet[pos] << 8) | packet[pos + 1]) : 0;
+  }
+
+  NBMQTTTraceEntry entries[NBMQTT_TRACE_ENTRIES];
+  uint32_t next;  // position of the next entry, the count recorded
+};
@@ -11,7 +11,18 @@
 
 #include <ubidots.h>
 
-#define TMPT_SIMPLE_PUBLISH_VAR "{\"%s\": %.2f}"
+#if UBIDOTS_COMPRESSION || UBIDOTS_DISPATCH || MQTTCLIENT_STATS
+#include <NBMQTTCycleCounter.h>
+#endif
+
+/*---------------------  Definitions ---------------------*/
+#if UBIDOTS_DISPATCH
+#define UBIDOTS_CLIENT_LOCK() OSCriticalSectionObj clientLockObj(this->clientLock) /*!< Client shared with the dispatch task */
+#else
+#define UBIDOTS_CLIENT_LOCK()
+#endif
+#define UBIDOTS_GATEWAY_SENT 0xFFFF /*!< Device of a gateway value already out of the queue */
+/*------------------------------------------------*/
 
 /*---------------------  Globals ---------------------*/
 static const char TAG[] = "UBIDOTS";
@@ -27,7 +38,8 @@ static const char UBIDOTS_STATES[][30] = {
     "timer_error",
     "subscribe_error",
     "publish_error",
-    "not_authorized"};
+    "not_authorized",
+    "rate_limited"};
 
 /*------------------------------------------------*/
 
@@ -42,6 +54,11 @@ static void printSocketErrors(int fd_print);
 /*------------------------------------------------*/
 
 /*---------------------  Private fuctions ---------------------*/
+static uint32_t nowMs()
+{ // TimeTick in ms, wraps consistently as TICKS_PER_SECOND divides 1000
+  return (uint32_t)((uint64_t)TimeTick * 1000 / TICKS_PER_SECOND);
+}
+
 static void printSocketErrors(int fd_print)
 {
   iprintf("Conection failed with error %d, ", fd_print);
@@ -97,16 +114,479 @@ static void printSocketErrors(int fd_print)
 /*------------------------------------------------*/
 
 /*---------------------  Private Methods  ---------------------*/
-void Ubidots::consoleLog(const char *format, ...)
+bool Ubidots::subscribeVariable(const char *variable, const ubidots_value_sub_t &sub)
+{
+  UBIDOTS_CLIENT_LOCK();
+
+#if UBIDOTS_WILDCARD_MAX_VARIABLES > 0
+  if (this->wildcard)
+    return this->subscribeWildcard(variable, sub);
+#endif
+  if (this->subTopicsUsed >= UBIDOTS_SUBSCRIBE_MAX_TOPICS)
+    return false; // No topics available
+
+  char *topic = this->subTopics[this->subTopicsUsed]; // Subscription topic
+
+  // Create subscribe topic using the base topic
+  strcpy(topic, this->baseTopic);
+  strcat(topic, "/");
+  strcat(topic, variable);
+  strcat(topic, "/lv");
+
+  int subState = -1; // Subscription state
+
+  if (this->client.isConnected() || this->clientSSL.isConnected())
+  { // If mqtt connected
+    this->subValues[this->subTopicsUsed] = sub;
+    if (sub.type == ubidots_value_sub_t::UBIDOTS_VALUE_RAW && !UBIDOTS_DISPATCH)
+    { // Raw handler called by the client, unless it is dispatched
+      subState = (this->ssl) ? this->clientSSL.subscribe(topic, MQTT::QOS0, sub.handler.raw)
+                             : this->client.subscribe(topic, MQTT::QOS0, sub.handler.raw);
+    }
+    else
+    { // Typed or dispatched handler, called by onValueMessage
+      subState = (this->ssl) ? this->clientSSL.subscribe(topic, MQTT::QOS0, this, &Ubidots::onValueMessage)
+                             : this->client.subscribe(topic, MQTT::QOS0, this, &Ubidots::onValueMessage);
+    }
+  }
+
+  if (subState != 0)
+    return false; // Subscribe error
+
+  this->subTopicsUsed++; // Adds one topic used
+
+  this->notify(UBIDOTS_EVENT_SUBSCRIBED, (void *)nullptr); // Event subscribed callback
+
+  return true;
+}
+
+void Ubidots::onValueMessage(MQTT::MessageData &md)
+{
+  MQTTLenString &topic = md.topicName.lenstring;
+
+  for (uint8_t i = 0; i < this->subTopicsUsed; i++)
+  {
+    if (strlen(this->subTopics[i]) == (size_t)topic.len && memcmp(this->subTopics[i], topic.data, topic.len) == 0)
+    {
+      this->deliverValue(this->subValues[i], md);
+      return;
+    }
+  }
+}
+
+void Ubidots::deliverValue(const ubidots_value_sub_t &sub, MQTT::MessageData &md)
+{
+#if UBIDOTS_DISPATCH
+  if (this->dispatching)
+  {
+    this->dispatchPush(ubidots_dispatch_t::UBIDOTS_DISPATCH_VALUE, &sub, &md);
+    return;
+  }
+#endif
+  this->invokeValue(sub, md);
+}
+
+void Ubidots::invokeValue(const ubidots_value_sub_t &sub, MQTT::MessageData &md)
+{
+  ubidots_value_t value;
+
+  if (sub.type == ubidots_value_sub_t::UBIDOTS_VALUE_RAW)
+  { // Payload left to the handler
+    if (sub.handler.raw)
+      sub.handler.raw(md);
+    return;
+  }
+
+  if (!this->parseValue(md, &value))
+  {
+    UBIDOTS_LOGW(this->log, "Malformed value on %.*s\r\n", md.topicName.lenstring.len, md.topicName.lenstring.data);
+    return;
+  }
+
+  switch (sub.type)
+  {
+  case ubidots_value_sub_t::UBIDOTS_VALUE_FLOAT:
+    sub.handler.toFloat(sub.ctx, (float)value.value, value.timestamp);
+    break;
+  case ubidots_value_sub_t::UBIDOTS_VALUE_INT:
+  { // Round to nearest, saturated
+    double v = value.value;
+    int32_t n = (v >= 2147483647.0) ? INT32_MAX : (v <= -2147483648.0) ? INT32_MIN : (int32_t)(v + ((v < 0) ? -0.5 : 0.5));
+    sub.handler.toInt(sub.ctx, n, value.timestamp);
+    break;
+  }
+  case ubidots_value_sub_t::UBIDOTS_VALUE_BOOL:
+    sub.handler.toBool(sub.ctx, value.value != 0, value.timestamp);
+    break;
+  default:
+    break;
+  }
+}
+
+bool Ubidots::parseValue(MQTT::MessageData &md, ubidots_value_t *value)
+{
+#if UBIDOTS_COMPRESSION
+  if (ubidotsIsCompressed(md.message.payload, md.message.payloadlen))
+  { // Context, if any, points into decompressBuf until the next message
+    int len = ubidotsDecompress((const uint8_t *)md.message.payload, md.message.payloadlen, this->decompressBuf, sizeof(this->decompressBuf));
+    return len >= 0 && ubidotsParseValue(this->decompressBuf, len, value);
+  }
+#endif
+  return ubidotsParseValue(md.message, value);
+}
+
+bool Ubidots::passRateLimit(size_t payloadLen)
+{
+  uint32_t waitMs = ubidotsRateTake(&this->rateLimit, payloadLen, nowMs());
+
+  if (waitMs == 0)
+  {
+    this->backfillHold = false; // Live traffic is flowing
+    return true;
+  }
+
+  this->rateRefused(waitMs);
+  return false;
+}
+
+void Ubidots::rateRefused(uint32_t waitMs)
+{
+  // Backfill waits until this producer had its turn
+  this->backfillHold = true;
+  this->backfillHoldMs = nowMs() + waitMs + UBIDOTS_BACKFILL_YIELD_MS;
+
+  ubidots_state_t state = UBIDOTS_RATE_LIMITED; // Ubidots state
+  UBIDOTS_LOGW(this->log, "Publish rate limited, retry in %lu ms\r\n", (unsigned long)waitMs);
+  this->notify(UBIDOTS_EVENT_ERROR, (void *)state); // Event error callback
+}
+
+bool Ubidots::backfillStep()
+{
+  if (this->backfillPeek == nullptr)
+    return true; // No backfill
+  if (this->backfillHold && (int32_t)(nowMs() - this->backfillHoldMs) < 0)
+    return true; // Live traffic first
+  if (ubidotsRateWait(&this->rateLimit, 0, nowMs()) > 0)
+    return true; // No message token, tried again by the next keepAlive
+
+  char buf[UBIDOTS_MSG_MAX_LEN]; // Buffer for message
+  ubidots_backfill_t backfill;
+  ubidots_sample_t sample;
+  uint32_t samples = 0;
+  bool more = false;
+
+  ubidotsBackfillInit(&backfill, buf, UBIDOTS_MSG_MAX_LEN);
+  while ((more = this->backfillPeek(this->backfillCtx, samples, &sample)) && ubidotsBackfillAdd(&backfill, &sample))
+  {
+    samples++;
+  }
+
+  if (samples == 0)
+  {
+    if (more)
+    { // A sample that fits in no payload would block the backfill
+      UBIDOTS_LOGW(this->log, "Backfill sample of %s dropped, too long\r\n", sample.variable);
+      this->backfillSent(this->backfillCtx, 1);
+    }
+    return true;
+  }
+
+  if (ubidotsRateWait(&this->rateLimit, backfill.len, nowMs()) > 0)
+    return true; // No byte tokens yet
+  if (!this->publishTo(this->baseTopic, buf, backfill.len))
+    return false; // Sent again by the next keepAlive
+
+  this->backfillSent(this->backfillCtx, samples);
+  return true;
+}
+
+bool Ubidots::publishTo(const char *topic, const void *payload, size_t payloadLen)
+{
+  UBIDOTS_CLIENT_LOCK();
+
+  if (payload == nullptr || payloadLen > UBIDOTS_MSG_MAX_LEN)
+    return false; // No payload
+  if (!this->connected)
+    return false; // No mqtt connection active
+
+  MQTT::Message message; // message to send
+  int pState = -1;       // Publish state
+
+  message.qos = this->qos;           // Quality of service
+  message.retained = false;          // Message retained on broker false
+  message.dup = false;               // No duplicate message
+  message.payload = (void *)payload; // Data buffer
+  message.payloadlen = payloadLen;   // Data buffer len
+
+#if UBIDOTS_COMPRESSION
+  if (this->compress && payloadLen >= UBIDOTS_COMPRESS_MIN_LEN)
+  { // Only worth it when the payload shrinks
+    uint32_t start = NBMQTTCycleCounter::now();
+    int len = ubidotsCompress(&this->lz, (const uint8_t *)payload, payloadLen, this->compressBuf, payloadLen - 1);
+    uint32_t us = NBMQTTCycleCounter::toMicros(NBMQTTCycleCounter::now() - start);
+
+    if (len > 0)
+    {
+      message.payload = this->compressBuf;
+      message.payloadlen = len;
+    }
+    this->compressStats.messages++;
+    this->compressStats.bytesIn += payloadLen;
+    this->compressStats.bytesOut += message.payloadlen;
+    this->compressStats.totalUs += us;
+    this->compressStats.lastBytesIn = payloadLen;
+    this->compressStats.lastBytesOut = message.payloadlen;
+    this->compressStats.lastUs = us;
+  }
+#endif
+
+  if (!this->passRateLimit(message.payloadlen))
+    return false; // Over the publish rate
+
+  pState = (this->ssl) ? this->clientSSL.publish(topic, message) : this->client.publish(topic, message);
+
+  if (pState < 0)
+  {                                                // If publish error
+    ubidots_state_t state = UBIDOTS_PUBLISH_ERROR; // Ubidots state
+    NBMQTTStats::count(this->counters.publishErrors);
+    UBIDOTS_LOGE(this->log, "Publish Error [%d] \r\n", pState);
+    this->notify(UBIDOTS_EVENT_ERROR, (void *)state); // Event error callback
+    return false;
+  }
+
+  NBMQTTStats::count(this->counters.publishes);
+  this->notify(UBIDOTS_EVENT_PUBLISHED, (void *)nullptr); // Event published callback
+
+  if (this->encoder->binary || message.payload != payload)
+    UBIDOTS_LOGD(this->log, "Message published (%d of %d bytes) to %s\r\n", (int)message.payloadlen, (int)payloadLen, topic);
+  else
+    UBIDOTS_LOGD(this->log, "Message published %.*s to %s\r\n", (int)payloadLen, (const char *)payload, topic);
+
+  return true;
+}
+
+#if UBIDOTS_GATEWAY
+void Ubidots::onGatewayMessage(MQTT::MessageData &md)
+{
+#if UBIDOTS_DISPATCH
+  if (this->dispatching)
+  {
+    this->dispatchPush(ubidots_dispatch_t::UBIDOTS_DISPATCH_GATEWAY, nullptr, &md);
+    return;
+  }
+#endif
+  this->deliverGateway(md);
+}
+
+void Ubidots::deliverGateway(MQTT::MessageData &md)
+{
+  MQTTLenString &topic = md.topicName.lenstring;
+  const size_t pathLen = sizeof(UBIDOTS_BROKER_PATH) - 1;
+
+  // Topic is /v1.6/devices/<device>/<variable>/lv
+  if ((size_t)topic.len <= pathLen + 3 || memcmp(topic.data + topic.len - 3, "/lv", 3) != 0)
+    return; // Not a variable value
+
+  const char *label = topic.data + pathLen;
+  const char *end = topic.data + topic.len - 3;
+  const char *slash = (const char *)memchr(label, '/', end - label);
+  if (slash == nullptr)
+    return; // No variable
+
+  int device = ubidotsDevicesFind(&this->devices, label, slash - label);
+  if (device < 0)
+    return; // Not a gateway device
+
+  ubidots_value_t value;
+  if (!this->parseValue(md, &value))
+  {
+    UBIDOTS_LOGW(this->log, "Malformed value on %.*s\r\n", topic.len, topic.data);
+    return;
+  }
+  this->gatewayHandler(this->gatewayCtx, device, slash + 1, end - slash - 1, value);
+}
+#endif
+
+#if UBIDOTS_WILDCARD_MAX_VARIABLES > 0
+bool Ubidots::subscribeWildcard(const char *variable, const ubidots_value_sub_t &sub)
+{
+  if (!this->client.isConnected() && !this->clientSSL.isConnected())
+    return false; // No mqtt connection active
+
+  int index = ubidotsVariablesAdd(&this->wildVars, variable, strlen(variable));
+  if (index < 0)
+  { // Table full or name too long
+    ubidots_state_t state = UBIDOTS_SUBSCRIBE_ERROR; // Ubidots state
+    UBIDOTS_LOGE(this->log, "Subscribe Error, no room for variable %s\r\n", variable);
+    this->notify(UBIDOTS_EVENT_ERROR, (void *)state); // Event error callback
+    return false;
+  }
+  this->wildSubs[index] = sub; // Set or replace the handler
+
+  if (!this->wildSubscribed)
+  { // First variable of this connection
+    int subState = (this->ssl) ? this->clientSSL.subscribe(this->wildTopic, MQTT::QOS0, this, &Ubidots::onWildcardMessage)
+                               : this->client.subscribe(this->wildTopic, MQTT::QOS0, this, &Ubidots::onWildcardMessage);
+    if (subState != 0)
+      return false; // Subscribe error
+    this->wildSubscribed = true;
+  }
+
+  this->notify(UBIDOTS_EVENT_SUBSCRIBED, (void *)nullptr); // Event subscribed callback
+
+  return true;
+}
+
+void Ubidots::onWildcardMessage(MQTT::MessageData &md)
+{
+  MQTTLenString &topic = md.topicName.lenstring;
+
+  // Topic is <base topic>/<variable>/lv
+  if (topic.len <= this->wildVarOffset + 3 || memcmp(topic.data + topic.len - 3, "/lv", 3) != 0)
+    return; // Not a variable value
+
+  int index = ubidotsVariablesFind(&this->wildVars, topic.data + this->wildVarOffset, topic.len - this->wildVarOffset - 3);
+  if (index >= 0)
+    this->deliverValue(this->wildSubs[index], md);
+}
+#endif
+void Ubidots::setConnected(bool connected)
+{
+  if (connected && !this->connected)
+  { // New connection
+    if (this->counters.connects > 0)
+      NBMQTTStats::count(this->counters.reconnects);
+    NBMQTTStats::count(this->counters.connects);
+    this->connectedAt = nowMs();
+  }
+  else if (!connected && this->connected)
+  { // Connection lost
+    uint32_t now = nowMs();
+    ubidots_link_event_t &event = this->linkHistory[this->counters.disconnects % UBIDOTS_LINK_HISTORY];
+
+    event.atMs = now;
+    event.upMs = now - this->connectedAt;
+    NBMQTTStats::count(this->counters.connectedMs, event.upMs);
+    __atomic_fetch_add(&this->counters.disconnects, 1, __ATOMIC_RELEASE); // Publishes the entry
+  }
+  this->connected = connected;
+}
+
+void Ubidots::notify(ubidots_events_t event, void *arg)
+{
+  if (this->cbPtrArr[event] == nullptr)
+    return; // No callback
+
+#if UBIDOTS_DISPATCH
+  if (this->dispatching)
+  {
+    this->dispatchPush(ubidots_dispatch_t::UBIDOTS_DISPATCH_EVENT, nullptr, nullptr, event, arg);
+    return;
+  }
+#endif
+  this->cbPtrArr[event](arg);
+}
+
+#if UBIDOTS_DISPATCH
+void Ubidots::startDispatch()
+{
+  NBMQTTCycleCounter::init(); // Times the queue latency
+
+  uint8_t rc = OSTaskCreatewName(Ubidots::dispatchTask, this, &this->dispatchStack[USER_TASK_STK_SIZE], this->dispatchStack,
+                                 this->dispatchPrio, "Ubidots dispatch");
+  if (rc != OS_NO_ERR)
+  { // Priority taken, callbacks keep running inline
+    UBIDOTS_LOGW(this->log, "Dispatch task not created [%d], callbacks run inline\r\n", rc);
+    return;
+  }
+  this->dispatching = true;
+}
+
+void Ubidots::dispatchPush(int kind, const ubidots_value_sub_t *sub, MQTT::MessageData *md, ubidots_events_t event, void *arg)
+{
+  size_t topicLen = (md) ? md->topicName.lenstring.len : 0;
+  size_t payloadLen = (md) ? md->message.payloadlen : 0;
+
+  {
+    OSCriticalSectionObj lock(this->dispatchLock);
+
+    if (this->dispatchCount >= UBIDOTS_DISPATCH_DEPTH || topicLen + payloadLen > UBIDOTS_DISPATCH_DATA_LEN)
+    { // Queue full or message too long, the MQTT loop never waits for user code
+      this->dispatchStats.dropped++;
+      return;
+    }
+
+    ubidots_dispatch_t &entry = this->dispatchQueue[this->dispatchHead];
+    entry.kind = (uint8_t)kind;
+    entry.event = event;
+    entry.arg = arg;
+    if (sub)
+      entry.sub = *sub;
+    if (md)
+    { // Keep topic and payload, the client reuses its buffer
+      entry.message = md->message;
+      entry.topicLen = (uint16_t)topicLen;
+      memcpy(entry.data, md->topicName.lenstring.data, topicLen);
+      memcpy(entry.data + topicLen, md->message.payload, payloadLen);
+    }
+    entry.queuedAt = NBMQTTCycleCounter::now();
+
+    this->dispatchHead = (this->dispatchHead + 1) % UBIDOTS_DISPATCH_DEPTH;
+    this->dispatchCount++;
+    this->dispatchStats.queued++;
+    if (this->dispatchCount > this->dispatchStats.maxDepth)
+      this->dispatchStats.maxDepth = this->dispatchCount;
+  }
+
+  this->dispatchSem.Post(); // Wake the dispatch task
+}
+
+void Ubidots::dispatchTask(void *pd)
 {
-  if (this->log)
-  { // If able log
-    va_list vl;
-    va_start(vl, format);
-    viprintf(format, vl);
-    va_end(vl);
+  Ubidots *ubidots = static_cast<Ubidots *>(pd);
+  ubidots_dispatch_t entry; // Copy, the slot is free while the callback runs
+
+  while (1)
+  {
+    ubidots->dispatchSem.Pend(0);
+
+    {
+      OSCriticalSectionObj lock(ubidots->dispatchLock);
+      entry = ubidots->dispatchQueue[ubidots->dispatchTail];
+      ubidots->dispatchTail = (ubidots->dispatchTail + 1) % UBIDOTS_DISPATCH_DEPTH;
+      ubidots->dispatchCount--;
+    }
+
+    // Queue latency
+    uint32_t us = NBMQTTCycleCounter::toMicros(NBMQTTCycleCounter::now() - entry.queuedAt);
+    ubidots->dispatchStats.lastUs = us;
+    ubidots->dispatchStats.totalUs += us;
+    if (us > ubidots->dispatchStats.maxUs)
+      ubidots->dispatchStats.maxUs = us;
+
+    if (entry.kind == ubidots_dispatch_t::UBIDOTS_DISPATCH_EVENT)
+    {
+      if (ubidots->cbPtrArr[entry.event])
+        ubidots->cbPtrArr[entry.event](entry.arg);
+      continue;
+    }
+
+    // Message rebuilt over the copy
+    MQTTString topic = MQTTString_initializer;
+    topic.lenstring.len = entry.topicLen;
+    topic.lenstring.data = entry.data;
+    entry.message.payload = entry.data + entry.topicLen;
+    MQTT::MessageData md(topic, entry.message);
+
+    if (entry.kind == ubidots_dispatch_t::UBIDOTS_DISPATCH_VALUE)
+      ubidots->invokeValue(entry.sub, md);
+#if UBIDOTS_GATEWAY
+    else
+      ubidots->deliverGateway(md);
+#endif
   }
 }
+#endif
 /*------------------------------------------------*/
 
 /*---------------------  Constructor/Destructor Methods  ---------------------*/
@@ -117,7 +597,47 @@ Ubidots::Ubidots(const char *token, const char *device_name, bool ssl, bool log)
   this->token = token;        // Init token
   this->connected = false;    // Init connected
   this->device = device_name; // Init device name
+  this->host = UBIDOTS_MQTT_HOST; // Init broker host
+  this->port = 0;             // Default port for TCP or SSL
+  this->qos = MQTT::QOS0;     // Init publish QoS
+  this->encoder = &ubidotsJsonEncoder; // Init publish payload encoder
+  ubidotsRateInit(&this->rateLimit, nowMs()); // No publish rate limit
+  memset(&this->counters, 0, sizeof(this->counters));
+  this->connectedAt = 0;
+  memset(this->linkHistory, 0, sizeof(this->linkHistory));
+#if MQTTCLIENT_STATS
+  NBMQTTCycleCounter::init(); // Times the client packets
+#endif
+#if UBIDOTS_DISPATCH
+  this->dispatching = false;  // Inline until connect() starts the task
+  this->dispatchPrio = UBIDOTS_DISPATCH_PRIO;
+  this->dispatchHead = 0;
+  this->dispatchTail = 0;
+  this->dispatchCount = 0;
+  memset(&this->dispatchStats, 0, sizeof(this->dispatchStats));
+#endif
+  this->backfillPeek = nullptr; // No backfill
+  this->backfillSent = nullptr;
+  this->backfillCtx = nullptr;
+  this->backfillHold = false;
+  this->backfillHoldMs = 0;
   this->subTopicsUsed = 0;    // Number de subscribe topics used
+#if UBIDOTS_GATEWAY
+  this->batchUsed = 0;        // No gateway values queued
+  this->gatewayHandler = nullptr;
+  this->gatewayCtx = nullptr;
+  ubidotsDevicesInit(&this->devices);
+#endif
+#if UBIDOTS_WILDCARD_MAX_VARIABLES > 0
+  this->wildcard = false;     // One subscription per variable
+  this->wildSubscribed = false;
+  ubidotsVariablesInit(&this->wildVars);
+#endif
+#if UBIDOTS_COMPRESSION
+  this->compress = false;     // Init compression
+  memset(&this->compressStats, 0, sizeof(this->compressStats));
+  ubidotsLzInit(&this->lz);
+#endif
 
   memset(this->subTopics, 0, sizeof(this->subTopics)); // Initialize subs topics array
 
@@ -129,7 +649,7 @@ Ubidots::Ubidots(const char *token, const char *device_name, bool ssl, bool log)
 
   // Init Ubidots MQTT configuration
   this->mqttOptions = MQTTPacket_connectData_initializer;
-  this->mqttOptions.MQTTVersion = 3;
+  this->mqttOptions.MQTTVersion = UBIDOTS_MQTT_VERSION;
   this->mqttOptions.keepAliveInterval = UBIDOTS_KEEP_ALIVE_MS;
   this->mqttOptions.cleansession = 1;
   this->mqttOptions.username.cstring = (char *)token;
@@ -150,7 +670,7 @@ Ubidots::Ubidots(const char *token, const char *device_name, bool ssl, bool log)
   strcpy(this->baseTopic, UBIDOTS_BROKER_PATH);
   strcat(this->baseTopic, this->device);
 
-  this->consoleLog("-- %s: APP iniciada --\r\n", "Ubidots");
+  UBIDOTS_LOGI(this->log, "-- %s: APP iniciada --\r\n", "Ubidots");
 }
 
 Ubidots::~Ubidots() {}
@@ -162,6 +682,15 @@ bool Ubidots::connect()
 {
   ubidots_state_t state = UBIDOTS_NONE; // Ubidots state
 
+#if UBIDOTS_LOG_DEFERRED
+  ubidotsLogStart(UBIDOTS_LOG_PRIO); // Prints the log, once
+#endif
+#if UBIDOTS_DISPATCH
+  if (!this->dispatching)
+    this->startDispatch(); // Tasks can not be created before UserMain
+#endif
+  UBIDOTS_CLIENT_LOCK();
+
   if (!this->connected)
   {                       // If no connected before
     int stateSocket = -1; // TCP socket state
@@ -176,14 +705,14 @@ bool Ubidots::connect()
       do
       {
         // Get socket connecting status
-        stateSocket = (this->ssl) ? this->mqttSSLSocket.connect((char *)UBIDOTS_MQTT_HOST, UBIDOTS_SSL_PORT)
-                                  : this->mqttSocket.connect((char *)UBIDOTS_MQTT_HOST, UBIDOTS_MQTT_PORT);
+        stateSocket = (this->ssl) ? this->mqttSSLSocket.connect((char *)this->host, this->port ? this->port : UBIDOTS_SSL_PORT)
+                                  : this->mqttSocket.connect((char *)this->host, this->port ? this->port : UBIDOTS_MQTT_PORT);
 
         this->retries++; // Add a retry
 
         if (stateSocket != 0)
         {                                                                                       // if error
-          this->consoleLog("%s\r\n", "Error connecting socket, retrying within 5 seconds\r\n"); // print message
+          UBIDOTS_LOGW(this->log, "%s\r\n", "Error connecting socket, retrying within 5 seconds\r\n"); // print message
           if (this->log)
           {
             printSocketErrors(stateSocket); // Print socket error
@@ -198,14 +727,11 @@ bool Ubidots::connect()
       if (stateSocket != 0)
       {                               // if socket error
         state = UBIDOTS_SOCKET_ERROR; // set state to socket error
-        if (this->cbPtrArr[UBIDOTS_EVENT_ERROR])
-        {
-          this->cbPtrArr[UBIDOTS_EVENT_ERROR]((void *)state); // Event error callback
-        }
+        this->notify(UBIDOTS_EVENT_ERROR, (void *)state); // Event error callback
         return false; // return false
       }
 
-      this->consoleLog("Ubidots socket %s connected successfully\r\n", (this->ssl) ? "SSL" : "TCP");
+      UBIDOTS_LOGI(this->log, "Ubidots socket %s connected successfully\r\n", (this->ssl) ? "SSL" : "TCP");
 
       // --- MQTT socket connection logic --- //
       bool mqttLoop = true;
@@ -219,7 +745,7 @@ bool Ubidots::connect()
 
         if (stateMQTT != 0)
         {                                                                                      // Broker connection error
-          this->consoleLog("%s\r\n", "Error connecting to broker, retrying within 5 seconds"); // print message
+          UBIDOTS_LOGW(this->log, "%s\r\n", "Error connecting to broker, retrying within 5 seconds"); // print message
           if (stateMQTT == 5)
           {                                 // If 5 (no authorized)
             state = UBIDOTS_NOT_AUTHORIZED; // Set state to no authorized
@@ -249,41 +775,32 @@ bool Ubidots::connect()
         int stateDisconnect = (this->ssl) ? this->mqttSSLSocket.disconnect()
                                           : this->mqttSocket.disconnect();
 
-        if (this->cbPtrArr[UBIDOTS_EVENT_ERROR])
-        {
-          this->cbPtrArr[UBIDOTS_EVENT_ERROR]((void *)state); // Event error callback
-        }
+        this->notify(UBIDOTS_EVENT_ERROR, (void *)state); // Event error callback
         OSTimeDly(TICKS_PER_SECOND * 5); // Block task for 5 seconds
 
         return false; // return false
       }
 
-      this->connected = true; // Set connected to true
-      this->consoleLog("Ubidots MQTT socket connected successfully\r\n");
+      this->setConnected(true); // Set connected to true
+#if UBIDOTS_WILDCARD_MAX_VARIABLES > 0
+      this->wildSubscribed = false; // Clean session, subscribed again by the next subscribe
+#endif
+      UBIDOTS_LOGI(this->log, "Ubidots MQTT socket connected successfully\r\n");
 
-      if (this->cbPtrArr[UBIDOTS_EVENT_CONNECTED])
-      {
-        this->cbPtrArr[UBIDOTS_EVENT_CONNECTED](nullptr); // Connected callback
-      }
+      this->notify(UBIDOTS_EVENT_CONNECTED, (void *)nullptr); // Connected callback
 
       return true; // return true
     }
     else
     {                                      // No socket available
       state = UBIDOTS_SOCKET_NO_AVAILABLE; // Set state to socket_no_available
-      if (this->cbPtrArr[UBIDOTS_EVENT_ERROR])
-      {
-        this->cbPtrArr[UBIDOTS_EVENT_ERROR]((void *)state); // Error event
-      }
+      this->notify(UBIDOTS_EVENT_ERROR, (void *)state); // Error event
     }
   }
   else
   {
     state = UBIDOTS_ALREADY_CONNECTED; // Set state to socket_no_available
-    if (this->cbPtrArr[UBIDOTS_EVENT_ERROR])
-    {
-      this->cbPtrArr[UBIDOTS_EVENT_ERROR]((void *)state); // Error event
-    }
+    this->notify(UBIDOTS_EVENT_ERROR, (void *)state); // Error event
   }
 
   return false;
@@ -291,40 +808,56 @@ bool Ubidots::connect()
 
 bool Ubidots::subscribe(const char *variable, subscribe_handler_t handler)
 {
-  if (variable == nullptr && handler == nullptr)
+  if (variable == nullptr)
     return false; // No data
-  if (this->subTopicsUsed >= UBIDOTS_SUBSCRIBE_MAX_TOPICS)
-    return false; // No topics available
 
-  // Create subscribe topic using the base topic
-  strcpy(this->subTopics[this->subTopicsUsed], this->baseTopic);
-  strcat(this->subTopics[this->subTopicsUsed], "/");
-  strcat(this->subTopics[this->subTopicsUsed], variable);
-  strcat(this->subTopics[this->subTopicsUsed], "/lv");
+  ubidots_value_sub_t sub;
+  sub.type = ubidots_value_sub_t::UBIDOTS_VALUE_RAW;
+  sub.handler.raw = handler;
+  sub.ctx = nullptr;
+  return this->subscribeVariable(variable, sub);
+}
 
-  int subState = -1; // Subscription state
+bool Ubidots::subscribe(const char *variable, value_float_handler_t handler, void *ctx)
+{
+  if (variable == nullptr || handler == nullptr)
+    return false; // No data
 
-  if (this->client.isConnected() || this->clientSSL.isConnected())
-  { // If mqtt connected
-    subState = (this->ssl) ? this->clientSSL.subscribe(this->subTopics[this->subTopicsUsed], MQTT::QOS0, handler)
-                           : this->client.subscribe(this->subTopics[this->subTopicsUsed], MQTT::QOS0, handler);
-  }
+  ubidots_value_sub_t sub;
+  sub.type = ubidots_value_sub_t::UBIDOTS_VALUE_FLOAT;
+  sub.handler.toFloat = handler;
+  sub.ctx = ctx;
+  return this->subscribeVariable(variable, sub);
+}
 
-  if (subState != 0)
-    return false; // Subscribe error
+bool Ubidots::subscribe(const char *variable, value_int_handler_t handler, void *ctx)
+{
+  if (variable == nullptr || handler == nullptr)
+    return false; // No data
 
-  this->subTopicsUsed++; // Adds one topic used
+  ubidots_value_sub_t sub;
+  sub.type = ubidots_value_sub_t::UBIDOTS_VALUE_INT;
+  sub.handler.toInt = handler;
+  sub.ctx = ctx;
+  return this->subscribeVariable(variable, sub);
+}
 
-  if (this->cbPtrArr[UBIDOTS_EVENT_SUBSCRIBED])
-  {
-    this->cbPtrArr[UBIDOTS_EVENT_SUBSCRIBED]((void *)nullptr); // Event subscribed callback
-  }
+bool Ubidots::subscribe(const char *variable, value_bool_handler_t handler, void *ctx)
+{
+  if (variable == nullptr || handler == nullptr)
+    return false; // No data
 
-  return true;
+  ubidots_value_sub_t sub;
+  sub.type = ubidots_value_sub_t::UBIDOTS_VALUE_BOOL;
+  sub.handler.toBool = handler;
+  sub.ctx = ctx;
+  return this->subscribeVariable(variable, sub);
 }
 
 bool Ubidots::keepAlive()
 {
+  UBIDOTS_CLIENT_LOCK();
+
   if (this->ssl)
   {
     if (this->clientSSL.isConnected())
@@ -349,11 +882,8 @@ bool Ubidots::keepAlive()
 
     if (yieldState < 0)
     {                          // If error
-      this->connected = false; // It means that socket is disconected
-      if (this->cbPtrArr[UBIDOTS_EVENT_DISCONNECTED])
-      {
-        this->cbPtrArr[UBIDOTS_EVENT_DISCONNECTED]((void *)nullptr); // Event disconected callback
-      }
+      this->setConnected(false); // It means that socket is disconected
+      this->notify(UBIDOTS_EVENT_DISCONNECTED, (void *)nullptr); // Event disconected callback
 
       if (this->ssl)
       {
@@ -368,11 +898,13 @@ bool Ubidots::keepAlive()
 
       return false;
     }
+
+    this->backfillStep(); // One backfill payload at most, between the live publishes
     return true;
   }
   else
   {
-    this->connected = false; // Not connected
+    this->setConnected(false); // Not connected
     return false;
   }
 
@@ -386,40 +918,195 @@ bool Ubidots::publish(const char *variable, float value)
   if (!this->connected)
     return false; // No mqtt connection active
 
-  MQTT::Message message;              // message to send
-  int pState = -1;                    // Publish state
-  char buf[UBIDOTS_MSG_MAX_LEN] = {}; // Buffer for message
+  uint8_t buf[UBIDOTS_MSG_MAX_LEN];                                           // Buffer for message
+  int len = this->encoder->encode(buf, UBIDOTS_MSG_MAX_LEN, variable, value); // Format the data
+
+  if (len < 0)
+  {                                                // If the variable name is too long for the message
+    ubidots_state_t state = UBIDOTS_PUBLISH_ERROR; // Ubidots state
+    NBMQTTStats::count(this->counters.publishErrors);
+    UBIDOTS_LOGE(this->log, "Publish Error, %s payload too long\r\n", this->encoder->name);
+    this->notify(UBIDOTS_EVENT_ERROR, (void *)state); // Event error callback
+    return false;
+  }
+
+  return this->publishPayload(buf, len);
+}
+
+bool Ubidots::publishPayload(const void *payload, size_t payloadLen)
+{
+  return this->publishTo(this->baseTopic, payload, payloadLen);
+}
+
+bool Ubidots::publishStream(size_t payloadLen, publish_producer_t producer, void *context)
+{
+  UBIDOTS_CLIENT_LOCK();
 
-  siprintf(buf, TMPT_SIMPLE_PUBLISH_VAR, variable, value); // Format the data
+  if (producer == nullptr)
+    return false; // No payload
+  if (!this->connected)
+    return false; // No mqtt connection active
 
-  message.qos = MQTT::QOS0;         // Quality of service
-  message.retained = false;         // Message retained on broker false
-  message.dup = false;              // No duplicate message
-  message.payload = (void *)buf;    // Data buffer
-  message.payloadlen = strlen(buf); // Data buffer len
+  if (!this->passRateLimit(payloadLen))
+    return false; // Over the publish rate
 
-  pState = (this->ssl) ? this->clientSSL.publish(this->baseTopic, message) : this->client.publish(this->baseTopic, message);
+  int pState = (this->ssl) ? this->clientSSL.publish(this->baseTopic, payloadLen, producer, context, this->qos)
+                           : this->client.publish(this->baseTopic, payloadLen, producer, context, this->qos);
 
   if (pState < 0)
   {                                                // If publish error
     ubidots_state_t state = UBIDOTS_PUBLISH_ERROR; // Ubidots state
-    this->consoleLog("Publish Error [%d] \r\n", pState);
-    if (this->cbPtrArr[UBIDOTS_EVENT_ERROR])
-    {
-      this->cbPtrArr[UBIDOTS_EVENT_ERROR]((void *)state); // Event error callback
-    }
+    NBMQTTStats::count(this->counters.publishErrors);
+    UBIDOTS_LOGE(this->log, "Publish Error [%d] \r\n", pState);
+    this->notify(UBIDOTS_EVENT_ERROR, (void *)state); // Event error callback
     return false;
   }
 
-  if (this->cbPtrArr[UBIDOTS_EVENT_PUBLISHED])
-  {
-    this->cbPtrArr[UBIDOTS_EVENT_PUBLISHED]((void *)nullptr); // Event published callback
+  NBMQTTStats::count(this->counters.publishes);
+  this->notify(UBIDOTS_EVENT_PUBLISHED, (void *)nullptr); // Event published callback
+
+  UBIDOTS_LOGD(this->log, "Message of %d bytes streamed to %s\r\n", (int)payloadLen, this->baseTopic);
+
+  return true;
+}
+
+#if UBIDOTS_GATEWAY
+int Ubidots::addDevice(const char *device)
+{
+  if (device == nullptr)
+    return -1; // No data
+
+  int index = ubidotsDevicesAdd(&this->devices, device);
+  if (index < 0)
+    UBIDOTS_LOGE(this->log, "No room for gateway device %s\r\n", device);
+  return index;
+}
+
+int Ubidots::addValue(int device, const char *variable, float value)
+{
+  UBIDOTS_CLIENT_LOCK();
+
+  int queuedState = 1; // Queued
+
+  if (variable == nullptr || device < 0 || device >= this->devices.count)
+    return -1; // Unknown device
+  if (this->batchUsed >= UBIDOTS_GATEWAY_BATCH_MAX && !this->flush())
+    queuedState = 0; // Flush failed
+  if (this->batchUsed >= UBIDOTS_GATEWAY_BATCH_MAX)
+    return -2; // Still full, the rate limiter holds the values back
+
+  ubidots_gateway_value_t &queued = this->batch[this->batchUsed++];
+  queued.variable = variable;
+  queued.value = value;
+  queued.device = (uint16_t)device;
+  return queuedState;
+}
+
+int Ubidots::flushPayload(uint16_t device, const uint8_t *payload, int len, uint8_t from, uint8_t to)
+{
+  uint32_t waitMs = ubidotsRateWait(&this->rateLimit, len, nowMs());
+  if (waitMs > 0)
+  { // Its values stay queued for the next flush
+    this->rateLimit.limited++;
+    this->rateRefused(waitMs);
+    return -1;
+  }
+
+  bool published = this->publishTo(ubidotsDevicesTopic(&this->devices, device), payload, len);
+  for (uint8_t k = from; k < to; k++)
+  { // Sent or failed, out of the queue either way
+    if (this->batch[k].device == device)
+      this->batch[k].device = UBIDOTS_GATEWAY_SENT;
+  }
+  return (published) ? 1 : 0;
+}
+
+bool Ubidots::flush()
+{
+  UBIDOTS_CLIENT_LOCK();
+
+  uint8_t buf[UBIDOTS_MSG_MAX_LEN]; // Buffer for message
+  bool ok = true;
+  bool held = false; // The rate limiter holds the rest back
+
+  for (uint8_t i = 0; i < this->batchUsed && !held; i++)
+  { // The first value not sent picks the next device
+    uint16_t device = this->batch[i].device;
+    if (device == UBIDOTS_GATEWAY_SENT)
+      continue;
+
+    uint8_t from = i; // First value of the payload
+    uint8_t j = i;
+    int len = 0;
+    int sent = 1;
+
+    for (; j < this->batchUsed; j++)
+    { // Every value of the device, in order
+      ubidots_gateway_value_t &queued = this->batch[j];
+      if (queued.device != device)
+        continue;
+
+      int newLen = this->encoder->append(buf, UBIDOTS_MSG_MAX_LEN, len, queued.variable, queued.value);
+      if (newLen < 0 && len > 0)
+      { // Payload full, send it and start another
+        if ((sent = this->flushPayload(device, buf, len, from, j)) < 0)
+          break;
+        ok = sent && ok;
+        from = j;
+        newLen = this->encoder->append(buf, UBIDOTS_MSG_MAX_LEN, 0, queued.variable, queued.value);
+      }
+      if (newLen < 0)
+      { // Can not fit in any payload
+        UBIDOTS_LOGE(this->log, "Publish Error, %s payload too long\r\n", this->encoder->name);
+        queued.device = UBIDOTS_GATEWAY_SENT;
+        ok = false;
+        len = 0;
+        continue;
+      }
+      len = newLen;
+    }
+
+    if (sent >= 0 && len > 0)
+      sent = this->flushPayload(device, buf, len, from, j);
+    held = (sent < 0);
+    ok = (sent > 0) && ok;
+  }
+
+  uint8_t kept = 0;
+  for (uint8_t i = 0; i < this->batchUsed; i++)
+  { // Keep the values held back, in order
+    if (this->batch[i].device != UBIDOTS_GATEWAY_SENT)
+      this->batch[kept++] = this->batch[i];
+  }
+  this->batchUsed = kept;
+  return ok;
+}
+
+bool Ubidots::subscribeDevices(gateway_handler_t handler, void *ctx)
+{
+  UBIDOTS_CLIENT_LOCK();
+
+  if (handler == nullptr)
+    return false; // No data
+
+  int subState = -1; // Subscription state
+
+  this->gatewayHandler = handler;
+  this->gatewayCtx = ctx;
+  if (this->client.isConnected() || this->clientSSL.isConnected())
+  { // If mqtt connected
+    subState = (this->ssl) ? this->clientSSL.subscribe(UBIDOTS_BROKER_PATH "+/+/lv", MQTT::QOS0, this, &Ubidots::onGatewayMessage)
+                           : this->client.subscribe(UBIDOTS_BROKER_PATH "+/+/lv", MQTT::QOS0, this, &Ubidots::onGatewayMessage);
   }
 
-  this->consoleLog("Message published %s to %s\r\n", buf, this->baseTopic);
+  if (subState != 0)
+    return false; // Subscribe error
+
+  this->notify(UBIDOTS_EVENT_SUBSCRIBED, (void *)nullptr); // Event subscribed callback
 
   return true;
 }
+#endif
 
 void Ubidots::registerCallback(ubidots_events_t event, void (*func_ptr)(void *))
 {
@@ -429,6 +1116,163 @@ void Ubidots::registerCallback(ubidots_events_t event, void (*func_ptr)(void *))
   }
 }
 
+void Ubidots::setBroker(const char *host, uint16_t port)
+{
+  this->host = (host) ? host : UBIDOTS_MQTT_HOST;
+  this->port = port;
+}
+
+void Ubidots::setClientId(const char *clientId)
+{
+  if (clientId == nullptr)
+    clientId = (this->device) ? this->device : UBIDOTS_DEFAULT_CLIENT_ID;
+  this->mqttOptions.clientID.cstring = (char *)clientId;
+}
+
+void Ubidots::setPublishQoS(MQTT::QoS qos)
+{
+  this->qos = qos;
+}
+
+#if UBIDOTS_DISPATCH
+void Ubidots::setDispatchPriority(uint8_t prio)
+{
+  this->dispatchPrio = prio;
+}
+
+const ubidots_dispatch_stats_t &Ubidots::getDispatchStats() const
+{
+  return this->dispatchStats;
+}
+#endif
+
+void Ubidots::setRateLimit(float messagesPerSecond, uint32_t bytesPerSecond, uint32_t messageBurst, uint32_t byteBurst)
+{
+  ubidotsRateSet(&this->rateLimit.messages, messagesPerSecond, messageBurst);
+  ubidotsRateSet(&this->rateLimit.bytes, (float)bytesPerSecond, (byteBurst) ? byteBurst : bytesPerSecond);
+}
+
+void Ubidots::setBackfill(backfill_peek_t peek, backfill_sent_t sent, void *ctx)
+{
+  this->backfillPeek = (sent) ? peek : nullptr;
+  this->backfillSent = sent;
+  this->backfillCtx = ctx;
+}
+
+uint32_t Ubidots::publishWaitMs(size_t payloadLen)
+{
+  return ubidotsRateWait(&this->rateLimit, payloadLen, nowMs());
+}
+
+const ubidots_rate_limit_t &Ubidots::getRateLimit() const
+{
+  return this->rateLimit;
+}
+
+void Ubidots::setEncoder(const ubidots_encoder_t *encoder)
+{
+  this->encoder = (encoder) ? encoder : &ubidotsJsonEncoder;
+}
+
+#if UBIDOTS_WILDCARD_MAX_VARIABLES > 0
+void Ubidots::setWildcardSubscription(bool enable)
+{
+  this->wildcard = enable;
+  if (enable)
+  { // Create wildcard topic using the base topic
+    strcpy(this->wildTopic, this->baseTopic);
+    strcat(this->wildTopic, "/+/lv");
+    this->wildVarOffset = strlen(this->baseTopic) + 1;
+  }
+}
+#endif
+
+#if UBIDOTS_COMPRESSION
+void Ubidots::setCompression(bool enable)
+{
+  if (enable)
+    NBMQTTCycleCounter::init(); // Times the compression
+  this->compress = enable;
+}
+
+const ubidots_compress_stats_t &Ubidots::getCompressionStats() const
+{
+  return this->compressStats;
+}
+#endif
+
+#if MQTTCLIENT_BATCH
+void Ubidots::setBatchHandler(batch_handler_t handler)
+{
+  this->client.setBatchMessageHandler(handler);
+  this->clientSSL.setBatchMessageHandler(handler);
+}
+#endif
+
+void Ubidots::getStats(ubidots_stats_t &stats) const
+{
+  stats.nowMs = nowMs();
+  stats.connected = this->connected;
+  stats.rateLimited = __atomic_load_n(&this->rateLimit.limited, __ATOMIC_RELAXED);
+#if UBIDOTS_DISPATCH
+  stats.dispatchDepth = this->dispatchCount;
+#else
+  stats.dispatchDepth = 0;
+#endif
+#if UBIDOTS_GATEWAY
+  stats.gatewayQueued = this->batchUsed;
+#else
+  stats.gatewayQueued = 0;
+#endif
+
+  stats.ubidots.publishes = __atomic_load_n(&this->counters.publishes, __ATOMIC_RELAXED);
+  stats.ubidots.publishErrors = __atomic_load_n(&this->counters.publishErrors, __ATOMIC_RELAXED);
+  stats.ubidots.connects = __atomic_load_n(&this->counters.connects, __ATOMIC_RELAXED);
+  stats.ubidots.reconnects = __atomic_load_n(&this->counters.reconnects, __ATOMIC_RELAXED);
+  stats.ubidots.disconnects = __atomic_load_n(&this->counters.disconnects, __ATOMIC_ACQUIRE);
+  stats.ubidots.connectedMs = __atomic_load_n(&this->counters.connectedMs, __ATOMIC_RELAXED);
+  if (stats.connected)
+    stats.ubidots.connectedMs += stats.nowMs - this->connectedAt; // Current connection
+
+  // Oldest first, a connection lost during the copy may overwrite the oldest entry
+  uint32_t lost = stats.ubidots.disconnects;
+  stats.historyCount = (lost < UBIDOTS_LINK_HISTORY) ? lost : UBIDOTS_LINK_HISTORY;
+  for (uint8_t i = 0; i < stats.historyCount; i++)
+  {
+    stats.history[i] = this->linkHistory[(lost - stats.historyCount + i) % UBIDOTS_LINK_HISTORY];
+  }
+
+#if MQTTCLIENT_STATS
+  if (this->ssl)
+    this->clientSSL.getStats(stats.client);
+  else
+    this->client.getStats(stats.client);
+#endif
+#if MQTTCLIENT_PROFILE
+  if (this->ssl)
+    this->clientSSL.getProfile(stats.profile);
+  else
+    this->client.getProfile(stats.profile);
+#endif
+}
+
+#if MQTTCLIENT_CAPTURE
+void Ubidots::setCapture(NBMQTTCapture *capture)
+{
+  this->client.setCapture(capture);
+  this->clientSSL.setCapture(capture);
+}
+#endif
+
+#if MQTTCLIENT_TRACE
+bool Ubidots::readTrace(uint32_t &cursor, char *line, int lineLen) const
+{
+  if (this->ssl)
+    return this->clientSSL.readTrace(cursor, line, lineLen);
+  return this->client.readTrace(cursor, line, lineLen);
+}
+#endif
+
 bool Ubidots::isConnected() const
 {
   return this->connected;
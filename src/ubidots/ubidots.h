@@ -19,6 +19,16 @@
 #include <NBMQTTSocket.h>
 #include <NBMQTTTLSSocket.h>
 #include <NBMQTTCountdown.h>
+#include <NBMQTTStats.h>
+
+#include <ubidotsencoder.h>
+#include <ubidotscompress.h>
+#include <ubidotsvalue.h>
+#include <ubidotsvariables.h>
+#include <ubidotsdevices.h>
+#include <ubidotsratelimit.h>
+#include <ubidotsbackfill.h>
+#include <ubidotslog.h>
 
 /*---------------------  Definitions ---------------------*/
 #define UBIDOTS_MQTT_HOST "industrial.api.ubidots.com" /*!< Ubidots MQTT host */
@@ -32,6 +42,25 @@
 #define UBIDOTS_DEFAULT_CLIENT_ID "NETBURNER"          /*!< Default name for MQTT client ID */
 #define UBIDOTS_CONNECT_RETRIES 3                      /*!< Retries to connect */
 #define UBIDOTS_SUBSCRIBE_MAX_TOPICS 20                /*!< Max subscribe topics */
+#ifndef UBIDOTS_COMPRESSION
+#define UBIDOTS_COMPRESSION 0                          /*!< 1 to build payload compression, about 4 KB per object */
+#endif
+#define UBIDOTS_COMPRESS_MIN_LEN 64                    /*!< Shorter payloads are always sent as they are */
+#define UBIDOTS_BACKFILL_YIELD_MS 1000                 /*!< Backfill pause after a refused live publish is due again */
+#ifndef UBIDOTS_GATEWAY
+#define UBIDOTS_GATEWAY 0                              /*!< 1 to build the gateway mode, about 3.5 KB per object */
+#endif
+#define UBIDOTS_GATEWAY_BATCH_MAX 32                   /*!< Gateway values queued before a flush */
+#ifndef UBIDOTS_DISPATCH
+#define UBIDOTS_DISPATCH 0                             /*!< 1 to run the callbacks on a dispatch task, about 11 KB per object */
+#endif
+#define UBIDOTS_DISPATCH_DEPTH 8                       /*!< Callbacks waiting for the dispatch task, more are dropped */
+#define UBIDOTS_DISPATCH_DATA_LEN 256                  /*!< Topic and payload bytes of a dispatched message, longer ones are dropped */
+#define UBIDOTS_DISPATCH_PRIO (MAIN_PRIO + 1)          /*!< Dispatch task priority, below the MQTT loop */
+#define UBIDOTS_LINK_HISTORY 8                         /*!< Lost connections kept for getStats() */
+#ifndef UBIDOTS_MQTT_VERSION
+#define UBIDOTS_MQTT_VERSION 3                         /*!< MQTT protocol version, 3 (3.1), 4 (3.1.1) or 5 (topic aliases) */
+#endif
 
 /**
  * @brief Ubidots events
@@ -61,7 +90,8 @@ typedef enum
   UBIDOTS_MQTT_SOCKET_ERROR,   /*!< MQTT socket error */
   UBIDOTS_SUBSCRIBE_ERROR,     /*!< Error during MQTT subscribe */
   UBIDOTS_PUBLISH_ERROR,       /*!< Error during MQTT publish */
-  UBIDOTS_NOT_AUTHORIZED       /*!< Error during MQTT authenticate */
+  UBIDOTS_NOT_AUTHORIZED,      /*!< Error during MQTT authenticate */
+  UBIDOTS_RATE_LIMITED         /*!< Publish refused by the rate limiter */
 } ubidots_state_t;
 
 /**
@@ -70,6 +100,194 @@ typedef enum
  */
 typedef void (*subscribe_handler_t)(MQTT::MessageData &md);
 
+/**
+ * @brief Handlers of typed value subscriptions. The value is parsed once by the
+ * library; the timestamp is in milliseconds since the epoch, 0 when absent.
+ *
+ */
+typedef void (*value_float_handler_t)(void *ctx, float value, int64_t timestamp);
+typedef void (*value_int_handler_t)(void *ctx, int32_t value, int64_t timestamp);
+typedef void (*value_bool_handler_t)(void *ctx, bool value, int64_t timestamp);
+
+/**
+ * @brief Typed handler of a subscription.
+ *
+ */
+typedef struct
+{
+  enum
+  {
+    UBIDOTS_VALUE_RAW,   /*!< subscribe_handler_t */
+    UBIDOTS_VALUE_FLOAT, /*!< value_float_handler_t */
+    UBIDOTS_VALUE_INT,   /*!< value_int_handler_t */
+    UBIDOTS_VALUE_BOOL   /*!< value_bool_handler_t */
+  } type;
+  union
+  {
+    subscribe_handler_t raw; /*!< Kept here only by the wildcard subscription, otherwise set on the client */
+    value_float_handler_t toFloat;
+    value_int_handler_t toInt;
+    value_bool_handler_t toBool;
+  } handler;
+  void *ctx; /*!< User context given to the handler */
+} ubidots_value_sub_t;
+
+/**
+ * @brief Producer of a streamed publish payload.
+ *
+ * Fills up to buflen bytes of buf with the payload from offset and returns how
+ * many, or <= 0 to abort the publish.
+ */
+typedef int (*publish_producer_t)(void *context, unsigned char *buf, int buflen, size_t offset);
+
+/**
+ * @brief Source of the backfill samples, oldest first.
+ *
+ * Gives the sample at index, counted from the oldest sample not yet sent, and
+ * returns false when there is none. Called again for the same samples until
+ * they are sent, so it must not drop them.
+ */
+typedef bool (*backfill_peek_t)(void *ctx, uint32_t index, ubidots_sample_t *sample);
+
+/**
+ * @brief Tells the backfill source the count oldest samples were sent and can be dropped.
+ *
+ */
+typedef void (*backfill_sent_t)(void *ctx, uint32_t count);
+
+#if UBIDOTS_COMPRESSION
+/**
+ * @brief Payload compression statistics.
+ *
+ */
+typedef struct
+{
+  uint32_t messages;     /*!< Payloads run through the compressor */
+  uint32_t bytesIn;      /*!< Their total uncompressed size */
+  uint32_t bytesOut;     /*!< Their total size as sent, compressed or not */
+  uint32_t totalUs;      /*!< CPU time spent compressing */
+  uint16_t lastBytesIn;  /*!< Uncompressed size of the last payload */
+  uint16_t lastBytesOut; /*!< Size as sent of the last payload */
+  uint32_t lastUs;       /*!< CPU time spent compressing the last payload */
+} ubidots_compress_stats_t;
+#endif
+
+/**
+ * @brief Counters of the Ubidots connection.
+ *
+ */
+typedef struct
+{
+  uint32_t publishes;     /*!< Payloads published */
+  uint32_t publishErrors; /*!< Payloads not encoded or not sent, rate limited ones apart */
+  uint32_t connects;      /*!< MQTT connections made */
+  uint32_t reconnects;    /*!< Connections made after losing one */
+  uint32_t disconnects;   /*!< Connections lost */
+  uint32_t connectedMs;   /*!< Time connected, the current connection included */
+} ubidots_counters_t;
+
+/**
+ * @brief Connection lost.
+ *
+ */
+typedef struct
+{
+  uint32_t atMs; /*!< Time lost */
+  uint32_t upMs; /*!< Time it had been connected */
+} ubidots_link_event_t;
+
+/**
+ * @brief Snapshot of the statistics, see getStats().
+ *
+ */
+typedef struct
+{
+  uint32_t nowMs;                                      /*!< Time of the snapshot, same clock as the history */
+  bool connected;                                      /*!< MQTT connected */
+  uint8_t dispatchDepth;                               /*!< Callbacks waiting for the dispatch task */
+  uint8_t gatewayQueued;                               /*!< Gateway values waiting for flush */
+  uint32_t rateLimited;                                /*!< Publishes refused by the rate limit */
+  ubidots_counters_t ubidots;                          /*!< Counters of the connection */
+  uint8_t historyCount;                                /*!< Entries in history */
+  ubidots_link_event_t history[UBIDOTS_LINK_HISTORY];  /*!< Last connections lost, oldest first */
+#if MQTTCLIENT_STATS
+  NBMQTTStats client;         /*!< Packets and bytes by type, send and ack time histograms of the MQTT client */
+#endif
+#if MQTTCLIENT_PROFILE
+  NBMQTTProfile profile;      /*!< Per stage time histograms of the MQTT client, in ns */
+#endif
+} ubidots_stats_t;
+
+#if UBIDOTS_GATEWAY
+/**
+ * @brief Handler of the values received for the gateway devices.
+ *
+ * @param ctx User context given to subscribeDevices
+ * @param device Index of the device, as returned by addDevice
+ * @param variable Variable label, points into the topic, not NUL terminated
+ * @param variableLen Variable label length
+ * @param value Parsed value
+ */
+typedef void (*gateway_handler_t)(void *ctx, int device, const char *variable, size_t variableLen, const ubidots_value_t &value);
+
+/**
+ * @brief Value queued by the gateway mode.
+ *
+ */
+typedef struct
+{
+  const char *variable; /*!< Variable label, valid until flushed */
+  float value;          /*!< Value of variable */
+  uint16_t device;      /*!< Index of the device */
+} ubidots_gateway_value_t;
+#endif
+
+#if UBIDOTS_DISPATCH
+/**
+ * @brief Dispatch task statistics.
+ *
+ */
+typedef struct
+{
+  uint32_t queued;  /*!< Callbacks queued */
+  uint32_t dropped; /*!< Callbacks dropped, queue full or message too long */
+  uint8_t maxDepth; /*!< Most callbacks waiting at once */
+  uint32_t lastUs;  /*!< Queue latency of the last callback */
+  uint32_t maxUs;   /*!< Longest queue latency */
+  uint32_t totalUs; /*!< Queue latency of every callback */
+} ubidots_dispatch_stats_t;
+
+/**
+ * @brief Callback waiting for the dispatch task.
+ *
+ */
+typedef struct
+{
+  enum
+  {
+    UBIDOTS_DISPATCH_EVENT,  /*!< cbPtrArr[event](arg) */
+    UBIDOTS_DISPATCH_VALUE,  /*!< Subscription handler sub */
+    UBIDOTS_DISPATCH_GATEWAY /*!< Gateway handler */
+  };
+  uint8_t kind;                         /*!< What to call */
+  ubidots_events_t event;               /*!< Event */
+  void *arg;                            /*!< Event argument */
+  ubidots_value_sub_t sub;              /*!< Subscription handler */
+  MQTT::Message message;                /*!< Message, payload in data */
+  uint16_t topicLen;                    /*!< Topic length, at the start of data */
+  uint32_t queuedAt;                    /*!< Cycle counter when queued */
+  char data[UBIDOTS_DISPATCH_DATA_LEN]; /*!< Topic then payload */
+} ubidots_dispatch_t;
+#endif
+
+#if MQTTCLIENT_BATCH
+/**
+ * @brief Handler to receive every buffered message at once.
+ *
+ */
+typedef void (*batch_handler_t)(MQTT::MessageView *messages, int count);
+#endif
+
 /*------------------------------------------------*/
 
 /*---------------------  Classes ---------------------*/
@@ -83,9 +301,58 @@ private:
   uint8_t retries;                                                               /*!< Number of connection retries */
   const char *token;                                                             /*!< Platform token */
   const char *device;                                                            /*!< Device name */
+  const char *host;                                                              /*!< MQTT broker host */
+  uint16_t port;                                                                 /*!< MQTT broker port, 0 for the default */
+  MQTT::QoS qos;                                                                 /*!< QoS used by publish */
+  const ubidots_encoder_t *encoder;                                              /*!< Payload encoder used by publish */
+  ubidots_rate_limit_t rateLimit;                                                /*!< Publish rate limiter */
+  ubidots_counters_t counters;                                                   /*!< Connection counters, connectedMs of the closed connections */
+  uint32_t connectedAt;                                                          /*!< Time of the current connection */
+  ubidots_link_event_t linkHistory[UBIDOTS_LINK_HISTORY];                        /*!< Connections lost, entry disconnects % UBIDOTS_LINK_HISTORY is the next */
+  backfill_peek_t backfillPeek;                                                  /*!< Source of the backfill samples */
+  backfill_sent_t backfillSent;                                                  /*!< Drops the backfill samples sent */
+  void *backfillCtx;                                                             /*!< Passed to the backfill callbacks */
+  bool backfillHold;                                                             /*!< A live publish was refused, backfill waits */
+  uint32_t backfillHoldMs;                                                       /*!< Time the backfill waits for */
+#if UBIDOTS_COMPRESSION
+  bool compress;                                                                 /*!< Compress payloads */
+  ubidots_lz_t lz;                                                               /*!< Compressor state */
+  uint8_t compressBuf[UBIDOTS_MSG_MAX_LEN];                                      /*!< Compressed payload */
+  uint8_t decompressBuf[UBIDOTS_MSG_MAX_LEN];                                    /*!< Decompressed inbound payload */
+  ubidots_compress_stats_t compressStats;                                        /*!< Compression statistics */
+#endif
   char baseTopic[UBIDOTS_TOPIC_MAX_LEN];                                         /*!< MQTT base topic */
   uint8_t subTopicsUsed;                                                         /*!< Number of subscriptions */
   char subTopics[UBIDOTS_SUBSCRIBE_MAX_TOPICS][UBIDOTS_TOPIC_MAX_LEN];           /*!< MQTT base topic */
+  ubidots_value_sub_t subValues[UBIDOTS_SUBSCRIBE_MAX_TOPICS];                   /*!< Typed handler of each subscription */
+#if UBIDOTS_WILDCARD_MAX_VARIABLES > 0
+  bool wildcard;                                                                 /*!< Subscribe every variable through one wildcard topic */
+  bool wildSubscribed;                                                           /*!< Wildcard topic subscribed on this connection */
+  uint8_t wildVarOffset;                                                         /*!< Offset of the variable in the topics received */
+  char wildTopic[UBIDOTS_TOPIC_MAX_LEN];                                         /*!< MQTT wildcard topic */
+  ubidots_variables_t wildVars;                                                  /*!< Variables of the wildcard subscription */
+  ubidots_value_sub_t wildSubs[UBIDOTS_WILDCARD_MAX_VARIABLES];                  /*!< Handler of each variable, by wildVars index */
+#endif
+#if UBIDOTS_GATEWAY
+  ubidots_devices_t devices;                                                     /*!< Gateway devices */
+  ubidots_gateway_value_t batch[UBIDOTS_GATEWAY_BATCH_MAX];                      /*!< Gateway values waiting for flush */
+  uint8_t batchUsed;                                                             /*!< Gateway values queued */
+  gateway_handler_t gatewayHandler;                                              /*!< Handler of the gateway devices values */
+  void *gatewayCtx;                                                              /*!< Passed to gatewayHandler */
+#endif
+#if UBIDOTS_DISPATCH
+  OS_CRIT clientLock;                                                            /*!< Client shared by the MQTT loop and the dispatch task */
+  OS_CRIT dispatchLock;                                                          /*!< Dispatch queue lock */
+  OS_SEM dispatchSem;                                                            /*!< Callbacks in the dispatch queue */
+  bool dispatching;                                                              /*!< Dispatch task running */
+  uint8_t dispatchPrio;                                                          /*!< Dispatch task priority */
+  uint8_t dispatchHead;                                                          /*!< Next free slot */
+  uint8_t dispatchTail;                                                          /*!< Next callback to run */
+  uint8_t dispatchCount;                                                         /*!< Callbacks waiting */
+  ubidots_dispatch_t dispatchQueue[UBIDOTS_DISPATCH_DEPTH];                      /*!< Dispatch queue */
+  ubidots_dispatch_stats_t dispatchStats;                                        /*!< Dispatch statistics */
+  uint32_t dispatchStack[USER_TASK_STK_SIZE];                                    /*!< Dispatch task stack */
+#endif
   NBMQTTSocket mqttSocket;                                                       /*!< MQTT Socket TCP */
   NBMQTTTLSSocket mqttSSLSocket;                                                 /*!< MQTT Socket SSL */
   MQTT::Client<NBMQTTSocket, NBMQTTCountdown, UBIDOTS_MSG_MAX_LEN> client;       /*!< MQTT TCP object  */
@@ -96,12 +363,179 @@ private:
 
   /*---------------------  Methods ---------------------*/
   /**
-   * @brief Prints to the UART terminal
+   * @brief Subscribe to a variable, on its own topic or through the wildcard one.
+   *
+   * @param variable Variable name to subscribe
+   * @param sub Handler of the variable
+   * @retval true Subscribed succesfully
+   * @retval false Error
+   */
+  bool subscribeVariable(const char *variable, const ubidots_value_sub_t &sub);
+
+  /**
+   * @brief Parse a message of a typed subscription and call its handler.
+   *
+   * @param md Message received
+   */
+  void onValueMessage(MQTT::MessageData &md);
+
+  /**
+   * @brief Set the connected flag, counting the connections made and lost.
+   *
+   * @param connected MQTT connected
+   */
+  void setConnected(bool connected);
+
+  /**
+   * @brief Call the handler of a subscription, or queue it for the dispatch task.
+   *
+   * @param sub Handler of the variable
+   * @param md Message received
+   */
+  void deliverValue(const ubidots_value_sub_t &sub, MQTT::MessageData &md);
+
+  /**
+   * @brief Call the handler of a subscription, parsing the value for the typed ones.
+   *
+   * @param sub Handler of the variable
+   * @param md Message received
+   */
+  void invokeValue(const ubidots_value_sub_t &sub, MQTT::MessageData &md);
+
+  /**
+   * @brief Parse the value of a message, decompressing it first when it was
+   * compressed by ubidotsCompress().
+   *
+   * @param md Message received
+   * @param value Parsed value
+   * @retval true Parsed
+   * @retval false Malformed, or compressed and corrupt or larger than UBIDOTS_MSG_MAX_LEN
+   */
+  bool parseValue(MQTT::MessageData &md, ubidots_value_t *value);
+
+  /**
+   * @brief Call the callback of an event, or queue it for the dispatch task.
+   *
+   * @param event Event
+   * @param arg Passed to the callback
+   */
+  void notify(ubidots_events_t event, void *arg);
+
+#if UBIDOTS_DISPATCH
+  /**
+   * @brief Start the dispatch task. Callbacks run inline if it can not be created.
+   *
+   */
+  void startDispatch();
+
+  /**
+   * @brief Queue a callback for the dispatch task, copying the message. Never
+   * waits: when the queue is full the callback is dropped and counted.
+   *
+   * @param kind ubidots_dispatch_t kind
+   * @param sub Subscription handler, for UBIDOTS_DISPATCH_VALUE
+   * @param md Message, for UBIDOTS_DISPATCH_VALUE and UBIDOTS_DISPATCH_GATEWAY
+   * @param event Event, for UBIDOTS_DISPATCH_EVENT
+   * @param arg Event argument
+   */
+  void dispatchPush(int kind, const ubidots_value_sub_t *sub, MQTT::MessageData *md,
+                    ubidots_events_t event = UBIDOTS_EVENT_ERROR, void *arg = nullptr);
+
+  /**
+   * @brief Dispatch task, runs the queued callbacks.
+   *
+   * @param pd Ubidots object
+   */
+  static void dispatchTask(void *pd);
+#endif
+
+  /**
+   * @brief Take the rate limiter tokens of a publish, or report it refused
+   * and hold the backfill back for the live producer.
+   *
+   * @param payloadLen Payload length
+   * @retval true Publish it
+   * @retval false Over the rate
+   */
+  bool passRateLimit(size_t payloadLen);
+
+  /**
+   * @brief Report a publish refused by the rate limiter and hold the backfill
+   * back for the live producer.
+   *
+   * @param waitMs Time until the publish would pass
+   */
+  void rateRefused(uint32_t waitMs);
+
+  /**
+   * @brief Publish one payload of backfill samples, if the rate limiter and
+   * the live traffic leave room for it.
+   *
+   * @retval true Sent, or nothing to send now
+   * @retval false Publish error
+   */
+  bool backfillStep();
+
+  /**
+   * @brief MQTT Publish of a payload to a topic, compressed when enabled.
+   *
+   * @param topic Topic
+   * @param payload Payload
+   * @param payloadLen Payload length, up to UBIDOTS_MSG_MAX_LEN
+   * @retval true Published succesfully
+   * @retval false Error
+   */
+  bool publishTo(const char *topic, const void *payload, size_t payloadLen);
+
+#if UBIDOTS_GATEWAY
+  /**
+   * @brief Receive a message of the gateway subscription, queued when dispatching.
+   *
+   * @param md Message received
+   */
+  void onGatewayMessage(MQTT::MessageData &md);
+
+  /**
+   * @brief Route a message of a gateway device to the gateway handler.
+   *
+   * @param md Message received
+   */
+  void deliverGateway(MQTT::MessageData &md);
+
+  /**
+   * @brief Publish a payload of flush(), unless the rate limiter holds it back.
    *
-   * @param format String format
-   * @param ... Elipsis
+   * @param device Index of the device
+   * @param payload Payload
+   * @param len Payload length
+   * @param from First queued value of the payload
+   * @param to End of the queued values of the payload, values of device in between are in it
+   * @retval 1 Published, its values out of the queue
+   * @retval 0 Publish error, its values dropped
+   * @retval -1 Over the rate limit, its values stay queued
    */
-  void consoleLog(const char *format, ...);
+  int flushPayload(uint16_t device, const uint8_t *payload, int len, uint8_t from, uint8_t to);
+#endif
+
+#if UBIDOTS_WILDCARD_MAX_VARIABLES > 0
+  /**
+   * @brief Add a variable to the wildcard subscription, subscribing the
+   * wildcard topic if it is not yet on this connection.
+   *
+   * @param variable Variable name to subscribe
+   * @param sub Handler of the variable
+   * @retval true Subscribed succesfully
+   * @retval false Error
+   */
+  bool subscribeWildcard(const char *variable, const ubidots_value_sub_t &sub);
+
+  /**
+   * @brief Route a message of the wildcard subscription to its variable handler.
+   *
+   * @param md Message received
+   */
+  void onWildcardMessage(MQTT::MessageData &md);
+#endif
   /*------------------------------------------------*/
 
 public:
@@ -142,6 +576,39 @@ public:
    */
   bool subscribe(const char *variable = nullptr, subscribe_handler_t handler = nullptr);
 
+  /**
+   * @brief Ubidots MQTT Subcribe delivering the parsed value
+   *
+   * @param variable Variable name to subscribe
+   * @param handler Callback with the value as a float
+   * @param ctx Passed to the handler
+   * @retval true Subscribed succesfully
+   * @retval false Error
+   */
+  bool subscribe(const char *variable, value_float_handler_t handler, void *ctx = nullptr);
+
+  /**
+   * @brief Ubidots MQTT Subcribe delivering the parsed value, rounded to an integer
+   *
+   * @param variable Variable name to subscribe
+   * @param handler Callback with the value as an int32_t
+   * @param ctx Passed to the handler
+   * @retval true Subscribed succesfully
+   * @retval false Error
+   */
+  bool subscribe(const char *variable, value_int_handler_t handler, void *ctx = nullptr);
+
+  /**
+   * @brief Ubidots MQTT Subcribe delivering the parsed value as a bool, true when not 0
+   *
+   * @param variable Variable name to subscribe
+   * @param handler Callback with the value as a bool
+   * @param ctx Passed to the handler
+   * @retval true Subscribed succesfully
+   * @retval false Error
+   */
+  bool subscribe(const char *variable, value_bool_handler_t handler, void *ctx = nullptr);
+
   /**
    * @brief Ubidots MQTT Publish
    *
@@ -152,6 +619,141 @@ public:
    */
   bool publish(const char *variable, float value);
 
+  /**
+   * @brief Ubidots MQTT Publish of a payload larger than UBIDOTS_MSG_MAX_LEN,
+   * such as historical data. The payload is the Ubidots JSON for the device,
+   * streamed from the producer a chunk at a time.
+   *
+   * @param payloadLen Total payload length
+   * @param producer Callback that fills the payload chunks
+   * @param context Passed to the producer
+   * @retval true Published succesfully
+   * @retval false Error
+   */
+  bool publishStream(size_t payloadLen, publish_producer_t producer, void *context = nullptr);
+
+  /**
+   * @brief Ubidots MQTT Publish of an already formatted payload, such as
+   * several variables in one JSON object. Compressed when enabled.
+   *
+   * @param payload Payload
+   * @param payloadLen Payload length, up to UBIDOTS_MSG_MAX_LEN
+   * @retval true Published succesfully
+   * @retval false Error
+   */
+  bool publishPayload(const void *payload, size_t payloadLen);
+
+#if UBIDOTS_GATEWAY
+  /**
+   * @brief Add a device to the gateway, which publishes and subscribes on its
+   * behalf over this connection. Its topic is built once here.
+   *
+   * @param device Device label, copied
+   * @retval >=0 Index of the device, for addValue
+   * @retval -1 No room for the device, see UBIDOTS_GATEWAY_MAX_DEVICES
+   */
+  int addDevice(const char *device);
+
+  /**
+   * @brief Queue a value of a gateway device. flush() sends the values of each
+   * device in one message; a full queue is flushed first. When the rate
+   * limiter holds the queue back the value is refused, and publishWaitMs()
+   * tells the producer how long to wait, drop or coalesce.
+   *
+   * @param device Index of the device, from addDevice
+   * @param variable Variable label, must stay valid until flushed
+   * @param value Value of variable
+   * @retval 1 Queued
+   * @retval 0 Queued, after a flush of the full queue that failed
+   * @retval -1 Unknown device, not queued
+   * @retval -2 Queue still full after the flush, over the rate limit; not queued
+   */
+  int addValue(int device, const char *variable, float value);
+
+  /**
+   * @brief Publish the queued values, one message per device, or more if they
+   * do not fit in UBIDOTS_MSG_MAX_LEN. Values of a failed publish are dropped;
+   * once the rate limiter refuses a message, it and every value after it stay
+   * queued, in order, for the next flush (see getStats(), gatewayQueued).
+   *
+   * @retval true Published succesfully
+   * @retval false Error, or values held back by the rate limiter
+   */
+  bool flush();
+
+  /**
+   * @brief Subscribe to the values of every gateway device with a single
+   * /v1.6/devices/+/+/lv subscription. Values of devices that were not added
+   * are dropped. Call it after connecting, like subscribe().
+   *
+   * @param handler Callback with the device and the parsed value
+   * @param ctx Passed to the handler
+   * @retval true Subscribed succesfully
+   * @retval false Error
+   */
+  bool subscribeDevices(gateway_handler_t handler, void *ctx = nullptr);
+#endif
+
+#if UBIDOTS_DISPATCH
+  /**
+   * @brief Set the dispatch task priority, UBIDOTS_DISPATCH_PRIO by default.
+   * Every task needs its own, so set it for a second Ubidots object. Call it
+   * before connect().
+   *
+   * @param prio Task priority
+   */
+  void setDispatchPriority(uint8_t prio);
+
+  /**
+   * @brief Get the dispatch statistics, queue latency included.
+   *
+   * @retval const ubidots_dispatch_stats_t& Statistics
+   */
+  const ubidots_dispatch_stats_t &getDispatchStats() const;
+#endif
+
+  /**
+   * @brief Limit the publish rate with token buckets, to stay within the plan
+   * limits of the broker. A publish over the limit is not sent: it fails with
+   * a UBIDOTS_RATE_LIMITED error event, and publishWaitMs() tells the producer
+   * how long to wait, drop or coalesce. No limit by default.
+   *
+   * @param messagesPerSecond Messages per second, 0 for no limit
+   * @param bytesPerSecond Payload bytes per second, 0 for no limit
+   * @param messageBurst Messages that can go at once after an idle time
+   * @param byteBurst Payload bytes that can go at once after an idle time, 0 for one second of bytesPerSecond
+   */
+  void setRateLimit(float messagesPerSecond, uint32_t bytesPerSecond = 0, uint32_t messageBurst = 1, uint32_t byteBurst = 0);
+
+  /**
+   * @brief Upload historical samples, such as those buffered during an outage.
+   * keepAlive() packs them into {"var":[{"value":..,"timestamp":..},...]}
+   * payloads of up to UBIDOTS_MSG_MAX_LEN and sends one per call, when the rate
+   * limiter has tokens left. After a live publish is refused the backfill
+   * waits until one goes through, or UBIDOTS_BACKFILL_YIELD_MS after the
+   * refused one was due, so fresh data is not starved.
+   *
+   * @param peek Source of the samples, nullptr to stop
+   * @param sent Called with the samples sent, which the source drops
+   * @param ctx Passed to the callbacks
+   */
+  void setBackfill(backfill_peek_t peek, backfill_sent_t sent, void *ctx = nullptr);
+
+  /**
+   * @brief Time until a publish of payloadLen bytes would pass the rate limiter.
+   *
+   * @param payloadLen Payload length, 0 to check only the message rate
+   * @retval uint32_t Milliseconds to wait, 0 when it can be published now
+   */
+  uint32_t publishWaitMs(size_t payloadLen = 0);
+
+  /**
+   * @brief Get the rate limiter state, tokens as of the last publish or publishWaitMs().
+   *
+   * @retval const ubidots_rate_limit_t& Rate limiter
+   */
+  const ubidots_rate_limit_t &getRateLimit() const;
+
   /**
    * @brief MQTT keep alive and receive data
    *
@@ -168,6 +770,113 @@ public:
    */
   void registerCallback(ubidots_events_t event, void (*func_ptr)(void *));
 
+  /**
+   * @brief Use another MQTT broker than the Ubidots one. Call it before connect().
+   *
+   * @param host Broker host name
+   * @param port Broker port, 0 for the default MQTT (1883) or SSL (8883) port
+   */
+  void setBroker(const char *host, uint16_t port = 0);
+
+  /**
+   * @brief Set the MQTT client ID, the device name by default. Connections of
+   * the same token need different IDs, or the broker drops the older one. Call
+   * it before connect().
+   *
+   * @param clientId Client ID, must stay valid, nullptr for the default
+   */
+  void setClientId(const char *clientId);
+
+  /**
+   * @brief Set the QoS used by publish. QOS0 by default.
+   *
+   * @param qos Quality of service
+   */
+  void setPublishQoS(MQTT::QoS qos);
+
+  /**
+   * @brief Set the payload encoder used by publish. JSON by default, which is
+   * the only one the Ubidots cloud understands; use ubidotsCborEncoder for local
+   * brokers and consumers that decode CBOR.
+   *
+   * @param encoder Payload encoder, nullptr for JSON
+   */
+  void setEncoder(const ubidots_encoder_t *encoder);
+
+#if UBIDOTS_WILDCARD_MAX_VARIABLES > 0
+  /**
+   * @brief Subscribe every variable through a single /v1.6/devices/<device>/+/lv
+   * subscription, routed to the variable handlers by a local hash table. Takes
+   * one client handler and one SUBACK for up to UBIDOTS_WILDCARD_MAX_VARIABLES
+   * variables, instead of one each. Call it before subscribe().
+   *
+   * @param enable True for the wildcard subscription
+   */
+  void setWildcardSubscription(bool enable);
+#endif
+
+#if UBIDOTS_COMPRESSION
+  /**
+   * @brief Compress published payloads of UBIDOTS_COMPRESS_MIN_LEN bytes or
+   * more, see ubidotscompress.h. Only for local brokers and consumers that
+   * decompress; a payload that would not shrink is sent as it is. Compressed
+   * inbound values are decompressed either way.
+   *
+   * @param enable True to compress
+   */
+  void setCompression(bool enable);
+
+  /**
+   * @brief Get the compression statistics.
+   *
+   * @retval const ubidots_compress_stats_t& Statistics
+   */
+  const ubidots_compress_stats_t &getCompressionStats() const;
+#endif
+
+#if MQTTCLIENT_BATCH
+  /**
+   * @brief Receive messages in batches: keepAlive() hands every message already
+   * received to the handler in one call, instead of calling the subscribe handlers.
+   *
+   * @param handler Callback, nullptr to go back to the subscribe handlers
+   */
+  void setBatchHandler(batch_handler_t handler);
+#endif
+
+  /**
+   * @brief Take a snapshot of the counters and of the MQTT client histograms.
+   * Counters are updated atomically, so any task may call it.
+   *
+   * @param stats Snapshot
+   */
+  void getStats(ubidots_stats_t &stats) const;
+
+#if MQTTCLIENT_CAPTURE
+  /**
+   * @brief Capture the MQTT packets, to replay them on a host (tools/replay).
+   * Set it before connect() so the capture starts with the CONNECT; the token
+   * is masked.
+   *
+   * @param capture Capture buffer, nullptr to stop
+   */
+  void setCapture(NBMQTTCapture *capture);
+#endif
+
+#if MQTTCLIENT_TRACE
+  /**
+   * @brief Read the MQTT packet trace, oldest first, one packet per call.
+   * Packets are decoded here, not when sent or received; any task may call it.
+   *
+   * @param cursor 0 for the oldest packet kept, then left as returned
+   * @param line Packet, decoded, NUL terminated
+   * @param lineLen Size of line
+   * @retval true Line written
+   * @retval false No newer packet
+   */
+  bool readTrace(uint32_t &cursor, char *line, int lineLen) const;
+#endif
+
   /**
    * @brief Get MQTT is connected status
    *
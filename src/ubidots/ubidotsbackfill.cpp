@@ -0,0 +1,139 @@
+/**
+ * @file ubidotsbackfill.cpp
+ *
+ * @brief Packing of historical samples into Ubidots array payloads
+ *
+ */
+
+#include <string.h>
+
+#include <ubidotsbackfill.h>
+#include <ubidotsencoder.h>
+
+/*---------------------  Definitions ---------------------*/
+#define BACKFILL_ENTRY_MAX_LEN 64 /*!< {"value":<number>,"timestamp":<20 digits>} */
+/*------------------------------------------------*/
+
+/*---------------------  Private fuctions ---------------------*/
+static int writeInt64(char *out, int64_t n)
+{
+  char tmp[20];
+  uint64_t mag = (n < 0) ? 0 - (uint64_t)n : (uint64_t)n;
+  int len = 0;
+  int tmpLen = 0;
+
+  if (n < 0)
+    out[len++] = '-';
+  do
+  {
+    tmp[tmpLen++] = (char)('0' + mag % 10);
+    mag /= 10;
+  } while (mag != 0);
+
+  while (tmpLen > 0)
+    out[len++] = tmp[--tmpLen];
+  return len;
+}
+
+/**
+ * @brief Format the array entry of a sample.
+ *
+ * @param out Output, at least BACKFILL_ENTRY_MAX_LEN bytes
+ * @param sample Sample
+ * @retval int Length written
+ */
+static int writeEntry(char *out, const ubidots_sample_t *sample)
+{
+  int len = 0;
+
+  memcpy(out, "{\"value\":", 9);
+  len += 9;
+  len += ubidotsJsonNumber(out + len, sample->value);
+  memcpy(out + len, ",\"timestamp\":", 13);
+  len += 13;
+  len += writeInt64(out + len, sample->timestamp);
+  out[len++] = '}';
+  return len;
+}
+/*------------------------------------------------*/
+
+/*---------------------  Public functions ---------------------*/
+void ubidotsBackfillInit(ubidots_backfill_t *backfill, char *buf, size_t bufLen)
+{
+  backfill->buf = buf;
+  backfill->bufLen = bufLen;
+  backfill->len = 0;
+  backfill->samples = 0;
+  backfill->keys = 0;
+
+  if (bufLen >= 2)
+  { // Empty object
+    buf[0] = '{';
+    buf[1] = '}';
+    backfill->len = 2;
+  }
+}
+
+bool ubidotsBackfillAdd(ubidots_backfill_t *backfill, const ubidots_sample_t *sample)
+{
+  char entry[BACKFILL_ENTRY_MAX_LEN];
+  size_t entryLen = writeEntry(entry, sample);
+  size_t varLen = strlen(sample->variable);
+  int k = 0;
+
+  if (backfill->len < 2)
+    return false; // No room for the object
+
+  for (; k < backfill->keys; k++)
+  { // Variable already in the payload?
+    if (backfill->key[k] == sample->variable || strcmp(backfill->key[k], sample->variable) == 0)
+      break;
+  }
+  if (k == UBIDOTS_BACKFILL_MAX_KEYS)
+    return false; // No room for another variable
+
+  bool newKey = (k == backfill->keys);
+  size_t pos = newKey ? backfill->len - 1 : backfill->keyEnd[k]; // Before the } or the ]
+  size_t insLen = newKey ? (backfill->keys > 0) + 1 + varLen + 3 + entryLen + 1 // ,"<var>":[<entry>]
+                         : 1 + entryLen;                                        // ,<entry>
+
+  if (backfill->len + insLen > backfill->bufLen)
+    return false; // Does not fit
+
+  char *buf = backfill->buf;
+  memmove(buf + pos + insLen, buf + pos, backfill->len - pos);
+  for (int i = 0; i < backfill->keys; i++)
+  { // Arrays from pos on move right
+    if (backfill->keyEnd[i] >= pos)
+      backfill->keyEnd[i] += insLen;
+  }
+
+  char *ptr = buf + pos;
+  if (newKey)
+  {
+    if (backfill->keys > 0)
+      *ptr++ = ',';
+    *ptr++ = '"';
+    memcpy(ptr, sample->variable, varLen);
+    ptr += varLen;
+    memcpy(ptr, "\":[", 3);
+    ptr += 3;
+    memcpy(ptr, entry, entryLen);
+    ptr += entryLen;
+    *ptr = ']';
+
+    backfill->key[k] = sample->variable;
+    backfill->keyEnd[k] = (uint16_t)(ptr - buf);
+    backfill->keys++;
+  }
+  else
+  {
+    *ptr++ = ',';
+    memcpy(ptr, entry, entryLen);
+  }
+
+  backfill->len += insLen;
+  backfill->samples++;
+  return true;
+}
+/*------------------------------------------------*/
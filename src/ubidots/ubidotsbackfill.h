@@ -0,0 +1,70 @@
+/**
+ * @file ubidotsbackfill.h
+ *
+ * @brief Packing of historical samples into Ubidots array payloads
+ *
+ * Builds {"temp":[{"value":21.50,"timestamp":1700000000000},...],"hum":[...]}
+ * in a fixed buffer, one sample at a time, until the next one does not fit.
+ * Samples of a variable already in the payload go to the end of its array, so
+ * interleaved samples of a few variables still pack densely.
+ *
+ */
+
+#ifndef UBIDOTSBACKFILL_H_
+#define UBIDOTSBACKFILL_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*---------------------  Definitions ---------------------*/
+#define UBIDOTS_BACKFILL_MAX_KEYS 8 /*!< Variables in one payload */
+
+/**
+ * @brief Historical sample of a variable.
+ *
+ */
+typedef struct
+{
+  const char *variable; /*!< Variable name */
+  float value;          /*!< Value of variable */
+  int64_t timestamp;    /*!< Milliseconds since the epoch */
+} ubidots_sample_t;
+
+/**
+ * @brief Payload being packed.
+ *
+ */
+typedef struct
+{
+  char *buf;                                     /*!< Payload */
+  size_t bufLen;                                 /*!< Size of buf */
+  size_t len;                                    /*!< Payload length */
+  uint16_t samples;                              /*!< Samples in the payload */
+  uint8_t keys;                                  /*!< Variables in the payload */
+  const char *key[UBIDOTS_BACKFILL_MAX_KEYS];    /*!< Variable names */
+  uint16_t keyEnd[UBIDOTS_BACKFILL_MAX_KEYS];    /*!< Offset of the ] closing each variable array */
+} ubidots_backfill_t;
+/*------------------------------------------------*/
+
+/*---------------------  Functions ---------------------*/
+/**
+ * @brief Start an empty payload.
+ *
+ * @param backfill Payload being packed
+ * @param buf Output buffer
+ * @param bufLen Size of buf
+ */
+void ubidotsBackfillInit(ubidots_backfill_t *backfill, char *buf, size_t bufLen);
+
+/**
+ * @brief Add a sample to the payload.
+ *
+ * @param backfill Payload being packed
+ * @param sample Sample, its variable name must stay valid while packing
+ * @retval true Added
+ * @retval false The sample does not fit, the payload is left as it was
+ */
+bool ubidotsBackfillAdd(ubidots_backfill_t *backfill, const ubidots_sample_t *sample);
+/*------------------------------------------------*/
+
+#endif /* UBIDOTSBACKFILL_H_ */
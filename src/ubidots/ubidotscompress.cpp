@@ -0,0 +1,168 @@
+/**
+ * @file ubidotscompress.cpp
+ *
+ * @brief LZSS payload compression for constrained links
+ *
+ */
+
+#include <string.h>
+
+#include <ubidotscompress.h>
+
+/*---------------------  Definitions ---------------------*/
+#define LZ_MIN_MATCH 3      /*!< Shorter matches cost more than literals */
+#define LZ_MAX_MATCH 18     /*!< LZ_MIN_MATCH + 15, the 4 bit length field */
+#define LZ_WINDOW 4096      /*!< Farthest match, the 12 bit offset field */
+#define LZ_HEADER_MAX_LEN 5 /*!< Magic and up to 3 length bytes, with room to spare */
+/*------------------------------------------------*/
+
+/*---------------------  Private fuctions ---------------------*/
+static inline uint32_t lzHash(const uint8_t *p)
+{
+  uint32_t v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+  return (v * 2654435761u) >> (32 - UBIDOTS_LZ_HASH_BITS);
+}
+/*------------------------------------------------*/
+
+/*---------------------  Public functions ---------------------*/
+void ubidotsLzInit(ubidots_lz_t *lz)
+{
+  memset(lz->head, 0, sizeof(lz->head));
+}
+
+int ubidotsCompress(ubidots_lz_t *lz, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen)
+{
+  if (inLen == 0 || inLen > UBIDOTS_LZ_MAX_LEN || outLen < LZ_HEADER_MAX_LEN)
+    return -1;
+
+  uint8_t *ptr = out;
+  uint8_t *end = out + outLen;
+  uint8_t *flags = nullptr; // Flag byte of the current group
+  int items = 8;            // Items in the current group
+  size_t len = inLen;
+
+  *ptr++ = UBIDOTS_LZ_MAGIC0;
+  *ptr++ = UBIDOTS_LZ_MAGIC1;
+  do
+  { // Uncompressed length, MQTT variable length integer
+    uint8_t digit = len % 128;
+    len /= 128;
+    *ptr++ = (len > 0) ? (digit | 0x80) : digit;
+  } while (len > 0);
+
+  // The head table is never cleared: entries left by other payloads are just
+  // positions, and every candidate is checked against the actual bytes.
+  size_t i = 0;
+  while (i < inLen)
+  {
+    if (items == 8)
+    {
+      if (end - ptr < 1)
+        return -1;
+      flags = ptr++;
+      *flags = 0;
+      items = 0;
+    }
+    if (end - ptr < 2)
+      return -1;
+
+    size_t matchLen = 0;
+    size_t offset = 0;
+    if (inLen - i >= LZ_MIN_MATCH)
+    {
+      uint32_t h = lzHash(in + i);
+      size_t candidate = lz->head[h];
+      lz->head[h] = (uint16_t)i;
+      if (candidate < i && i - candidate <= LZ_WINDOW)
+      {
+        size_t max = (inLen - i < LZ_MAX_MATCH) ? inLen - i : LZ_MAX_MATCH;
+        while (matchLen < max && in[candidate + matchLen] == in[i + matchLen])
+          matchLen++;
+        offset = i - candidate;
+      }
+    }
+
+    if (matchLen >= LZ_MIN_MATCH)
+    { // Offset - 1 in 12 bits, length - 3 in 4 bits
+      *ptr++ = (uint8_t)((offset - 1) >> 4);
+      *ptr++ = (uint8_t)(((offset - 1) & 0x0F) << 4 | (matchLen - LZ_MIN_MATCH));
+      for (size_t j = i + 1; j < i + matchLen && inLen - j >= LZ_MIN_MATCH; j++)
+        lz->head[lzHash(in + j)] = (uint16_t)j; // Index the covered positions too
+      i += matchLen;
+    }
+    else
+    {
+      *flags |= (uint8_t)(1 << items);
+      *ptr++ = in[i++];
+    }
+    items++;
+  }
+
+  return (int)(ptr - out);
+}
+
+bool ubidotsIsCompressed(const void *payload, size_t len)
+{
+  const uint8_t *p = (const uint8_t *)payload;
+  return len >= 3 && p[0] == UBIDOTS_LZ_MAGIC0 && p[1] == UBIDOTS_LZ_MAGIC1;
+}
+
+int ubidotsDecompress(const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen)
+{
+  if (!ubidotsIsCompressed(in, inLen))
+    return -1;
+
+  const uint8_t *ptr = in + 2;
+  const uint8_t *end = in + inLen;
+  size_t total = 0;
+  size_t multiplier = 1;
+
+  for (int n = 0;; n++)
+  { // Uncompressed length
+    if (ptr == end || n == 3)
+      return -1;
+    total += (*ptr & 0x7F) * multiplier;
+    multiplier *= 128;
+    if ((*ptr++ & 0x80) == 0)
+      break;
+  }
+  if (total > outLen)
+    return -1;
+
+  size_t produced = 0;
+  uint8_t flags = 0;
+  int items = 8;
+  while (produced < total)
+  {
+    if (items == 8)
+    {
+      if (ptr == end)
+        return -1;
+      flags = *ptr++;
+      items = 0;
+    }
+
+    if (flags & (1 << items))
+    {
+      if (ptr == end)
+        return -1;
+      out[produced++] = *ptr++;
+    }
+    else
+    {
+      if (end - ptr < 2)
+        return -1;
+      size_t offset = ((size_t)ptr[0] << 4 | ptr[1] >> 4) + 1;
+      size_t matchLen = (ptr[1] & 0x0F) + LZ_MIN_MATCH;
+      ptr += 2;
+      if (offset > produced || matchLen > total - produced)
+        return -1;
+      for (size_t j = 0; j < matchLen; j++, produced++)
+        out[produced] = out[produced - offset]; // Byte by byte, the match may overlap itself
+    }
+    items++;
+  }
+
+  return (ptr == end) ? (int)total : -1;
+}
+/*------------------------------------------------*/
@@ -0,0 +1,84 @@
+/**
+ * @file ubidotscompress.h
+ *
+ * @brief LZSS payload compression for constrained links
+ *
+ * A compressed payload is the magic bytes 0x1F 0x4C, the uncompressed length
+ * as an MQTT variable length integer and an LZSS stream: a flag byte before
+ * every 8 items, bit set for a literal byte, clear for a two byte match of 3 to
+ * 18 bytes up to 4096 bytes back. Neither JSON nor CBOR payloads can start with
+ * 0x1F, so a consumer can tell compressed payloads apart.
+ *
+ * Compression needs a 2 KB ubidots_lz_t and no heap; decompression needs no
+ * state at all.
+ *
+ */
+
+#ifndef UBIDOTSCOMPRESS_H_
+#define UBIDOTSCOMPRESS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*---------------------  Definitions ---------------------*/
+#define UBIDOTS_LZ_MAGIC0 0x1F   /*!< First byte of a compressed payload */
+#define UBIDOTS_LZ_MAGIC1 0x4C   /*!< Second byte of a compressed payload */
+#define UBIDOTS_LZ_HASH_BITS 10  /*!< Match finder hash table of 2^bits entries */
+#define UBIDOTS_LZ_MAX_LEN 65535 /*!< Longest payload the compressor takes */
+
+/**
+ * @brief Compressor state. Keep it between calls, it never needs clearing.
+ *
+ */
+typedef struct
+{
+  uint16_t head[1 << UBIDOTS_LZ_HASH_BITS]; /*!< Last position of each 3 byte hash */
+} ubidots_lz_t;
+/*------------------------------------------------*/
+
+/*---------------------  Functions ---------------------*/
+/**
+ * @brief Init the compressor state.
+ *
+ * @param lz Compressor state
+ */
+void ubidotsLzInit(ubidots_lz_t *lz);
+
+/**
+ * @brief Compress a payload.
+ *
+ * @param lz Compressor state
+ * @param in Payload
+ * @param inLen Payload length, up to UBIDOTS_LZ_MAX_LEN
+ * @param out Output buffer
+ * @param outLen Size of out. Pass less than inLen to only accept a saving.
+ * @retval >0 Compressed length
+ * @retval -1 The compressed payload does not fit in out
+ */
+int ubidotsCompress(ubidots_lz_t *lz, const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen);
+
+/**
+ * @brief Check whether a payload was compressed by ubidotsCompress().
+ *
+ * @param payload Payload
+ * @param len Payload length
+ * @retval true Compressed
+ * @retval false Plain payload
+ */
+bool ubidotsIsCompressed(const void *payload, size_t len);
+
+/**
+ * @brief Decompress a payload, such as an inbound message. Corrupt input is
+ * rejected, it never reads or writes out of bounds.
+ *
+ * @param in Compressed payload
+ * @param inLen Compressed payload length
+ * @param out Output buffer
+ * @param outLen Size of out
+ * @retval >=0 Decompressed length
+ * @retval -1 Not a compressed payload, corrupt, or larger than out
+ */
+int ubidotsDecompress(const uint8_t *in, size_t inLen, uint8_t *out, size_t outLen);
+/*------------------------------------------------*/
+
+#endif /* UBIDOTSCOMPRESS_H_ */
@@ -0,0 +1,92 @@
+/**
+ * @file ubidotsdevices.cpp
+ *
+ * @brief Device table of the gateway mode
+ *
+ */
+
+#include <string.h>
+
+#include <ubidotsdevices.h>
+#include <ubidotsvariables.h>
+
+/*---------------------  Definitions ---------------------*/
+#define DEVICES_PATH "/v1.6/devices/"                  /*!< Same as UBIDOTS_BROKER_PATH */
+#define DEVICES_PATH_LEN (sizeof(DEVICES_PATH) - 1)    /*!< Offset of the label in a topic */
+#define DEVICES_LABEL_MAX_LEN 255                      /*!< Label lengths are stored in a byte */
+/*------------------------------------------------*/
+
+static_assert((UBIDOTS_GATEWAY_SLOTS & (UBIDOTS_GATEWAY_SLOTS - 1)) == 0, "UBIDOTS_GATEWAY_SLOTS must be a power of two");
+static_assert(UBIDOTS_GATEWAY_SLOTS > UBIDOTS_GATEWAY_MAX_DEVICES, "UBIDOTS_GATEWAY_SLOTS must exceed UBIDOTS_GATEWAY_MAX_DEVICES");
+static_assert(UBIDOTS_GATEWAY_TOPICS_LEN <= 0xFFFF, "topic offsets are 16 bit");
+
+/*---------------------  Private fuctions ---------------------*/
+/**
+ * @brief Find the slot of a label, or the free slot where it would go.
+ *
+ * @param table Device table
+ * @param label Device label
+ * @param len Device label length
+ * @retval size_t Slot
+ */
+static size_t deviceSlot(const ubidots_devices_t *table, const char *label, size_t len)
+{
+  size_t slot = ubidotsNameHash(label, len) & (UBIDOTS_GATEWAY_SLOTS - 1);
+
+  // Never full, there are more slots than devices
+  for (; table->slots[slot] != 0; slot = (slot + 1) & (UBIDOTS_GATEWAY_SLOTS - 1))
+  {
+    int index = table->slots[slot] - 1;
+    if (table->labelLens[index] == len && memcmp(table->topics + table->offsets[index] + DEVICES_PATH_LEN, label, len) == 0)
+      break;
+  }
+  return slot;
+}
+/*------------------------------------------------*/
+
+/*---------------------  Public functions ---------------------*/
+void ubidotsDevicesInit(ubidots_devices_t *table)
+{
+  memset(table->slots, 0, sizeof(table->slots));
+  table->topicsUsed = 0;
+  table->count = 0;
+}
+
+int ubidotsDevicesAdd(ubidots_devices_t *table, const char *label)
+{
+  size_t len = strlen(label);
+  if (len == 0 || len > DEVICES_LABEL_MAX_LEN)
+    return -1; // No label or too long
+
+  size_t slot = deviceSlot(table, label, len);
+  if (table->slots[slot] != 0)
+    return table->slots[slot] - 1; // Already there
+  if (table->count >= UBIDOTS_GATEWAY_MAX_DEVICES || table->topicsUsed + DEVICES_PATH_LEN + len + 1 > UBIDOTS_GATEWAY_TOPICS_LEN)
+    return -1; // Table full
+
+  // Build the device topic at the end of the pool
+  int index = table->count++;
+  char *topic = table->topics + table->topicsUsed;
+  memcpy(topic, DEVICES_PATH, DEVICES_PATH_LEN);
+  memcpy(topic + DEVICES_PATH_LEN, label, len + 1);
+
+  table->offsets[index] = table->topicsUsed;
+  table->labelLens[index] = (uint8_t)len;
+  table->topicsUsed += DEVICES_PATH_LEN + len + 1;
+  table->slots[slot] = (uint16_t)(index + 1);
+  return index;
+}
+
+int ubidotsDevicesFind(const ubidots_devices_t *table, const char *label, size_t len)
+{
+  if (len > DEVICES_LABEL_MAX_LEN)
+    return -1; // Can not be there
+
+  return table->slots[deviceSlot(table, label, len)] - 1;
+}
+
+const char *ubidotsDevicesTopic(const ubidots_devices_t *table, int index)
+{
+  return table->topics + table->offsets[index];
+}
+/*------------------------------------------------*/
@@ -0,0 +1,84 @@
+/**
+ * @file ubidotsdevices.h
+ *
+ * @brief Device table of the gateway mode
+ *
+ * Holds the /v1.6/devices/<device> topic of every device a gateway publishes
+ * for, built once when the device is added, and finds a device by the label in
+ * a received topic with an open addressed hash table. Topics are packed in one
+ * pool, so a device costs its topic length and a few bytes of index.
+ *
+ */
+
+#ifndef UBIDOTSDEVICES_H_
+#define UBIDOTSDEVICES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*---------------------  Definitions ---------------------*/
+#ifndef UBIDOTS_GATEWAY_MAX_DEVICES
+#define UBIDOTS_GATEWAY_MAX_DEVICES 64                                /*!< Devices of the gateway mode */
+#endif
+#ifndef UBIDOTS_GATEWAY_SLOTS
+#define UBIDOTS_GATEWAY_SLOTS 128                                     /*!< Hash slots, a power of two above UBIDOTS_GATEWAY_MAX_DEVICES */
+#endif
+#ifndef UBIDOTS_GATEWAY_TOPICS_LEN
+#define UBIDOTS_GATEWAY_TOPICS_LEN (UBIDOTS_GATEWAY_MAX_DEVICES * 40) /*!< Topic pool, for labels of 25 characters on average */
+#endif
+
+/**
+ * @brief Device table.
+ *
+ */
+typedef struct
+{
+  char topics[UBIDOTS_GATEWAY_TOPICS_LEN];        /*!< NUL terminated device topics, back to back */
+  uint16_t topicsUsed;                            /*!< Bytes of the pool used */
+  uint16_t offsets[UBIDOTS_GATEWAY_MAX_DEVICES];  /*!< Topic of each device, by index */
+  uint8_t labelLens[UBIDOTS_GATEWAY_MAX_DEVICES]; /*!< Device label lengths, by index */
+  uint16_t slots[UBIDOTS_GATEWAY_SLOTS];          /*!< Index + 1 of the label hashed there, 0 when free */
+  uint16_t count;                                 /*!< Devices in the table */
+} ubidots_devices_t;
+/*------------------------------------------------*/
+
+/*---------------------  Functions ---------------------*/
+/**
+ * @brief Init an empty table.
+ *
+ * @param table Device table
+ */
+void ubidotsDevicesInit(ubidots_devices_t *table);
+
+/**
+ * @brief Add a device, or find it if it is already there.
+ *
+ * @param table Device table
+ * @param label Device label
+ * @retval >=0 Index of the device
+ * @retval -1 Table or topic pool full, or label too long
+ */
+int ubidotsDevicesAdd(ubidots_devices_t *table, const char *label);
+
+/**
+ * @brief Find a device.
+ *
+ * @param table Device table
+ * @param label Device label, not NUL terminated
+ * @param len Device label length
+ * @retval >=0 Index of the device
+ * @retval -1 Not in the table
+ */
+int ubidotsDevicesFind(const ubidots_devices_t *table, const char *label, size_t len);
+
+/**
+ * @brief Get the topic of a device.
+ *
+ * @param table Device table
+ * @param index Index of the device
+ * @retval const char* /v1.6/devices/<device>
+ */
+const char *ubidotsDevicesTopic(const ubidots_devices_t *table, int index);
+/*------------------------------------------------*/
+
+#endif /* UBIDOTSDEVICES_H_ */
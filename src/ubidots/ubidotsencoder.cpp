@@ -0,0 +1,235 @@
+/**
+ * @file ubidotsencoder.cpp
+ *
+ * @brief Payload encoders used by Ubidots::publish
+ *
+ */
+
+#include <string.h>
+
+#include <ubidotsencoder.h>
+
+/*---------------------  Definitions ---------------------*/
+#define JSON_FIXED_LIMIT 1e15            /*!< Larger magnitudes are written with an exponent */
+#define CBOR_HEAD_MAX_LEN 5              /*!< Initial byte and a 32 bit argument */
+#define CBOR_MAJOR_UNSIGNED 0x00         /*!< Major type 0, unsigned integer */
+#define CBOR_MAJOR_NEGATIVE 0x20         /*!< Major type 1, negative integer */
+#define CBOR_MAJOR_TEXT 0x60             /*!< Major type 3, text string */
+#define CBOR_MAJOR_MAP 0xA0              /*!< Major type 5, map */
+#define CBOR_FLOAT32 0xFA                /*!< Major type 7, single precision float */
+#define CBOR_INT_LIMIT 2147483648.0f     /*!< Values below this magnitude may be sent as integers */
+#define CBOR_MAP_MAX_PAIRS 23            /*!< Pairs counted in the initial byte of the map */
+/*------------------------------------------------*/
+
+/*---------------------  Prototipos funciones privadas ---------------------*/
+static int jsonEncode(uint8_t *buf, size_t bufLen, const char *variable, float value);
+static int cborEncode(uint8_t *buf, size_t bufLen, const char *variable, float value);
+static int jsonAppend(uint8_t *buf, size_t bufLen, size_t len, const char *variable, float value);
+static int cborAppend(uint8_t *buf, size_t bufLen, size_t len, const char *variable, float value);
+/*------------------------------------------------*/
+
+/*---------------------  Globals ---------------------*/
+const ubidots_encoder_t ubidotsJsonEncoder = {"json", false, jsonEncode, jsonAppend};
+const ubidots_encoder_t ubidotsCborEncoder = {"cbor", true, cborEncode, cborAppend};
+/*------------------------------------------------*/
+
+/*---------------------  Private fuctions ---------------------*/
+/**
+ * @brief Write the decimal digits of n, most significant first.
+ *
+ * @param out Output, at least 20 bytes
+ * @param n Number
+ * @param minDigits Pad with leading zeros up to this many digits
+ * @retval int Digits written
+ */
+static int writeDigits(char *out, uint64_t n, int minDigits)
+{
+  char tmp[20];
+  int len = 0;
+
+  do
+  {
+    tmp[len++] = (char)('0' + n % 10);
+    n /= 10;
+  } while (n != 0 || len < minDigits);
+
+  for (int i = 0; i < len; i++)
+  {
+    out[i] = tmp[len - 1 - i];
+  }
+  return len;
+}
+
+static int jsonEncode(uint8_t *buf, size_t bufLen, const char *variable, float value)
+{
+  char number[UBIDOTS_JSON_NUMBER_MAX_LEN];
+  size_t varLen = strlen(variable);
+  size_t numberLen = ubidotsJsonNumber(number, value);
+  size_t len = 2 + varLen + 3 + numberLen + 1; // {"<var>": <number>}
+
+  if (len > bufLen)
+    return -1; // Does not fit
+
+  uint8_t *ptr = buf;
+  *ptr++ = '{';
+  *ptr++ = '"';
+  memcpy(ptr, variable, varLen);
+  ptr += varLen;
+  *ptr++ = '"';
+  *ptr++ = ':';
+  *ptr++ = ' ';
+  memcpy(ptr, number, numberLen);
+  ptr += numberLen;
+  *ptr++ = '}';
+
+  return (int)len;
+}
+
+static int jsonAppend(uint8_t *buf, size_t bufLen, size_t len, const char *variable, float value)
+{
+  if (len == 0)
+    return jsonEncode(buf, bufLen, variable, value);
+
+  // Encode the pair over the closing brace, then turn its opening brace into a comma
+  int pairLen = jsonEncode(buf + len - 1, bufLen - len + 1, variable, value);
+  if (pairLen < 0)
+    return -1; // Nothing written
+  buf[len - 1] = ',';
+  return (int)(len - 1 + pairLen);
+}
+
+/**
+ * @brief Write a CBOR head, the major type with the shortest argument.
+ *
+ * @param out Output, at least CBOR_HEAD_MAX_LEN bytes
+ * @param major Major type, already shifted
+ * @param arg Argument
+ * @retval int Length written
+ */
+static int cborHead(uint8_t *out, uint8_t major, uint32_t arg)
+{
+  if (arg < 24)
+  {
+    out[0] = major | (uint8_t)arg;
+    return 1;
+  }
+  if (arg <= 0xFF)
+  {
+    out[0] = major | 24;
+    out[1] = (uint8_t)arg;
+    return 2;
+  }
+  if (arg <= 0xFFFF)
+  {
+    out[0] = major | 25;
+    out[1] = (uint8_t)(arg >> 8);
+    out[2] = (uint8_t)arg;
+    return 3;
+  }
+  out[0] = major | 26;
+  out[1] = (uint8_t)(arg >> 24);
+  out[2] = (uint8_t)(arg >> 16);
+  out[3] = (uint8_t)(arg >> 8);
+  out[4] = (uint8_t)arg;
+  return 5;
+}
+
+static int cborEncode(uint8_t *buf, size_t bufLen, const char *variable, float value)
+{
+  size_t varLen = strlen(variable);
+
+  if (1 + CBOR_HEAD_MAX_LEN + varLen + CBOR_HEAD_MAX_LEN > bufLen)
+    return -1; // Does not fit
+
+  uint8_t *ptr = buf;
+  *ptr++ = CBOR_MAJOR_MAP | 1;
+  ptr += cborHead(ptr, CBOR_MAJOR_TEXT, (uint32_t)varLen);
+  memcpy(ptr, variable, varLen);
+  ptr += varLen;
+
+  if (value > -CBOR_INT_LIMIT && value < CBOR_INT_LIMIT && value == (float)(int32_t)value)
+  { // Whole numbers are smaller as integers
+    int32_t n = (int32_t)value;
+    ptr += (n >= 0) ? cborHead(ptr, CBOR_MAJOR_UNSIGNED, (uint32_t)n)
+                    : cborHead(ptr, CBOR_MAJOR_NEGATIVE, (uint32_t)(-1 - n));
+  }
+  else
+  {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    *ptr++ = CBOR_FLOAT32;
+    *ptr++ = (uint8_t)(bits >> 24);
+    *ptr++ = (uint8_t)(bits >> 16);
+    *ptr++ = (uint8_t)(bits >> 8);
+    *ptr++ = (uint8_t)bits;
+  }
+
+  return (int)(ptr - buf);
+}
+
+static int cborAppend(uint8_t *buf, size_t bufLen, size_t len, const char *variable, float value)
+{
+  if (len == 0)
+    return cborEncode(buf, bufLen, variable, value);
+  if ((buf[0] & 0x1F) >= CBOR_MAP_MAX_PAIRS)
+    return -1; // A longer map head would move the whole payload
+
+  // Encode a one pair map over the last byte, then put that byte back over its head
+  uint8_t last = buf[len - 1];
+  int pairLen = cborEncode(buf + len - 1, bufLen - len + 1, variable, value);
+  if (pairLen < 0)
+    return -1; // Nothing written
+  buf[len - 1] = last;
+  buf[0]++; // One more pair
+  return (int)(len - 1 + pairLen);
+}
+/*------------------------------------------------*/
+
+/*---------------------  Public functions ---------------------*/
+int ubidotsJsonNumber(char *out, float value)
+{ // Rounds half away from zero, the NetBurner siprintf has no floating point
+  double mag = value;
+  int exponent = 0;
+  int len = 0;
+
+  if (value != value || value - value != 0.0f)
+  { // NaN or Inf
+    memcpy(out, "null", 4);
+    return 4;
+  }
+
+  if (mag < 0)
+  {
+    out[len++] = '-';
+    mag = -mag;
+  }
+
+  if (mag >= JSON_FIXED_LIMIT)
+  { // d.dde+dd, a float has 7 significant digits anyway
+    while (mag >= 10.0)
+    {
+      mag /= 10.0;
+      exponent++;
+    }
+  }
+
+  uint64_t cents = (uint64_t)(mag * 100.0 + 0.5);
+  if (exponent > 0 && cents >= 1000)
+  { // 9.995 rounded up to 10.00
+    cents /= 10;
+    exponent++;
+  }
+
+  len += writeDigits(out + len, cents / 100, 1);
+  out[len++] = '.';
+  len += writeDigits(out + len, cents % 100, 2);
+
+  if (exponent > 0)
+  {
+    out[len++] = 'e';
+    out[len++] = '+';
+    len += writeDigits(out + len, (uint64_t)exponent, 2);
+  }
+  return len;
+}
+/*------------------------------------------------*/
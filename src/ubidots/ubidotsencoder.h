@@ -0,0 +1,75 @@
+/**
+ * @file ubidotsencoder.h
+ *
+ * @brief Payload encoders used by Ubidots::publish
+ *
+ * An encoder writes one {variable: value} pair into the publish buffer and
+ * returns its length, or appends a pair to a payload it already wrote, which
+ * batches several variables of a device into one message. Encoders keep no state and never allocate, so they can
+ * run from any task. JSON is what the Ubidots cloud expects; CBOR (RFC 8949)
+ * is for local brokers and consumers that decode it, and is about half the
+ * size.
+ *
+ */
+
+#ifndef UBIDOTSENCODER_H_
+#define UBIDOTSENCODER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*---------------------  Definitions ---------------------*/
+#define UBIDOTS_JSON_NUMBER_MAX_LEN 24 /*!< -<15 digits>.dd or -d.dde+dd, with room to spare */
+
+/**
+ * @brief Payload encoder.
+ *
+ */
+typedef struct
+{
+  const char *name; /*!< Encoder name, for logs */
+  bool binary;      /*!< Payload is not printable text */
+  /**
+   * @brief Encode {variable: value} into buf.
+   *
+   * @param buf Output buffer
+   * @param bufLen Size of buf
+   * @param variable Variable name
+   * @param value Value of variable
+   * @retval >0 Payload length
+   * @retval -1 The payload does not fit in buf
+   */
+  int (*encode)(uint8_t *buf, size_t bufLen, const char *variable, float value);
+  /**
+   * @brief Add variable: value to the payload of len bytes in buf.
+   *
+   * @param buf Output buffer, holding the payload
+   * @param bufLen Size of buf
+   * @param len Payload length, 0 to start one like encode
+   * @param variable Variable name
+   * @param value Value of variable
+   * @retval >0 New payload length
+   * @retval -1 The pair does not fit in buf, the payload is left as it was
+   */
+  int (*append)(uint8_t *buf, size_t bufLen, size_t len, const char *variable, float value);
+} ubidots_encoder_t;
+/*------------------------------------------------*/
+
+/*---------------------  Functions ---------------------*/
+/**
+ * @brief Format a value as the JSON encoder does: like printf("%.2f"), with
+ * an exponent from 1e15 and null for NaN or Inf.
+ *
+ * @param out Output, at least UBIDOTS_JSON_NUMBER_MAX_LEN bytes
+ * @param value Value
+ * @retval int Length written, no terminator
+ */
+int ubidotsJsonNumber(char *out, float value);
+/*------------------------------------------------*/
+
+/*---------------------  Encoders ---------------------*/
+extern const ubidots_encoder_t ubidotsJsonEncoder; /*!< {"variable": 1.00}, two decimals, null for NaN/Inf */
+extern const ubidots_encoder_t ubidotsCborEncoder; /*!< CBOR map of text keys, integer when exact or float32 values, up to 23 pairs */
+/*------------------------------------------------*/
+
+#endif /* UBIDOTSENCODER_H_ */
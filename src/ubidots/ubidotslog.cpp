@@ -0,0 +1,470 @@
+/**
+ * @file ubidotslog.cpp
+ *
+ * @brief Leveled, deferred console log
+ *
+ */
+
+#include <nbrtos.h>
+#include <string.h>
+
+#include <ubidotslog.h>
+
+/*---------------------  Definitions ---------------------*/
+#define LOG_SPEC_MAX_LEN 16 /*!< Longest conversion specification formatted */
+
+/**
+ * @brief Header of a record, followed by the arguments: integers and pointers
+ * as stored by the caller, strings as a uint16_t length and the bytes.
+ *
+ */
+typedef struct
+{
+  uint16_t len;       /*!< Record length, header included, 0 marks the end of the ring */
+  uint8_t level;      /*!< UBIDOTS_LOG_LEVEL_x */
+  const char *format; /*!< String literal */
+} log_head_t;
+
+/**
+ * @brief Conversion specification of a format.
+ *
+ */
+typedef struct
+{
+  size_t len;    /*!< Length, from the % to the conversion */
+  uint8_t stars; /*!< * width and precision, an int argument each */
+  int precision; /*!< Literal precision, -1 if none, -2 if * */
+  uint8_t size;  /*!< Bytes of an integer argument */
+  char conv;     /*!< Conversion */
+} log_spec_t;
+/*------------------------------------------------*/
+
+/*---------------------  Globals ---------------------*/
+static uint8_t ring[UBIDOTS_LOG_BUFFER_LEN];        /*!< Records */
+static size_t ringHead = 0;                         /*!< Next record written */
+static size_t ringTail = 0;                         /*!< Next record formatted */
+static size_t ringUsed = 0;                         /*!< Bytes in use, ends skipped at wrap included */
+static ubidots_log_stats_t logStats = {0, 0, 0};    /*!< Counters */
+static uint32_t dropsReported = 0;                  /*!< Drops already printed */
+static bool logStarted = false;                     /*!< Log task created */
+static uint32_t logStack[USER_TASK_STK_SIZE];       /*!< Log task stack */
+/*------------------------------------------------*/
+
+/*---------------------  Private fuctions ---------------------*/
+/**
+ * @brief Parse the conversion specification at a %.
+ *
+ * @param p The %
+ * @param spec Specification
+ */
+static void parseSpec(const char *p, log_spec_t *spec)
+{
+  const char *s = p + 1;
+
+  spec->stars = 0;
+  spec->precision = -1;
+  spec->size = sizeof(int);
+
+  while (*s == '-' || *s == '+' || *s == ' ' || *s == '#' || *s == '0')
+    s++; // Flags
+  if (*s == '*')
+  {
+    spec->stars++;
+    s++;
+  }
+  while (*s >= '0' && *s <= '9')
+    s++; // Width
+  if (*s == '.')
+  {
+    s++;
+    if (*s == '*')
+    {
+      spec->stars++;
+      spec->precision = -2;
+      s++;
+    }
+    else
+    {
+      spec->precision = 0;
+      while (*s >= '0' && *s <= '9')
+        spec->precision = spec->precision * 10 + (*s++ - '0');
+    }
+  }
+
+  switch (*s)
+  { // Length modifier
+  case 'h':
+    s += (s[1] == 'h') ? 2 : 1; // Promoted to int
+    break;
+  case 'l':
+    if (s[1] == 'l')
+    {
+      spec->size = sizeof(long long);
+      s += 2;
+    }
+    else
+    {
+      spec->size = sizeof(long);
+      s++;
+    }
+    break;
+  case 'z':
+    spec->size = sizeof(size_t);
+    s++;
+    break;
+  case 'j':
+    spec->size = sizeof(intmax_t);
+    s++;
+    break;
+  case 't':
+    spec->size = sizeof(ptrdiff_t);
+    s++;
+    break;
+  }
+
+  spec->conv = *s;
+  spec->len = (*s) ? s + 1 - p : s - p;
+}
+
+static bool isInteger(char conv)
+{
+  return conv == 'd' || conv == 'i' || conv == 'u' || conv == 'o' || conv == 'x' || conv == 'X' || conv == 'c';
+}
+
+static bool put(uint8_t *rec, size_t *pos, const void *data, size_t len)
+{
+  if (*pos + len > UBIDOTS_LOG_RECORD_MAX_LEN)
+    return false; // Left out
+  memcpy(rec + *pos, data, len);
+  *pos += len;
+  return true;
+}
+
+/**
+ * @brief Build the record of a message.
+ *
+ * @retval size_t Record length
+ */
+static size_t buildRecord(uint8_t *rec, uint8_t level, const char *format, va_list args)
+{
+  log_head_t head;
+  size_t pos = sizeof(head);
+  bool fits = true;
+
+  for (const char *p = format; fits && *p; p++)
+  {
+    if (*p != '%')
+      continue;
+
+    log_spec_t spec;
+    parseSpec(p, &spec);
+    p += spec.len - 1;
+    if (spec.conv == '%')
+      continue;
+
+    int star = -1;
+    for (int i = 0; i < spec.stars; i++)
+    {
+      star = va_arg(args, int);
+      fits = fits && put(rec, &pos, &star, sizeof(star));
+    }
+
+    if (isInteger(spec.conv) && spec.size > sizeof(int))
+    {
+      long long value = va_arg(args, long long);
+      fits = fits && put(rec, &pos, &value, sizeof(value));
+    }
+    else if (isInteger(spec.conv))
+    {
+      int value = va_arg(args, int);
+      fits = fits && put(rec, &pos, &value, sizeof(value));
+    }
+    else if (spec.conv == 'p')
+    {
+      void *value = va_arg(args, void *);
+      fits = fits && put(rec, &pos, &value, sizeof(value));
+    }
+    else if (spec.conv == 's')
+    {
+      const char *str = va_arg(args, const char *);
+      size_t max = UBIDOTS_LOG_STRING_MAX_LEN;
+      int precision = (spec.precision == -2) ? star : spec.precision; // .* is the last star
+
+      if (str == nullptr)
+        str = "(null)";
+      if (precision >= 0 && (size_t)precision < max)
+        max = precision;
+
+      uint16_t len = (uint16_t)strnlen(str, max);
+      fits = fits && put(rec, &pos, &len, sizeof(len)) && put(rec, &pos, str, len);
+    }
+    else
+      break; // Unsupported, the arguments after it can not be found
+  }
+
+  head.len = (uint16_t)pos;
+  head.level = level;
+  head.format = format;
+  memcpy(rec, &head, sizeof(head));
+  return pos;
+}
+
+/**
+ * @brief Format one argument with the stars read before it.
+ *
+ */
+template <typename T>
+static int formatArg(char *out, size_t outLen, const char *spec, int stars, const int *star, T value)
+{
+  switch (stars)
+  {
+  case 0:
+    return sniprintf(out, outLen, spec, value);
+  case 1:
+    return sniprintf(out, outLen, spec, star[0], value);
+  default:
+    return sniprintf(out, outLen, spec, star[0], star[1], value);
+  }
+}
+
+static bool get(const uint8_t *rec, size_t recLen, size_t *pos, void *data, size_t len)
+{
+  if (*pos + len > recLen)
+    return false; // Left out of the record
+  memcpy(data, rec + *pos, len);
+  *pos += len;
+  return true;
+}
+
+/**
+ * @brief Format a record.
+ *
+ * @retval int Length of line
+ */
+static int formatRecord(const uint8_t *rec, const log_head_t *head, char *line, size_t lineLen)
+{
+  size_t pos = sizeof(log_head_t);
+  size_t len = 0;
+  bool missing = false; // Arguments left out, the rest of the format is copied as it is
+
+  for (const char *p = head->format; *p && len + 1 < lineLen;)
+  {
+    log_spec_t spec;
+
+    if (*p != '%' || missing)
+    {
+      line[len++] = *p++;
+      continue;
+    }
+    parseSpec(p, &spec);
+    if (spec.conv == '%')
+    {
+      line[len++] = '%';
+      p += spec.len;
+      continue;
+    }
+
+    char fmt[LOG_SPEC_MAX_LEN];
+    int star[2] = {0, 0};
+    int n = -1;
+
+    if (spec.len >= sizeof(fmt))
+    {
+      missing = true; // Too long to rebuild
+      continue;
+    }
+    memcpy(fmt, p, spec.len);
+    fmt[spec.len] = '\0';
+
+    for (int i = 0; i < spec.stars; i++)
+      missing = missing || !get(rec, head->len, &pos, &star[i], sizeof(star[i]));
+
+    if (missing)
+      continue; // Copied from this specification on
+
+    if (isInteger(spec.conv) && spec.size > sizeof(int))
+    {
+      long long value;
+      if (get(rec, head->len, &pos, &value, sizeof(value)))
+        n = formatArg(line + len, lineLen - len, fmt, spec.stars, star, value);
+    }
+    else if (isInteger(spec.conv))
+    {
+      int value;
+      if (get(rec, head->len, &pos, &value, sizeof(value)))
+        n = formatArg(line + len, lineLen - len, fmt, spec.stars, star, value);
+    }
+    else if (spec.conv == 'p')
+    {
+      void *value;
+      if (get(rec, head->len, &pos, &value, sizeof(value)))
+        n = formatArg(line + len, lineLen - len, fmt, spec.stars, star, value);
+    }
+    else if (spec.conv == 's')
+    {
+      char str[UBIDOTS_LOG_STRING_MAX_LEN + 1];
+      uint16_t strLen;
+      if (get(rec, head->len, &pos, &strLen, sizeof(strLen)) && get(rec, head->len, &pos, str, strLen))
+      {
+        str[strLen] = '\0';
+        n = formatArg(line + len, lineLen - len, fmt, spec.stars, star, (const char *)str);
+      }
+    }
+
+    if (n < 0)
+    {
+      missing = true; // Copied from this specification on
+      continue;
+    }
+    len += ((size_t)n < lineLen - len) ? n : lineLen - len - 1; // Truncated
+    p += spec.len;
+  }
+
+  line[len] = '\0';
+  return (int)len;
+}
+
+/**
+ * @brief Put a record in the ring.
+ *
+ */
+static void ringPush(const uint8_t *rec, size_t len)
+{
+  USER_ENTER_CRITICAL(); // Short copy, callable from any task, before the OS starts too
+
+  size_t end = UBIDOTS_LOG_BUFFER_LEN - ringHead;
+  size_t need = (end < len) ? end + len : len; // A record never wraps, the end is skipped
+
+  if (ringUsed + need > UBIDOTS_LOG_BUFFER_LEN)
+  {
+    logStats.dropped++;
+  }
+  else
+  {
+    if (end < len)
+    { // Skip the end
+      if (end >= sizeof(uint16_t))
+        memset(ring + ringHead, 0, sizeof(uint16_t)); // End marker
+      ringUsed += end;
+      ringHead = 0;
+    }
+    memcpy(ring + ringHead, rec, len);
+    ringHead = (ringHead + len) % UBIDOTS_LOG_BUFFER_LEN;
+    ringUsed += len;
+    logStats.recorded++;
+  }
+
+  USER_EXIT_CRITICAL();
+}
+
+/**
+ * @brief Take the oldest record out of the ring.
+ *
+ * @retval size_t Record length, 0 when empty
+ */
+static size_t ringPop(uint8_t *rec)
+{
+  uint16_t len = 0;
+
+  USER_ENTER_CRITICAL();
+
+  if (ringUsed > 0)
+  {
+    size_t end = UBIDOTS_LOG_BUFFER_LEN - ringTail;
+
+    if (end < sizeof(uint16_t) || (memcpy(&len, ring + ringTail, sizeof(len)), len == 0))
+    { // Skipped end
+      ringUsed -= end;
+      ringTail = 0;
+      memcpy(&len, ring, sizeof(len));
+    }
+    memcpy(rec, ring + ringTail, len);
+    ringTail = (ringTail + len) % UBIDOTS_LOG_BUFFER_LEN;
+    ringUsed -= len;
+  }
+
+  USER_EXIT_CRITICAL();
+  return len;
+}
+
+static void logTask(void *pd)
+{
+  static char line[UBIDOTS_LOG_LINE_MAX_LEN]; // Only this task formats
+
+  while (1)
+  {
+    while (ubidotsLogNext(line, sizeof(line), nullptr) >= 0)
+    {
+      iprintf("%s", line);
+    }
+    OSTimeDly(1); // Poll, so recording never touches the OS
+  }
+}
+/*------------------------------------------------*/
+
+/*---------------------  Public functions ---------------------*/
+void ubidotsLog(uint8_t level, const char *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  ubidotsLogV(level, format, args);
+  va_end(args);
+}
+
+void ubidotsLogV(uint8_t level, const char *format, va_list args)
+{
+#if UBIDOTS_LOG_DEFERRED
+  uint8_t rec[UBIDOTS_LOG_RECORD_MAX_LEN];
+  size_t len = buildRecord(rec, level, format, args);
+
+  ringPush(rec, len);
+#else
+  viprintf(format, args);
+#endif
+}
+
+int ubidotsLogNext(char *line, size_t lineLen, uint8_t *level)
+{
+  uint8_t rec[UBIDOTS_LOG_RECORD_MAX_LEN];
+  uint32_t dropped = logStats.dropped;
+  log_head_t head;
+
+  if (lineLen == 0)
+    return -1; // No room for the NUL
+
+  if (dropped != dropsReported)
+  { // Tell the records lost first
+    if (level)
+      *level = UBIDOTS_LOG_LEVEL_WARN;
+    int n = sniprintf(line, lineLen, "[%lu log records dropped]\r\n", (unsigned long)(dropped - dropsReported));
+    dropsReported = dropped;
+    return (n < (int)lineLen) ? n : (int)lineLen - 1;
+  }
+
+  if (ringPop(rec) == 0)
+    return -1; // Empty
+
+  memcpy(&head, rec, sizeof(head));
+  if (level)
+    *level = head.level;
+  logStats.printed++;
+  return formatRecord(rec, &head, line, lineLen);
+}
+
+bool ubidotsLogStart(uint8_t prio)
+{
+  if (logStarted)
+    return true; // Already running
+
+  uint8_t rc = OSTaskCreatewName(logTask, nullptr, &logStack[USER_TASK_STK_SIZE], logStack, prio, "Ubidots log");
+  logStarted = (rc == OS_NO_ERR);
+  return logStarted;
+}
+
+void ubidotsLogGetStats(ubidots_log_stats_t *stats)
+{
+  USER_ENTER_CRITICAL();
+  *stats = logStats;
+  USER_EXIT_CRITICAL();
+}
+/*------------------------------------------------*/
@@ -0,0 +1,126 @@
+/**
+ * @file ubidotslog.h
+ *
+ * @brief Leveled, deferred console log
+ *
+ * Messages below UBIDOTS_LOG_LEVEL are compiled out, format and arguments
+ * included. The others are not formatted by the caller: a binary record, the
+ * format pointer and the raw arguments, goes into a ring buffer and a low
+ * priority task formats and prints it, so a publish no longer waits for the
+ * UART. String arguments are copied into the record, up to
+ * UBIDOTS_LOG_STRING_MAX_LEN bytes, as they rarely outlive the call.
+ *
+ * The format must be a string literal. Conversions d i u o x X c s p and %%
+ * are supported, with flags, width, precision (* too) and the h hh l ll z j t
+ * length modifiers; floating point is not, as with iprintf. When the ring is
+ * full the record is dropped and counted.
+ *
+ */
+
+#ifndef UBIDOTSLOG_H_
+#define UBIDOTSLOG_H_
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*---------------------  Definitions ---------------------*/
+#define UBIDOTS_LOG_LEVEL_NONE 0  /*!< Nothing */
+#define UBIDOTS_LOG_LEVEL_ERROR 1 /*!< Failures */
+#define UBIDOTS_LOG_LEVEL_WARN 2  /*!< Degraded, but working */
+#define UBIDOTS_LOG_LEVEL_INFO 3  /*!< Connection changes */
+#define UBIDOTS_LOG_LEVEL_DEBUG 4 /*!< Every message */
+
+#ifndef UBIDOTS_LOG_LEVEL
+#define UBIDOTS_LOG_LEVEL UBIDOTS_LOG_LEVEL_INFO /*!< Messages above this level are compiled out */
+#endif
+#ifndef UBIDOTS_LOG_DEFERRED
+#define UBIDOTS_LOG_DEFERRED 1                   /*!< 0 to print in the caller, as before */
+#endif
+#define UBIDOTS_LOG_BUFFER_LEN 4096              /*!< Ring buffer of the records */
+#define UBIDOTS_LOG_RECORD_MAX_LEN 256           /*!< Largest record, arguments that do not fit are left out */
+#define UBIDOTS_LOG_STRING_MAX_LEN 96            /*!< Longest string argument kept */
+#define UBIDOTS_LOG_LINE_MAX_LEN 512             /*!< Longest formatted message */
+#define UBIDOTS_LOG_PRIO (MAIN_PRIO + 8)         /*!< Log task priority, below the application */
+
+#if UBIDOTS_LOG_LEVEL >= UBIDOTS_LOG_LEVEL_ERROR
+#define UBIDOTS_LOGE(on, ...) do { if (on) ubidotsLog(UBIDOTS_LOG_LEVEL_ERROR, __VA_ARGS__); } while (0) /*!< Error if on */
+#else
+#define UBIDOTS_LOGE(on, ...) do { } while (0)
+#endif
+#if UBIDOTS_LOG_LEVEL >= UBIDOTS_LOG_LEVEL_WARN
+#define UBIDOTS_LOGW(on, ...) do { if (on) ubidotsLog(UBIDOTS_LOG_LEVEL_WARN, __VA_ARGS__); } while (0) /*!< Warning if on */
+#else
+#define UBIDOTS_LOGW(on, ...) do { } while (0)
+#endif
+#if UBIDOTS_LOG_LEVEL >= UBIDOTS_LOG_LEVEL_INFO
+#define UBIDOTS_LOGI(on, ...) do { if (on) ubidotsLog(UBIDOTS_LOG_LEVEL_INFO, __VA_ARGS__); } while (0) /*!< Info if on */
+#else
+#define UBIDOTS_LOGI(on, ...) do { } while (0)
+#endif
+#if UBIDOTS_LOG_LEVEL >= UBIDOTS_LOG_LEVEL_DEBUG
+#define UBIDOTS_LOGD(on, ...) do { if (on) ubidotsLog(UBIDOTS_LOG_LEVEL_DEBUG, __VA_ARGS__); } while (0) /*!< Debug if on */
+#else
+#define UBIDOTS_LOGD(on, ...) do { } while (0)
+#endif
+
+/**
+ * @brief Log counters.
+ *
+ */
+typedef struct
+{
+  uint32_t recorded; /*!< Records put in the ring */
+  uint32_t dropped;  /*!< Records lost, ring full */
+  uint32_t printed;  /*!< Records formatted */
+} ubidots_log_stats_t;
+/*------------------------------------------------*/
+
+/*---------------------  Functions ---------------------*/
+/**
+ * @brief Record a message, use the UBIDOTS_LOGx macros instead.
+ *
+ * @param level UBIDOTS_LOG_LEVEL_x
+ * @param format String literal, iprintf format
+ * @param ... Arguments
+ */
+void ubidotsLog(uint8_t level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Record a message.
+ *
+ * @param level UBIDOTS_LOG_LEVEL_x
+ * @param format String literal, iprintf format
+ * @param args Arguments
+ */
+void ubidotsLogV(uint8_t level, const char *format, va_list args);
+
+/**
+ * @brief Take the oldest record out of the ring and format it.
+ *
+ * @param line Output, NUL terminated, truncated to lineLen
+ * @param lineLen Size of line
+ * @param level Level of the record, may be nullptr
+ * @retval int Length of line, -1 when the ring is empty
+ */
+int ubidotsLogNext(char *line, size_t lineLen, uint8_t *level);
+
+/**
+ * @brief Start the task printing the records, once; later calls do nothing.
+ * Call it from a task, Ubidots::connect() does.
+ *
+ * @param prio Task priority
+ * @retval true Running
+ * @retval false Task not created, records wait in the ring
+ */
+bool ubidotsLogStart(uint8_t prio);
+
+/**
+ * @brief Get the log counters.
+ *
+ * @param stats Counters
+ */
+void ubidotsLogGetStats(ubidots_log_stats_t *stats);
+/*------------------------------------------------*/
+
+#endif /* UBIDOTSLOG_H_ */
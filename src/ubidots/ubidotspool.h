@@ -0,0 +1,250 @@
+/**
+ * @file ubidotspool.h
+ *
+ * @brief Pool of Ubidots MQTT connections with variables sharded by hash
+ *
+ * One MQTT::Client sends everything through one socket, and brokers limit the
+ * rate of each connection. The pool opens N connections for the same device
+ * and always publishes a variable on the connection its name hashes to, so the
+ * updates of a variable stay in order while the load spreads over N sockets.
+ *
+ * QoS0 publishes from one task already overlap on the wire. Publishes that
+ * wait for an ack block their task, so for QoS1 run one task per connection,
+ * each publishing the variables of shard(i) and calling its keepAlive().
+ * Every connection costs a whole Ubidots object, buffers included.
+ *
+ */
+
+#ifndef UBIDOTSPOOL_H_
+#define UBIDOTSPOOL_H_
+
+#include <new>
+
+#include <ubidots.h>
+
+/*---------------------  Definitions ---------------------*/
+#define UBIDOTS_POOL_CLIENT_ID_LEN 64 /*!< Max Len for the client ID of a connection, <device>-<n> */
+/*------------------------------------------------*/
+
+/*---------------------  Classes ---------------------*/
+template <int N>
+class UbidotsPool
+{
+private:
+  /*---------------------  Attributes ---------------------*/
+  alignas(Ubidots) uint8_t shards[N][sizeof(Ubidots)]; /*!< Connections, built in place */
+  char clientIds[N][UBIDOTS_POOL_CLIENT_ID_LEN];       /*!< MQTT client ID of each connection */
+  /*------------------------------------------------*/
+
+public:
+  /*---------------------  Constructor/Destructor ---------------------*/
+  /**
+   * @brief Construct a new pool, connections are made by connect().
+   *
+   * @param token Ubidots token to authenticate.
+   * @param device_name Ubidots device name.
+   * @param ssl Choose SSL or TCP. True for SSL.
+   * @param log True for print to the console.
+   */
+  UbidotsPool(const char *token, const char *device_name, bool ssl = false, bool log = true);
+
+  /**
+   * @brief Destroy the pool
+   *
+   */
+  ~UbidotsPool();
+  /*------------------------------------------------*/
+
+  /*--------------------- Methods  ---------------------*/
+  /**
+   * @brief Connect every connection not yet connected.
+   *
+   * @retval true All connected.
+   * @retval false Error
+   */
+  bool connect();
+
+  /**
+   * @brief Publish a variable on its connection.
+   *
+   * @param variable Variable name
+   * @param value Value of variable
+   * @retval true Published succesfully
+   * @retval false Error
+   */
+  bool publish(const char *variable, float value);
+
+  /**
+   * @brief MQTT keep alive and receive data on every connection.
+   *
+   * @retval true All good
+   * @retval false Error on some connection
+   */
+  bool keepAlive();
+
+  /**
+   * @brief Register a callback to an event of every connection
+   *
+   * @param event Event to register
+   * @param func_ptr Callback
+   */
+  void registerCallback(ubidots_events_t event, void (*func_ptr)(void *));
+
+  /**
+   * @brief Use another MQTT broker than the Ubidots one. Call it before connect().
+   *
+   * @param host Broker host name
+   * @param port Broker port, 0 for the default MQTT (1883) or SSL (8883) port
+   */
+  void setBroker(const char *host, uint16_t port = 0);
+
+  /**
+   * @brief Set the QoS used by publish on every connection.
+   *
+   * @param qos Quality of service
+   */
+  void setPublishQoS(MQTT::QoS qos);
+
+  /**
+   * @brief Get the connection of a variable. The same name always gives the
+   * same connection, so subscribe to a variable there too.
+   *
+   * @param variable Variable name
+   * @retval int Index of the connection
+   */
+  int shardOf(const char *variable) const;
+
+  /**
+   * @brief Get a connection.
+   *
+   * @param index Index of the connection, 0 to N - 1
+   * @retval Ubidots& Connection
+   */
+  Ubidots &shard(int index);
+
+  /**
+   * @brief Get MQTT is connected status
+   *
+   * @retval true Every connection connected
+   * @retval false Some connection disconnected
+   */
+  bool isConnected();
+  /*------------------------------------------------*/
+};
+/*------------------------------------------------*/
+
+/*---------------------  Constructor/Destructor Methods  ---------------------*/
+template <int N>
+UbidotsPool<N>::UbidotsPool(const char *token, const char *device_name, bool ssl, bool log)
+{
+  for (int i = 0; i < N; i++)
+  {
+    Ubidots *ubidots = new (this->shards[i]) Ubidots(token, device_name, ssl, log);
+
+    // Same device, a client ID per connection
+    sniprintf(this->clientIds[i], UBIDOTS_POOL_CLIENT_ID_LEN, "%s-%d", (device_name) ? device_name : UBIDOTS_DEFAULT_CLIENT_ID, i);
+    ubidots->setClientId(this->clientIds[i]);
+#if UBIDOTS_DISPATCH
+    ubidots->setDispatchPriority(UBIDOTS_DISPATCH_PRIO + i); // A task priority per connection
+#endif
+  }
+}
+
+template <int N>
+UbidotsPool<N>::~UbidotsPool()
+{
+  for (int i = 0; i < N; i++)
+  {
+    this->shard(i).~Ubidots();
+  }
+}
+/*------------------------------------------------*/
+
+/*---------------------  Public Methods  ---------------------*/
+template <int N>
+bool UbidotsPool<N>::connect()
+{
+  bool connected = true;
+
+  for (int i = 0; i < N; i++)
+  {
+    if (!this->shard(i).isConnected() && !this->shard(i).connect())
+      connected = false; // Retried by the next call
+  }
+  return connected;
+}
+
+template <int N>
+bool UbidotsPool<N>::publish(const char *variable, float value)
+{
+  if (variable == nullptr)
+    return false; // No variable name
+
+  return this->shard(this->shardOf(variable)).publish(variable, value);
+}
+
+template <int N>
+bool UbidotsPool<N>::keepAlive()
+{
+  bool alive = true;
+
+  for (int i = 0; i < N; i++)
+  {
+    if (this->shard(i).isConnected() && !this->shard(i).keepAlive())
+      alive = false;
+  }
+  return alive;
+}
+
+template <int N>
+void UbidotsPool<N>::registerCallback(ubidots_events_t event, void (*func_ptr)(void *))
+{
+  for (int i = 0; i < N; i++)
+  {
+    this->shard(i).registerCallback(event, func_ptr);
+  }
+}
+
+template <int N>
+void UbidotsPool<N>::setBroker(const char *host, uint16_t port)
+{
+  for (int i = 0; i < N; i++)
+  {
+    this->shard(i).setBroker(host, port);
+  }
+}
+
+template <int N>
+void UbidotsPool<N>::setPublishQoS(MQTT::QoS qos)
+{
+  for (int i = 0; i < N; i++)
+  {
+    this->shard(i).setPublishQoS(qos);
+  }
+}
+
+template <int N>
+int UbidotsPool<N>::shardOf(const char *variable) const
+{
+  return (int)(ubidotsNameHash(variable, strlen(variable)) % N);
+}
+
+template <int N>
+Ubidots &UbidotsPool<N>::shard(int index)
+{
+  return *reinterpret_cast<Ubidots *>(this->shards[index]);
+}
+
+template <int N>
+bool UbidotsPool<N>::isConnected()
+{
+  for (int i = 0; i < N; i++)
+  {
+    if (!this->shard(i).isConnected())
+      return false;
+  }
+  return true;
+}
+/*------------------------------------------------*/
+
+#endif /* UBIDOTSPOOL_H_ */
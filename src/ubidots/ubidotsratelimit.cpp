@@ -0,0 +1,106 @@
+/**
+ * @file ubidotsratelimit.cpp
+ *
+ * @brief Token bucket publish rate limiter
+ *
+ */
+
+#include <string.h>
+
+#include <ubidotsratelimit.h>
+
+/*---------------------  Definitions ---------------------*/
+#define RATE_TOKEN 1000000ULL /*!< One token, in millionths */
+/*------------------------------------------------*/
+
+/*---------------------  Private fuctions ---------------------*/
+static void bucketRefill(ubidots_bucket_t *bucket, uint32_t ms)
+{
+  if (bucket->rate == 0)
+    return; // No limit
+
+  // Thousandths per second times milliseconds is millionths
+  uint64_t add = (uint64_t)bucket->rate * ms;
+  bucket->level = (add >= bucket->burst - bucket->level) ? bucket->burst : bucket->level + add;
+}
+
+/**
+ * @brief Time until a bucket holds enough tokens.
+ *
+ * @param bucket Token bucket
+ * @param tokens Tokens needed, more than the burst waits for a full bucket
+ * @retval uint32_t Milliseconds to wait
+ */
+static uint32_t bucketWait(const ubidots_bucket_t *bucket, uint64_t tokens)
+{
+  if (bucket->rate == 0)
+    return 0; // No limit
+
+  uint64_t need = tokens * RATE_TOKEN;
+  if (need > bucket->burst)
+    need = bucket->burst;
+  if (bucket->level >= need)
+    return 0;
+  return (uint32_t)((need - bucket->level + bucket->rate - 1) / bucket->rate);
+}
+
+static void bucketTake(ubidots_bucket_t *bucket, uint64_t tokens)
+{
+  if (bucket->rate == 0)
+    return; // No limit
+
+  uint64_t need = tokens * RATE_TOKEN;
+  bucket->level = (need > bucket->level) ? 0 : bucket->level - need;
+}
+
+static void rateRefill(ubidots_rate_limit_t *limit, uint32_t nowMs)
+{
+  uint32_t ms = nowMs - limit->lastMs; // Wraps around
+
+  limit->lastMs = nowMs;
+  bucketRefill(&limit->messages, ms);
+  bucketRefill(&limit->bytes, ms);
+}
+/*------------------------------------------------*/
+
+/*---------------------  Public functions ---------------------*/
+void ubidotsRateInit(ubidots_rate_limit_t *limit, uint32_t nowMs)
+{
+  memset(limit, 0, sizeof(*limit));
+  limit->lastMs = nowMs;
+}
+
+void ubidotsRateSet(ubidots_bucket_t *bucket, float perSecond, uint32_t burst)
+{
+  bucket->rate = (perSecond > 0) ? (uint32_t)(perSecond * 1000.0f + 0.5f) : 0;
+  if (bucket->rate == 0 && perSecond > 0)
+    bucket->rate = 1; // Slowest rate, one token every 1000 s
+  bucket->burst = ((burst > 0) ? burst : 1) * RATE_TOKEN;
+  bucket->level = bucket->burst;
+}
+
+uint32_t ubidotsRateWait(ubidots_rate_limit_t *limit, size_t bytes, uint32_t nowMs)
+{
+  rateRefill(limit, nowMs);
+
+  uint32_t messagesMs = bucketWait(&limit->messages, 1);
+  uint32_t bytesMs = bucketWait(&limit->bytes, bytes);
+  return (messagesMs > bytesMs) ? messagesMs : bytesMs;
+}
+
+uint32_t ubidotsRateTake(ubidots_rate_limit_t *limit, size_t bytes, uint32_t nowMs)
+{
+  uint32_t waitMs = ubidotsRateWait(limit, bytes, nowMs);
+
+  if (waitMs > 0)
+  { // Not enough tokens in some bucket, take none
+    limit->limited++;
+    return waitMs;
+  }
+
+  bucketTake(&limit->messages, 1);
+  bucketTake(&limit->bytes, bytes);
+  limit->passed++;
+  return 0;
+}
+/*------------------------------------------------*/
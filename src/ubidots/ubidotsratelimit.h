@@ -0,0 +1,86 @@
+/**
+ * @file ubidotsratelimit.h
+ *
+ * @brief Token bucket publish rate limiter
+ *
+ * Two buckets, messages and bytes, refill at their rate up to their burst. A
+ * publish passes when both hold enough tokens and takes them; otherwise the
+ * limiter tells how long until it would pass, so the producer can wait, drop
+ * or coalesce. Rates are kept in thousandths of a token per second, so rates
+ * below one per second work too, and levels in millionths, which a rate adds
+ * exactly every millisecond. Time is given by the caller in milliseconds.
+ *
+ */
+
+#ifndef UBIDOTSRATELIMIT_H_
+#define UBIDOTSRATELIMIT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*---------------------  Definitions ---------------------*/
+/**
+ * @brief Token bucket.
+ *
+ */
+typedef struct
+{
+  uint32_t rate;  /*!< Thousandths of a token added per second, 0 for no limit */
+  uint64_t burst; /*!< Capacity, in millionths of a token */
+  uint64_t level; /*!< Millionths of a token available */
+} ubidots_bucket_t;
+
+/**
+ * @brief Publish rate limiter.
+ *
+ */
+typedef struct
+{
+  ubidots_bucket_t messages; /*!< One token per message */
+  ubidots_bucket_t bytes;    /*!< One token per payload byte */
+  uint32_t lastMs;           /*!< Time of the last refill */
+  uint32_t passed;           /*!< Publishes let through */
+  uint32_t limited;          /*!< Publishes refused */
+} ubidots_rate_limit_t;
+/*------------------------------------------------*/
+
+/*---------------------  Functions ---------------------*/
+/**
+ * @brief Init a limiter without limits.
+ *
+ * @param limit Rate limiter
+ * @param nowMs Current time
+ */
+void ubidotsRateInit(ubidots_rate_limit_t *limit, uint32_t nowMs);
+
+/**
+ * @brief Set the rate of a bucket, which starts full.
+ *
+ * @param bucket Token bucket
+ * @param perSecond Tokens per second, 0 for no limit
+ * @param burst Capacity in tokens, at least 1
+ */
+void ubidotsRateSet(ubidots_bucket_t *bucket, float perSecond, uint32_t burst);
+
+/**
+ * @brief Time until a publish would pass, without taking tokens.
+ *
+ * @param limit Rate limiter
+ * @param bytes Payload length
+ * @param nowMs Current time
+ * @retval uint32_t Milliseconds to wait, 0 when it passes now
+ */
+uint32_t ubidotsRateWait(ubidots_rate_limit_t *limit, size_t bytes, uint32_t nowMs);
+
+/**
+ * @brief Take the tokens of a publish if it passes.
+ *
+ * @param limit Rate limiter
+ * @param bytes Payload length
+ * @param nowMs Current time
+ * @retval uint32_t 0 when it passes, else the milliseconds to wait and no token is taken
+ */
+uint32_t ubidotsRateTake(ubidots_rate_limit_t *limit, size_t bytes, uint32_t nowMs);
+/*------------------------------------------------*/
+
+#endif /* UBIDOTSRATELIMIT_H_ */
@@ -0,0 +1,162 @@
+/**
+ * @file ubidotsstats.cpp
+ *
+ * @brief JSON of the Ubidots statistics, for the dashboard page
+ *
+ */
+
+#include <string.h>
+
+#include <ubidotsstats.h>
+
+/*---------------------  Definitions ---------------------*/
+/**
+ * @brief JSON being written.
+ *
+ */
+typedef struct
+{
+  char *buf;     /*!< Output */
+  size_t bufLen; /*!< Size of buf */
+  size_t len;    /*!< Length written */
+  bool full;     /*!< Something did not fit */
+} stats_writer_t;
+/*------------------------------------------------*/
+
+/*---------------------  Private fuctions ---------------------*/
+static void put(stats_writer_t *w, const char *str)
+{
+  size_t len = strlen(str);
+
+  if (w->full || w->len + len >= w->bufLen)
+  { // Keep room for the NUL
+    w->full = true;
+    return;
+  }
+  memcpy(w->buf + w->len, str, len);
+  w->len += len;
+}
+
+static void putU32(stats_writer_t *w, uint32_t n)
+{
+  char tmp[11];
+  int i = sizeof(tmp) - 1;
+
+  tmp[i] = '\0';
+  do
+  {
+    tmp[--i] = (char)('0' + n % 10);
+    n /= 10;
+  } while (n != 0);
+  put(w, tmp + i);
+}
+
+/**
+ * @brief Write ,"key":n, or "key":n as the first member.
+ *
+ */
+static void putField(stats_writer_t *w, const char *key, uint32_t n, bool first = false)
+{
+  put(w, first ? "\"" : ",\"");
+  put(w, key);
+  put(w, "\":");
+  putU32(w, n);
+}
+
+static void putArray(stats_writer_t *w, const char *key, const uint32_t *values, int count)
+{
+  put(w, ",\"");
+  put(w, key);
+  put(w, "\":[");
+  for (int i = 0; i < count; i++)
+  {
+    if (i > 0)
+      put(w, ",");
+    putU32(w, values[i]);
+  }
+  put(w, "]");
+}
+
+#if MQTTCLIENT_STATS || MQTTCLIENT_PROFILE
+static void putHistogram(stats_writer_t *w, const char *key, const NBMQTTHistogram &histogram, bool first = false)
+{
+  int used = NBMQTT_HISTOGRAM_BUCKETS;
+
+  while (used > 0 && histogram.buckets[used - 1] == 0)
+    used--; // Trim the empty tail
+
+  put(w, first ? "\"" : ",\"");
+  put(w, key);
+  put(w, "\":{");
+  putField(w, "n", histogram.count, true);
+  putField(w, "p50", histogram.percentile(50));
+  putField(w, "p99", histogram.percentile(99));
+  putField(w, "max", histogram.max);
+  putArray(w, "b", histogram.buckets, used);
+  put(w, "}");
+}
+#endif
+/*------------------------------------------------*/
+
+/*---------------------  Public functions ---------------------*/
+int ubidotsStatsJson(char *buf, size_t bufLen, const ubidots_stats_t *stats)
+{
+  stats_writer_t w = {buf, bufLen, 0, false};
+
+  if (bufLen == 0)
+    return -1; // No room for the NUL
+
+  put(&w, "{");
+  putField(&w, "now", stats->nowMs, true);
+  putField(&w, "connected", stats->connected);
+  putField(&w, "publishes", stats->ubidots.publishes);
+  putField(&w, "publishErrors", stats->ubidots.publishErrors);
+  putField(&w, "rateLimited", stats->rateLimited);
+  putField(&w, "connects", stats->ubidots.connects);
+  putField(&w, "reconnects", stats->ubidots.reconnects);
+  putField(&w, "disconnects", stats->ubidots.disconnects);
+  putField(&w, "connectedMs", stats->ubidots.connectedMs);
+  putField(&w, "dispatchDepth", stats->dispatchDepth);
+  putField(&w, "gatewayQueued", stats->gatewayQueued);
+
+  put(&w, ",\"history\":[");
+  for (int i = 0; i < stats->historyCount; i++)
+  {
+    put(&w, (i > 0) ? ",[" : "[");
+    putU32(&w, stats->history[i].atMs);
+    put(&w, ",");
+    putU32(&w, stats->history[i].upMs);
+    put(&w, "]");
+  }
+  put(&w, "]");
+
+#if MQTTCLIENT_STATS
+  put(&w, ",\"client\":{");
+  putField(&w, "bytesIn", stats->client.bytesIn, true);
+  putField(&w, "bytesOut", stats->client.bytesOut);
+  putField(&w, "sendErrors", stats->client.sendErrors);
+  putArray(&w, "in", stats->client.packetsIn, NBMQTT_PACKET_TYPES);
+  putArray(&w, "out", stats->client.packetsOut, NBMQTT_PACKET_TYPES);
+  putHistogram(&w, "send", stats->client.sendUs);
+  putHistogram(&w, "ack", stats->client.ackUs);
+  put(&w, "}");
+#endif
+#if MQTTCLIENT_PROFILE
+  put(&w, ",\"stagesNs\":{");
+  for (int i = 0; i < NBMQTT_STAGES; i++)
+  {
+    putHistogram(&w, NBMQTTProfile::name(i), stats->profile.stages[i], i == 0);
+  }
+  put(&w, "}");
+#endif
+  put(&w, "}");
+
+  if (w.full)
+  {
+    buf[0] = '\0';
+    return -1;
+  }
+  buf[w.len] = '\0';
+  return (int)w.len;
+}
+/*------------------------------------------------*/
@@ -0,0 +1,42 @@
+/**
+ * @file ubidotsstats.h
+ *
+ * @brief JSON of the Ubidots statistics, for the dashboard page
+ *
+ * Written into a caller buffer without heap allocation, the histograms trimmed
+ * after their last used bucket:
+ * {"now":...,"connected":1,...,"history":[[atMs,upMs],...],
+ *  "client":{"in":[16 counts],"out":[16 counts],...,"ack":{"n":..,"p50":..,"p99":..,"max":..,"b":[...]}},
+ *  "stagesNs":{"serialize":{...},...,"handler":{...}}}
+ * stagesNs only with MQTTCLIENT_PROFILE.
+ *
+ */
+
+#ifndef UBIDOTSSTATS_H_
+#define UBIDOTSSTATS_H_
+
+#include <stddef.h>
+
+#include <ubidots.h>
+
+/*---------------------  Definitions ---------------------*/
+#if MQTTCLIENT_PROFILE
+#define UBIDOTS_STATS_JSON_MAX_LEN (2048 + NBMQTT_STAGES * 448) /*!< Longest JSON, every counter at its maximum */
+#else
+#define UBIDOTS_STATS_JSON_MAX_LEN 2048 /*!< Longest JSON, every counter at its maximum */
+#endif
+/*------------------------------------------------*/
+
+/*---------------------  Functions ---------------------*/
+/**
+ * @brief Write the JSON of a statistics snapshot.
+ *
+ * @param buf Output buffer, NUL terminated
+ * @param bufLen Size of buf, UBIDOTS_STATS_JSON_MAX_LEN always fits
+ * @param stats Snapshot from Ubidots::getStats()
+ * @retval int JSON length, -1 if it does not fit
+ */
+int ubidotsStatsJson(char *buf, size_t bufLen, const ubidots_stats_t *stats);
+/*------------------------------------------------*/
+
+#endif /* UBIDOTSSTATS_H_ */
@@ -0,0 +1,287 @@
+/**
+ * @file ubidotsvalue.cpp
+ *
+ * @brief Zero-copy value extraction from inbound Ubidots messages
+ *
+ */
+
+#include <string.h>
+
+#include <MQTTClient.h>
+
+#include <ubidotsvalue.h>
+
+/*---------------------  Definitions ---------------------*/
+#define VALUE_MAX_DIGITS 19    /*!< Significant digits that fit in the 64 bit mantissa */
+#define VALUE_MAX_EXPONENT 400 /*!< Past this any double is 0 or Inf anyway */
+/*------------------------------------------------*/
+
+/*---------------------  Globals ---------------------*/
+static const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                               1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+/*------------------------------------------------*/
+
+/*---------------------  Private fuctions ---------------------*/
+static inline bool isDigit(char c)
+{
+  return c >= '0' && c <= '9';
+}
+
+static const char *skipSpace(const char *p, const char *end)
+{
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+    p++;
+  return p;
+}
+
+/**
+ * @brief Parse a JSON number. Up to 19 significant digits are kept, scaled by
+ * an exact power of ten, which is far more precision than a float needs.
+ *
+ * @param p Start of the number
+ * @param end End of the payload
+ * @param out Number
+ * @retval const char* End of the number, nullptr if there is none
+ */
+static const char *parseNumber(const char *p, const char *end, double *out)
+{
+  bool negative = false;
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+
+  if (p < end && *p == '-')
+  {
+    negative = true;
+    p++;
+  }
+  if (p == end || !isDigit(*p))
+    return nullptr;
+
+  for (; p < end && isDigit(*p); p++)
+  {
+    if (digits < VALUE_MAX_DIGITS)
+    {
+      mantissa = mantissa * 10 + (*p - '0');
+      digits += (mantissa != 0);
+    }
+    else
+      exponent++; // Digit dropped
+  }
+
+  if (p < end && *p == '.')
+  {
+    if (++p == end || !isDigit(*p))
+      return nullptr;
+    for (; p < end && isDigit(*p); p++)
+    {
+      if (digits < VALUE_MAX_DIGITS)
+      {
+        mantissa = mantissa * 10 + (*p - '0');
+        digits += (mantissa != 0);
+        exponent--;
+      }
+    }
+  }
+
+  if (p < end && (*p == 'e' || *p == 'E'))
+  {
+    bool negativeExp = false;
+    int exp = 0;
+
+    if (++p < end && (*p == '+' || *p == '-'))
+      negativeExp = (*p++ == '-');
+    if (p == end || !isDigit(*p))
+      return nullptr;
+    for (; p < end && isDigit(*p); p++)
+    {
+      if (exp < VALUE_MAX_EXPONENT)
+        exp = exp * 10 + (*p - '0');
+    }
+    exponent += negativeExp ? -exp : exp;
+  }
+
+  double v = (double)mantissa;
+  if (exponent < 0)
+  {
+    for (; exponent < -22 && v != 0; exponent += 22)
+      v /= POW10[22];
+    v /= POW10[(exponent < -22) ? 22 : -exponent];
+  }
+  else
+  {
+    for (; exponent > 22 && v != 0; exponent -= 22)
+      v *= POW10[22];
+    v *= POW10[(exponent > 22) ? 22 : exponent];
+  }
+
+  *out = negative ? -v : v;
+  return p;
+}
+
+/**
+ * @brief Parse a number, true or false.
+ *
+ * @param p Start of the value
+ * @param end End of the payload
+ * @param out Value
+ * @retval const char* End of the value, nullptr if it is not one of those
+ */
+static const char *parseScalar(const char *p, const char *end, double *out)
+{
+  if (end - p >= 4 && memcmp(p, "true", 4) == 0)
+  {
+    *out = 1;
+    return p + 4;
+  }
+  if (end - p >= 5 && memcmp(p, "false", 5) == 0)
+  {
+    *out = 0;
+    return p + 5;
+  }
+  return parseNumber(p, end, out);
+}
+
+static const char *skipString(const char *p, const char *end)
+{
+  for (p++; p < end; p++)
+  { // p starts at the opening quote
+    if (*p == '\\')
+    { // Escaped character
+      if (++p == end)
+        return nullptr;
+    }
+    else if (*p == '"')
+      return p + 1;
+  }
+  return nullptr;
+}
+
+/**
+ * @brief Skip any JSON value, objects and arrays included.
+ *
+ * @param p Start of the value
+ * @param end End of the payload
+ * @retval const char* End of the value, nullptr if it is malformed
+ */
+static const char *skipValue(const char *p, const char *end)
+{
+  if (p == end)
+    return nullptr;
+  if (*p == '"')
+    return skipString(p, end);
+
+  if (*p == '{' || *p == '[')
+  {
+    int depth = 0;
+    while (p < end)
+    {
+      if (*p == '"')
+      {
+        if ((p = skipString(p, end)) == nullptr)
+          return nullptr;
+        continue;
+      }
+      if (*p == '{' || *p == '[')
+        depth++;
+      else if ((*p == '}' || *p == ']') && --depth == 0)
+        return p + 1;
+      p++;
+    }
+    return nullptr; // Unterminated
+  }
+
+  const char *start = p; // Number or literal
+  while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+    p++;
+  return (p > start) ? p : nullptr;
+}
+
+static bool keyIs(const char *key, size_t keyLen, const char *name, size_t nameLen)
+{
+  return keyLen == nameLen && memcmp(key, name, nameLen) == 0;
+}
+/*------------------------------------------------*/
+
+/*---------------------  Public functions ---------------------*/
+bool ubidotsParseValue(const void *payload, size_t payloadLen, ubidots_value_t *value)
+{
+  const char *p = (const char *)payload;
+  const char *end = p + payloadLen;
+  bool found = false;
+
+  value->value = 0;
+  value->timestamp = 0;
+  value->context = nullptr;
+  value->contextLen = 0;
+
+  p = skipSpace(p, end);
+  if (p < end && *p != '{')
+  { // Bare value, the /lv topic
+    p = parseScalar(p, end, &value->value);
+    return p != nullptr && skipSpace(p, end) == end;
+  }
+
+  if (p == end || (p = skipSpace(p + 1, end)) == end)
+    return false;
+  if (*p == '}')
+    return false; // Empty object, no value
+
+  for (;;)
+  {
+    if (p == end || *p != '"')
+      return false;
+    const char *key = p + 1;
+    if ((p = skipString(p, end)) == nullptr)
+      return false;
+    size_t keyLen = p - 1 - key;
+
+    p = skipSpace(p, end);
+    if (p == end || *p != ':')
+      return false;
+    p = skipSpace(p + 1, end);
+
+    if (keyIs(key, keyLen, "value", 5))
+    {
+      p = parseScalar(p, end, &value->value);
+      found = true;
+    }
+    else if (keyIs(key, keyLen, "timestamp", 9))
+    {
+      double timestamp;
+      if ((p = parseNumber(p, end, &timestamp)) != nullptr)
+        value->timestamp = (int64_t)timestamp;
+    }
+    else if (keyIs(key, keyLen, "context", 7))
+    {
+      const char *context = p;
+      if ((p = skipValue(p, end)) != nullptr)
+      {
+        value->context = context;
+        value->contextLen = p - context;
+      }
+    }
+    else
+      p = skipValue(p, end);
+
+    if (p == nullptr)
+      return false;
+    p = skipSpace(p, end);
+    if (p < end && *p == ',')
+    {
+      p = skipSpace(p + 1, end);
+      continue;
+    }
+    if (p < end && *p == '}')
+      break;
+    return false;
+  }
+
+  return found && skipSpace(p + 1, end) == end;
+}
+
+bool ubidotsParseValue(const MQTT::Message &message, ubidots_value_t *value)
+{
+  return ubidotsParseValue(message.payload, message.payloadlen, value);
+}
+/*------------------------------------------------*/
@@ -0,0 +1,61 @@
+/**
+ * @file ubidotsvalue.h
+ *
+ * @brief Zero-copy value extraction from inbound Ubidots messages
+ *
+ * Ubidots sends a variable either as a bare number, on the /lv topic, or as
+ * {"value": 21.5, "timestamp": 1700000000000, "context": {...}} on the variable
+ * topic. The parser reads the payload in place, never past payloadlen and
+ * without a NUL terminator, so the message buffer is left untouched.
+ *
+ */
+
+#ifndef UBIDOTSVALUE_H_
+#define UBIDOTSVALUE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace MQTT
+{
+  struct Message;
+}
+
+/*---------------------  Definitions ---------------------*/
+/**
+ * @brief Value of a Ubidots variable.
+ *
+ */
+typedef struct
+{
+  double value;        /*!< Value, true/false read as 1/0 */
+  int64_t timestamp;   /*!< Milliseconds since the epoch, 0 when absent */
+  const char *context; /*!< Context JSON, points into the payload, nullptr when absent */
+  size_t contextLen;   /*!< Context JSON length */
+} ubidots_value_t;
+/*------------------------------------------------*/
+
+/*---------------------  Functions ---------------------*/
+/**
+ * @brief Parse a Ubidots value payload.
+ *
+ * @param payload Payload, not NUL terminated
+ * @param payloadLen Payload length
+ * @param value Parsed value
+ * @retval true Parsed
+ * @retval false Malformed payload, or an object without "value"
+ */
+bool ubidotsParseValue(const void *payload, size_t payloadLen, ubidots_value_t *value);
+
+/**
+ * @brief Parse the payload of a received message.
+ *
+ * @param message Message given to a subscribe handler
+ * @param value Parsed value
+ * @retval true Parsed
+ * @retval false Malformed payload
+ */
+bool ubidotsParseValue(const MQTT::Message &message, ubidots_value_t *value);
+/*------------------------------------------------*/
+
+#endif /* UBIDOTSVALUE_H_ */
@@ -0,0 +1,81 @@
+/**
+ * @file ubidotsvariables.cpp
+ *
+ * @brief Variable name table of the wildcard subscription
+ *
+ */
+
+#include <string.h>
+
+#include <ubidotsvariables.h>
+
+static_assert((UBIDOTS_WILDCARD_SLOTS & (UBIDOTS_WILDCARD_SLOTS - 1)) == 0, "UBIDOTS_WILDCARD_SLOTS must be a power of two");
+static_assert(UBIDOTS_WILDCARD_SLOTS > UBIDOTS_WILDCARD_MAX_VARIABLES, "UBIDOTS_WILDCARD_SLOTS must exceed UBIDOTS_WILDCARD_MAX_VARIABLES");
+static_assert(UBIDOTS_VARIABLE_MAX_LEN <= 256, "variable name lengths are stored in a byte");
+
+/*---------------------  Private fuctions ---------------------*/
+/**
+ * @brief Find the slot of a name, or the free slot where it would go.
+ *
+ * @param table Variable table
+ * @param name Variable name
+ * @param len Variable name length
+ * @retval size_t Slot
+ */
+static size_t variableSlot(const ubidots_variables_t *table, const char *name, size_t len)
+{
+  size_t slot = ubidotsNameHash(name, len) & (UBIDOTS_WILDCARD_SLOTS - 1);
+
+  // Never full, there are more slots than variables
+  for (; table->slots[slot] != 0; slot = (slot + 1) & (UBIDOTS_WILDCARD_SLOTS - 1))
+  {
+    int index = table->slots[slot] - 1;
+    if (table->lens[index] == len && memcmp(table->names[index], name, len) == 0)
+      break;
+  }
+  return slot;
+}
+/*------------------------------------------------*/
+
+/*---------------------  Public functions ---------------------*/
+uint32_t ubidotsNameHash(const char *name, size_t len)
+{
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < len; i++)
+    h = (h ^ (uint8_t)name[i]) * 16777619u;
+  return h;
+}
+
+void ubidotsVariablesInit(ubidots_variables_t *table)
+{
+  memset(table->slots, 0, sizeof(table->slots));
+  table->count = 0;
+}
+
+int ubidotsVariablesAdd(ubidots_variables_t *table, const char *name, size_t len)
+{
+  if (len >= UBIDOTS_VARIABLE_MAX_LEN)
+    return -1; // Name too long
+
+  size_t slot = variableSlot(table, name, len);
+  if (table->slots[slot] != 0)
+    return table->slots[slot] - 1; // Already there
+  if (table->count >= UBIDOTS_WILDCARD_MAX_VARIABLES)
+    return -1; // Table full
+
+  int index = table->count++;
+  memcpy(table->names[index], name, len);
+  table->names[index][len] = '\0';
+  table->lens[index] = (uint8_t)len;
+  table->slots[slot] = (uint16_t)(index + 1);
+  return index;
+}
+
+int ubidotsVariablesFind(const ubidots_variables_t *table, const char *name, size_t len)
+{
+  if (len >= UBIDOTS_VARIABLE_MAX_LEN)
+    return -1; // Can not be there
+
+  return table->slots[variableSlot(table, name, len)] - 1;
+}
+/*------------------------------------------------*/
@@ -0,0 +1,83 @@
+/**
+ * @file ubidotsvariables.h
+ *
+ * @brief Variable name table of the wildcard subscription
+ *
+ * Maps the variable segment of a /v1.6/devices/<device>/<variable>/lv topic to
+ * a dense index, with an open addressed hash table so a lookup costs one hash
+ * and, almost always, one compare whatever the number of variables. Names are
+ * copied in, the topic they come from can be a transient message buffer.
+ *
+ */
+
+#ifndef UBIDOTSVARIABLES_H_
+#define UBIDOTSVARIABLES_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*---------------------  Definitions ---------------------*/
+#ifndef UBIDOTS_WILDCARD_MAX_VARIABLES
+#define UBIDOTS_WILDCARD_MAX_VARIABLES 32 /*!< Variables of the wildcard subscription, 0 to disable it */
+#endif
+#ifndef UBIDOTS_WILDCARD_SLOTS
+#define UBIDOTS_WILDCARD_SLOTS 64         /*!< Hash slots, a power of two above UBIDOTS_WILDCARD_MAX_VARIABLES */
+#endif
+#ifndef UBIDOTS_VARIABLE_MAX_LEN
+#define UBIDOTS_VARIABLE_MAX_LEN 32       /*!< Longest variable name, with the terminator */
+#endif
+
+/**
+ * @brief Variable name table.
+ *
+ */
+typedef struct
+{
+  char names[UBIDOTS_WILDCARD_MAX_VARIABLES][UBIDOTS_VARIABLE_MAX_LEN]; /*!< Variable names, by index */
+  uint8_t lens[UBIDOTS_WILDCARD_MAX_VARIABLES];                         /*!< Variable name lengths, by index */
+  uint16_t slots[UBIDOTS_WILDCARD_SLOTS];                               /*!< Index + 1 of the name hashed there, 0 when free */
+  uint16_t count;                                                       /*!< Variables in the table */
+} ubidots_variables_t;
+/*------------------------------------------------*/
+
+/*---------------------  Functions ---------------------*/
+/**
+ * @brief Hash of a variable or device name, FNV-1a.
+ *
+ * @param name Name, not NUL terminated
+ * @param len Name length
+ * @retval uint32_t Hash
+ */
+uint32_t ubidotsNameHash(const char *name, size_t len);
+
+/**
+ * @brief Init an empty table.
+ *
+ * @param table Variable table
+ */
+void ubidotsVariablesInit(ubidots_variables_t *table);
+
+/**
+ * @brief Add a variable, or find it if it is already there.
+ *
+ * @param table Variable table
+ * @param name Variable name, not NUL terminated
+ * @param len Variable name length
+ * @retval >=0 Index of the variable
+ * @retval -1 Table full or name too long
+ */
+int ubidotsVariablesAdd(ubidots_variables_t *table, const char *name, size_t len);
+
+/**
+ * @brief Find a variable.
+ *
+ * @param table Variable table
+ * @param name Variable name, not NUL terminated
+ * @param len Variable name length
+ * @retval >=0 Index of the variable
+ * @retval -1 Not in the table
+ */
+int ubidotsVariablesFind(const ubidots_variables_t *table, const char *name, size_t len);
+/*------------------------------------------------*/
+
+#endif /* UBIDOTSVARIABLES_H_ */
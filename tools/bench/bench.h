@@ -0,0 +1,97 @@
+/**
+ * @file bench.h
+ *
+ * @brief Minimal timing harness shared by the host benchmarks.
+ *
+ * A benchmark is a function that performs one operation and returns the
+ * number of bytes it produced or consumed. bench_run() calibrates the
+ * iteration count until a run lasts at least the requested time, keeps the
+ * fastest of a few runs and prints one line with ns/op and bytes/op.
+ */
+
+#ifndef BENCH_H_
+#define BENCH_H_
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_MIN_MS 200 /*!< Default minimum duration of a measured run */
+#define BENCH_REPEATS 3          /*!< Measured runs, the fastest is reported */
+
+typedef int (*bench_fn_t)(void* ctx);
+
+typedef struct
+{
+	const char* filter; /*!< Only run benchmarks whose name contains this, NULL runs all */
+	int min_ms;         /*!< Minimum duration of one measured run */
+} bench_config_t;
+
+/** Sink that keeps the compiler from discarding benchmark results */
+static volatile long bench_sink;
+
+static inline long long bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline void bench_header(void)
+{
+	printf("%-48s %12s %10s %10s\n", "benchmark", "iterations", "ns/op", "bytes/op");
+}
+
+/**
+ * Times fn and prints one result line
+ * @param config run configuration
+ * @param name benchmark name, printed and matched against config->filter
+ * @param fn operation to measure
+ * @param ctx argument passed to fn
+ * @return the measured ns/op, or -1 if the benchmark was filtered out
+ */
+static inline double bench_run(const bench_config_t* config, const char* name, bench_fn_t fn, void* ctx)
+{
+	long long iterations = 1;
+	long long budget_ns = (long long)config->min_ms * 1000000LL;
+	double best = -1;
+	long bytes = 0;
+	int r;
+
+	if (config->filter && strstr(name, config->filter) == NULL)
+		return -1;
+
+	for (;;) /* calibrate */
+	{
+		long long i, start = bench_now_ns(), elapsed;
+
+		for (i = 0; i < iterations; ++i)
+			bytes = fn(ctx);
+		elapsed = bench_now_ns() - start;
+		if (elapsed >= budget_ns / 4)
+		{
+			iterations = (long long)((double)iterations * budget_ns / (elapsed ? elapsed : 1)) + 1;
+			break;
+		}
+		iterations *= 4;
+	}
+
+	for (r = 0; r < BENCH_REPEATS; ++r)
+	{
+		long long i, start = bench_now_ns();
+		double ns;
+
+		for (i = 0; i < iterations; ++i)
+			bench_sink += fn(ctx);
+		ns = (double)(bench_now_ns() - start) / iterations;
+		if (best < 0 || ns < best)
+			best = ns;
+	}
+
+	printf("%-48s %12lld %10.2f %10ld\n", name, iterations, best, bytes);
+	fflush(stdout);
+	return best;
+}
+
+#endif /* BENCH_H_ */
@@ -0,0 +1,386 @@
+/**
+ * @file codec_bench.c
+ *
+ * @brief Microbenchmarks of the mqtt-paho packet codecs.
+ *
+ * Sweeps topic and payload sizes over the functions on the publish and
+ * subscribe paths and prints ns/op and bytes/op (bytes written by a
+ * serializer, bytes parsed by a deserializer).
+ *
+ *   codec-bench [-f filter] [-t ms]
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "MQTTPacket.h"
+#include "bench.h"
+
+#define CODEC_BUF_SIZE 4096
+#define DISPATCH_FILTERS 20
+#define DISPATCH_VARIABLE "var19"           /* last of the DISPATCH_FILTERS variables */
+
+static const int topic_sizes[] = {16, 32, 64, 128};
+static const int payload_sizes[] = {0, 16, 64, 256, 1024};
+static const int remaining_lengths[] = {100, 10000, 1000000, 100000000}; /* 1, 2, 3 and 4 encoded bytes */
+static const int device_sizes[] = {8, 32, 96};
+static const char* match_filters[] = {"/v1.6/devices/%s/" DISPATCH_VARIABLE "/lv", "/v1.6/devices/%s/+/lv", "/v1.6/devices/+/+/lv", "/v1.6/devices/%s/#"};
+static const char* match_names[] = {"literal", "plus", "plus2", "hash"};
+
+typedef struct
+{
+	unsigned char buf[CODEC_BUF_SIZE];  /*!< Serialization output / deserialization input */
+	unsigned char payload[CODEC_BUF_SIZE];
+	char topic[256];
+	char other[256];                    /*!< Same length as topic, differs in the last byte */
+	char filters[DISPATCH_FILTERS][256];
+	int filterlens[DISPATCH_FILTERS];
+	int prefixlen;                      /*!< Literal levels shared by all filters */
+	const char* filter;                 /*!< Filter of the matches cases */
+	MQTTString topicName;
+	int payloadlen;
+	int packetlen;
+	int value;
+} codec_ctx_t;
+
+/*---------------------  Benchmarks ---------------------*/
+static int bench_serialize_publish(void* arg)
+{
+	codec_ctx_t* c = arg;
+
+	return MQTTSerialize_publish(c->buf, sizeof(c->buf), 0, 1, 0, 1234, c->topicName, c->payload, c->payloadlen);
+}
+
+
+static int bench_deserialize_publish(void* arg)
+{
+	codec_ctx_t* c = arg;
+	unsigned char dup, retained, *payload;
+	unsigned short packetid;
+	int qos, payloadlen;
+	MQTTString topicName = MQTTString_initializer;
+
+	MQTTDeserialize_publish(&dup, &qos, &retained, &packetid, &topicName, &payload, &payloadlen, c->buf, c->packetlen);
+	return c->packetlen + (payloadlen & 0);
+}
+
+
+static int bench_serialize_ack(void* arg)
+{
+	codec_ctx_t* c = arg;
+
+	return MQTTSerialize_ack(c->buf, sizeof(c->buf), PUBACK, 0, 1234);
+}
+
+
+static int bench_deserialize_ack(void* arg)
+{
+	codec_ctx_t* c = arg;
+	unsigned char type, dup;
+	unsigned short packetid;
+
+	MQTTDeserialize_ack(&type, &dup, &packetid, c->buf, c->packetlen);
+	return c->packetlen + (packetid & 0);
+}
+
+
+static int bench_encode(void* arg)
+{
+	codec_ctx_t* c = arg;
+
+	return MQTTPacket_encode(c->buf, c->value);
+}
+
+
+static int bench_decode_buf(void* arg)
+{
+	codec_ctx_t* c = arg;
+	int value;
+
+	return MQTTPacket_decodeBuf(c->buf, &value) + (value & 0);
+}
+
+
+/* MQTTPacket_decodeBuf before it was made reentrant: a file static cursor
+ * read one byte at a time through a callback. Kept for comparison. */
+static unsigned char* callback_ptr;
+
+static int callback_getchar(unsigned char* c, int count)
+{
+	int i;
+
+	for (i = 0; i < count; ++i)
+		*c = *callback_ptr++;
+	return count;
+}
+
+
+static int bench_decode_callback(void* arg)
+{
+	codec_ctx_t* c = arg;
+	int value;
+
+	callback_ptr = c->buf;
+	return MQTTPacket_decode(callback_getchar, &value) + (value & 0);
+}
+
+
+static int bench_serialize_subscribe(void* arg)
+{
+	codec_ctx_t* c = arg;
+	int qos = 1;
+
+	return MQTTSerialize_subscribe(c->buf, sizeof(c->buf), 0, 1234, 1, &c->topicName, &qos);
+}
+
+
+static int bench_equals_match(void* arg)
+{
+	codec_ctx_t* c = arg;
+
+	return MQTTPacket_equals(&c->topicName, c->topic) ? c->topicName.lenstring.len : 0;
+}
+
+
+static int bench_equals_mismatch(void* arg)
+{
+	codec_ctx_t* c = arg;
+
+	return MQTTPacket_equals(&c->topicName, c->other) ? 0 : c->topicName.lenstring.len;
+}
+
+
+/* MQTTPacket_equals before it compared a word at a time. Kept for comparison. */
+static int bytewise_equals(MQTTString* a, const char* b)
+{
+	return ((int)strlen(b) == a->lenstring.len && strncmp(a->lenstring.data, b, a->lenstring.len) == 0);
+}
+
+
+static int bench_equals_bytewise(void* arg)
+{
+	codec_ctx_t* c = arg;
+
+	return bytewise_equals(&c->topicName, c->topic) ? c->topicName.lenstring.len : 0;
+}
+
+
+/* Client::isTopicMatched before MQTTTopic_matches. Kept for comparison. */
+static int bytewise_matches(const char* filter, const char* name, int namelen)
+{
+	const char* curf = filter;
+	const char* curn = name;
+	const char* curn_end = name + namelen;
+
+	while (*curf && curn < curn_end)
+	{
+		if (*curn == '/' && *curf != '/')
+			break;
+		if (*curf != '+' && *curf != '#' && *curf != *curn)
+			break;
+		if (*curf == '+')
+		{
+			const char* nextpos = curn + 1;
+			while (nextpos < curn_end && *nextpos != '/')
+				nextpos = ++curn + 1;
+		}
+		else if (*curf == '#')
+			curn = curn_end - 1;
+		curf++;
+		curn++;
+	}
+	return (curn == curn_end) && (*curf == '\0');
+}
+
+
+static int bench_matches(void* arg)
+{
+	codec_ctx_t* c = arg;
+
+	return MQTTTopic_matches(c->filter, strlen(c->filter), c->topic, c->topicName.lenstring.len) ? c->topicName.lenstring.len : 0;
+}
+
+
+static int bench_matches_bytewise(void* arg)
+{
+	codec_ctx_t* c = arg;
+
+	return bytewise_matches(c->filter, c->topic, c->topicName.lenstring.len) ? c->topicName.lenstring.len : 0;
+}
+
+
+/* Finds the handler of a topic among DISPATCH_FILTERS variable topics the way
+ * Client::deliverMessage does: the shared prefix once, then the rest of each filter */
+static int bench_dispatch_prefix(void* arg)
+{
+	codec_ctx_t* c = arg;
+	int skip = c->prefixlen, len = c->topicName.lenstring.len;
+	int i;
+
+	if (len < skip || MQTTTopic_compare(c->topic, c->filters[0], skip) != skip)
+		return 0;
+	for (i = 0; i < DISPATCH_FILTERS; ++i)
+		if (MQTTTopic_matches(c->filters[i] + skip, c->filterlens[i] - skip, c->topic + skip, len - skip))
+			return len;
+	return 0;
+}
+
+
+/* ... and the way it did before: equals, then a bytewise wildcard match, per filter */
+static int bench_dispatch_bytewise(void* arg)
+{
+	codec_ctx_t* c = arg;
+	int i;
+
+	for (i = 0; i < DISPATCH_FILTERS; ++i)
+		if (bytewise_equals(&c->topicName, c->filters[i]) || bytewise_matches(c->filters[i], c->topic, c->topicName.lenstring.len))
+			return c->topicName.lenstring.len;
+	return 0;
+}
+/*------------------------------------------------*/
+
+/**
+ * Builds a topic of the requested length shaped like a Ubidots variable topic
+ */
+static void make_topic(char* topic, int len)
+{
+	static const char prefix[] = "/v1.6/devices/netburner-gateway/";
+	int i;
+
+	for (i = 0; i < len; ++i)
+		topic[i] = (i < (int)sizeof(prefix) - 1) ? prefix[i] : 'a' + (i % 26);
+	topic[len] = '\0';
+}
+
+
+static void make_device(char* device, int len)
+{
+	int i;
+
+	for (i = 0; i < len; ++i)
+		device[i] = 'a' + (i % 26);
+	device[len] = '\0';
+}
+
+
+static void set_topic(codec_ctx_t* c, int len)
+{
+	make_topic(c->topic, len);
+	strcpy(c->other, c->topic);
+	c->other[len - 1] ^= 1;
+	c->topicName.cstring = NULL;
+	c->topicName.lenstring.data = c->topic;
+	c->topicName.lenstring.len = len;
+}
+
+
+int main(int argc, char** argv)
+{
+	bench_config_t config = {NULL, BENCH_DEFAULT_MIN_MS};
+	static codec_ctx_t c;
+	char name[64];
+	size_t t, p;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "f:t:h")) != -1)
+	{
+		switch (opt)
+		{
+		case 'f': config.filter = optarg; break;
+		case 't': config.min_ms = atoi(optarg); break;
+		default:
+			fprintf(stderr, "usage: %s [-f filter] [-t ms]\n", argv[0]);
+			return 2;
+		}
+	}
+
+	memset(c.payload, '7', sizeof(c.payload));
+	bench_header();
+
+	for (t = 0; t < sizeof(topic_sizes) / sizeof(topic_sizes[0]); ++t)
+	{
+		for (p = 0; p < sizeof(payload_sizes) / sizeof(payload_sizes[0]); ++p)
+		{
+			set_topic(&c, topic_sizes[t]);
+			c.payloadlen = payload_sizes[p];
+
+			snprintf(name, sizeof(name), "serialize_publish/t%d/p%d", topic_sizes[t], payload_sizes[p]);
+			bench_run(&config, name, bench_serialize_publish, &c);
+
+			c.packetlen = bench_serialize_publish(&c);
+			snprintf(name, sizeof(name), "deserialize_publish/t%d/p%d", topic_sizes[t], payload_sizes[p]);
+			bench_run(&config, name, bench_deserialize_publish, &c);
+		}
+	}
+
+	bench_run(&config, "serialize_ack", bench_serialize_ack, &c);
+	c.packetlen = bench_serialize_ack(&c);
+	bench_run(&config, "deserialize_ack", bench_deserialize_ack, &c);
+
+	for (t = 0; t < sizeof(remaining_lengths) / sizeof(remaining_lengths[0]); ++t)
+	{
+		c.value = remaining_lengths[t];
+		snprintf(name, sizeof(name), "encode/len%d", c.value);
+		bench_run(&config, name, bench_encode, &c);
+
+		bench_encode(&c);
+		snprintf(name, sizeof(name), "decodeBuf/len%d", c.value);
+		bench_run(&config, name, bench_decode_buf, &c);
+
+		snprintf(name, sizeof(name), "decode_callback/len%d", c.value);
+		bench_run(&config, name, bench_decode_callback, &c);
+	}
+
+	for (t = 0; t < sizeof(topic_sizes) / sizeof(topic_sizes[0]); ++t)
+	{
+		set_topic(&c, topic_sizes[t]);
+
+		snprintf(name, sizeof(name), "serialize_subscribe/t%d", topic_sizes[t]);
+		bench_run(&config, name, bench_serialize_subscribe, &c);
+
+		snprintf(name, sizeof(name), "equals/match/t%d", topic_sizes[t]);
+		bench_run(&config, name, bench_equals_match, &c);
+
+		snprintf(name, sizeof(name), "equals/mismatch/t%d", topic_sizes[t]);
+		bench_run(&config, name, bench_equals_mismatch, &c);
+
+		snprintf(name, sizeof(name), "equals_bytewise/match/t%d", topic_sizes[t]);
+		bench_run(&config, name, bench_equals_bytewise, &c);
+	}
+
+	/* Ubidots variable topics, /v1.6/devices/<device>/<variable>/lv */
+	for (t = 0; t < sizeof(device_sizes) / sizeof(device_sizes[0]); ++t)
+	{
+		char device[128];
+		int len;
+
+		make_device(device, device_sizes[t]);
+		len = snprintf(c.topic, sizeof(c.topic), "/v1.6/devices/%s/" DISPATCH_VARIABLE "/lv", device);
+		c.topicName.lenstring.data = c.topic;
+		c.topicName.lenstring.len = len;
+
+		for (p = 0; p < sizeof(match_filters) / sizeof(match_filters[0]); ++p)
+		{
+			snprintf(c.filters[0], sizeof(c.filters[0]), match_filters[p], device);
+			c.filter = c.filters[0];
+
+			snprintf(name, sizeof(name), "matches/%s/t%d", match_names[p], len);
+			bench_run(&config, name, bench_matches, &c);
+
+			snprintf(name, sizeof(name), "matches_bytewise/%s/t%d", match_names[p], len);
+			bench_run(&config, name, bench_matches_bytewise, &c);
+		}
+
+		for (p = 0; p < DISPATCH_FILTERS; ++p)
+			c.filterlens[p] = snprintf(c.filters[p], sizeof(c.filters[p]), "/v1.6/devices/%s/var%02d/lv", device, (int)p);
+		c.prefixlen = MQTTTopic_levelPrefix(c.filters[0], c.filterlens[0], c.filters[1], c.filterlens[1]);
+
+		snprintf(name, sizeof(name), "dispatch/f%d/t%d", DISPATCH_FILTERS, len);
+		bench_run(&config, name, bench_dispatch_prefix, &c);
+
+		snprintf(name, sizeof(name), "dispatch_bytewise/f%d/t%d", DISPATCH_FILTERS, len);
+		bench_run(&config, name, bench_dispatch_bytewise, &c);
+	}
+
+	return 0;
+}
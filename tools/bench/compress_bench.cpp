@@ -0,0 +1,99 @@
+/**
+ * @file compress_bench.cpp
+ *
+ * @brief Ratio and speed of the Ubidots payload compressor.
+ *
+ * Compresses and decompresses Ubidots JSON payloads of several sizes, like the
+ * batched ones sent over metered links, with src/ubidots/ubidotscompress.cpp.
+ * Prints ns/op and bytes/op (compressed size), then the ratio of each size.
+ *
+ *   compress-bench [-f filter] [-t ms]
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <ubidotscompress.h>
+
+#include "bench.h"
+
+#define COMPRESS_BUF_SIZE 1000 /* same as UBIDOTS_MSG_MAX_LEN */
+
+static const int payload_sizes[] = {64, 256, 512, 960};
+
+typedef struct
+{
+  ubidots_lz_t lz;
+  uint8_t payload[COMPRESS_BUF_SIZE];
+  uint8_t compressed[COMPRESS_BUF_SIZE + 64];
+  uint8_t out[COMPRESS_BUF_SIZE];
+  int payloadlen;
+  int compressedlen;
+} compress_ctx_t;
+
+/* {"sensor_00": {"value": 21.37, "timestamp": 1700000000000}, ...} up to len bytes */
+static int build_payload(char* buf, int len)
+{
+  int n = 1;
+  buf[0] = '{';
+  for (int i = 0;; ++i) {
+    char item[96];
+    int itemlen = snprintf(item, sizeof(item), "%s\"sensor_%02d\": {\"value\": %d.%02d, \"timestamp\": %lld}",
+                           i ? ", " : "", i, rand() % 100, rand() % 100, 1700000000000LL + i * 60000LL);
+    if (n + itemlen + 1 > len)
+      break;
+    memcpy(buf + n, item, itemlen);
+    n += itemlen;
+  }
+  buf[n++] = '}';
+  return n;
+}
+
+static int bench_compress(void* ctx)
+{
+  compress_ctx_t* c = (compress_ctx_t*)ctx;
+  return ubidotsCompress(&c->lz, c->payload, c->payloadlen, c->compressed, sizeof(c->compressed));
+}
+
+static int bench_decompress(void* ctx)
+{
+  compress_ctx_t* c = (compress_ctx_t*)ctx;
+  return ubidotsDecompress(c->compressed, c->compressedlen, c->out, sizeof(c->out));
+}
+
+int main(int argc, char** argv) {
+  bench_config_t config = {NULL, BENCH_DEFAULT_MIN_MS};
+  static compress_ctx_t c;
+  char name[64];
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:t:h")) != -1) {
+    switch (opt) {
+      case 'f': config.filter = optarg; break;
+      case 't': config.min_ms = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-f filter] [-t ms]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  ubidotsLzInit(&c.lz);
+  bench_header();
+  for (size_t s = 0; s < sizeof(payload_sizes) / sizeof(payload_sizes[0]); ++s) {
+    c.payloadlen = build_payload((char*)c.payload, payload_sizes[s]);
+    c.compressedlen = bench_compress(&c);
+
+    snprintf(name, sizeof(name), "compress/p%d", payload_sizes[s]);
+    bench_run(&config, name, bench_compress, &c);
+    snprintf(name, sizeof(name), "decompress/p%d", payload_sizes[s]);
+    bench_run(&config, name, bench_decompress, &c);
+
+    if (bench_decompress(&c) != c.payloadlen || memcmp(c.out, c.payload, c.payloadlen) != 0) {
+      fprintf(stderr, "round trip failed for p%d\n", payload_sizes[s]);
+      return 1;
+    }
+    printf("%-48s %12d %10d %9.1f%%\n", "  ratio (in, out, out/in)", c.payloadlen, c.compressedlen,
+           100.0 * c.compressedlen / c.payloadlen);
+  }
+  return 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file encoder_bench.cpp
+ *
+ * @brief Size and speed of the Ubidots payload encoders.
+ *
+ * Encodes one {variable: value} pair per operation with each encoder
+ * (src/ubidots/ubidotsencoder.cpp) and with snprintf("%.2f"), the format the
+ * JSON encoder reproduces. Prints ns/op and the payload size in bytes/op.
+ *
+ *   encoder-bench [-f filter] [-t ms]
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <ubidotsencoder.h>
+
+#include "bench.h"
+
+#define ENCODER_BUF_SIZE 1000 /* same as UBIDOTS_MSG_MAX_LEN */
+
+static const int variable_sizes[] = {4, 16, 64};
+static const float values[] = {21.0f, 21.37f, -1234.5f, 6.02e23f};
+static const char* value_names[] = {"int", "frac", "neg", "large"};
+
+typedef struct
+{
+  uint8_t buf[ENCODER_BUF_SIZE];
+  char variable[128];
+  float value;
+  const ubidots_encoder_t* encoder;
+} encoder_ctx_t;
+
+static int bench_encode(void* ctx)
+{
+  encoder_ctx_t* c = (encoder_ctx_t*)ctx;
+  return c->encoder->encode(c->buf, sizeof(c->buf), c->variable, c->value);
+}
+
+static int bench_snprintf(void* ctx)
+{
+  encoder_ctx_t* c = (encoder_ctx_t*)ctx;
+  return snprintf((char*)c->buf, sizeof(c->buf), "{\"%s\": %.2f}", c->variable, c->value);
+}
+
+int main(int argc, char** argv) {
+  bench_config_t config = {NULL, BENCH_DEFAULT_MIN_MS};
+  static encoder_ctx_t c;
+  char name[64];
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:t:h")) != -1) {
+    switch (opt) {
+      case 'f': config.filter = optarg; break;
+      case 't': config.min_ms = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-f filter] [-t ms]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  bench_header();
+  for (size_t s = 0; s < sizeof(variable_sizes) / sizeof(variable_sizes[0]); ++s) {
+    memset(c.variable, 'v', variable_sizes[s]);
+    c.variable[variable_sizes[s]] = '\0';
+
+    for (size_t v = 0; v < sizeof(values) / sizeof(values[0]); ++v) {
+      c.value = values[v];
+
+      snprintf(name, sizeof(name), "snprintf/v%d/%s", variable_sizes[s], value_names[v]);
+      bench_run(&config, name, bench_snprintf, &c);
+
+      c.encoder = &ubidotsJsonEncoder;
+      snprintf(name, sizeof(name), "json/v%d/%s", variable_sizes[s], value_names[v]);
+      bench_run(&config, name, bench_encode, &c);
+
+      c.encoder = &ubidotsCborEncoder;
+      snprintf(name, sizeof(name), "cbor/v%d/%s", variable_sizes[s], value_names[v]);
+      bench_run(&config, name, bench_encode, &c);
+    }
+  }
+  return 0;
+}
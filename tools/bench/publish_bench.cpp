@@ -0,0 +1,268 @@
+/**
+ * @file publish_bench.cpp
+ *
+ * @brief Host end-to-end publish benchmark of MQTT::Client against a local broker.
+ *
+ * Same cases and output as the firmware benchmark (src/benchmark/publishbench.cpp),
+ * run on Linux with the POSIX network and timer policies:
+ *
+ *   loopback-broker &
+ *   publish-bench [-H host] [-p port] [-n messages] [-t topic] [-c capture] [-P connections]
+ *
+ * -P runs the connection pool cases instead, the way UbidotsPool spreads a
+ * device over connections: 1, 2, 4 ... up to the given number of
+ * connections, Ubidots payloads of 64 variables each on the connection its
+ * name hashes to, one thread per connection as the pool documentation asks
+ * for QoS1. Against a broker that delays its acks (loopback-broker -a ms)
+ * this shows how the throughput scales with the connections.
+ *
+ * Built with MQTTCLIENT_PROFILE, it ends with the time of each client stage
+ * over the whole run.
+ *
+ * -c writes the packets of the run to a capture file for mqtt-replay, as
+ * capture.bin of the module.
+ *
+ * For QoS1 the latency is publish to PUBACK; for QoS0 it is the time spent in
+ * publish, since there is no ack. QoS0 cases end with one QoS1 publish so the
+ * throughput only counts what the broker actually took.
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <MQTTClient.h>
+#include <PosixMQTTSocket.h>
+#include <PosixMQTTCountdown.h>
+#include <benchstats.h>
+#include <ubidotsvariables.h>
+
+#include "bench.h"
+
+#define PUBLISH_BENCH_PACKET_SIZE 1000 /* same as UBIDOTS_MSG_MAX_LEN */
+#define PUBLISH_BENCH_CAPTURE_LEN (16 * 1024 * 1024)
+#define PUBLISH_BENCH_POOL_VARIABLES 64 /* variables spread over the pool connections */
+#define PUBLISH_BENCH_POOL_MAX 16       /* most pool connections */
+
+typedef MQTT::Client<PosixMQTTSocket, PosixMQTTCountdown, PUBLISH_BENCH_PACKET_SIZE> bench_client_t;
+
+static const uint32_t payload_sizes[] = {16, 64, 256, 900};
+static const MQTT::QoS qos_levels[] = {MQTT::QOS0, MQTT::QOS1};
+
+static void bench_case(bench_client_t& client, const char* topic, MQTT::QoS qos, uint32_t payloadlen, uint32_t messages)
+{
+  static char payload[PUBLISH_BENCH_PACKET_SIZE];
+  uint32_t* samples = new uint32_t[messages];
+  bench_result_t result = {};
+  uint32_t count = 0;
+  long long start;
+
+  memset(payload, 'x', payloadlen);
+
+  start = bench_now_ns();
+  for (uint32_t i = 0; i < messages; ++i) {
+    long long t0 = bench_now_ns();
+    if (client.publish(topic, payload, payloadlen, qos) == MQTT::SUCCESS)
+      samples[count++] = (uint32_t)(bench_now_ns() - t0);
+    else
+      result.errors++;
+  }
+  if (qos == MQTT::QOS0)
+    client.publish(topic, payload, payloadlen, MQTT::QOS1);
+
+  result.messages = count;
+  benchSummarize(samples, count, payloadlen, (uint32_t)((bench_now_ns() - start) / 1000), result);
+  printf("%-8s %4d %7u %6u %6u %8u %9u %8.1f %8.1f %8.1f %8.1f\n",
+         "client", qos, payloadlen, result.messages, result.errors, result.msgPerSec, result.bytesPerSec,
+         result.p50Ns / 1000.0, result.p99Ns / 1000.0, result.p999Ns / 1000.0, result.maxNs / 1000.0);
+  delete[] samples;
+}
+
+/* one pool connection and the variables it publishes, run by its own thread */
+struct pool_worker {
+  PosixMQTTSocket socket;
+  bench_client_t* client;
+  const char* topic;
+  MQTT::QoS qos;
+  int variables[PUBLISH_BENCH_POOL_VARIABLES];
+  int variable_count;
+  uint32_t messages;
+  uint32_t* samples;
+  uint32_t count;
+  uint32_t errors;
+};
+
+static void* pool_worker_run(void* arg)
+{
+  pool_worker* w = (pool_worker*)arg;
+  char payload[32];
+
+  for (uint32_t i = 0; i < w->messages; ++i) {
+    int len = snprintf(payload, sizeof(payload), "{\"var%d\": 1.00}", w->variables[i % w->variable_count]);
+    long long t0 = bench_now_ns();
+    if (w->client->publish(w->topic, payload, len, w->qos) == MQTT::SUCCESS)
+      w->samples[w->count++] = (uint32_t)(bench_now_ns() - t0);
+    else
+      w->errors++;
+  }
+  if (w->qos == MQTT::QOS0)
+    w->client->publish(w->topic, payload, strlen(payload), MQTT::QOS1);
+  return NULL;
+}
+
+static int pool_case(const char* host, int port, const char* topic, int connections, MQTT::QoS qos, uint32_t messages)
+{
+  pool_worker* workers = new pool_worker[connections];
+  uint32_t* samples = new uint32_t[messages];
+  bench_result_t result = {};
+  pthread_t threads[PUBLISH_BENCH_POOL_MAX];
+  uint32_t used = 0;
+  char name[24], api[16];
+  int rc = 0;
+
+  for (int i = 0; i < connections; ++i) {
+    workers[i].variable_count = 0;
+    workers[i].count = workers[i].errors = 0;
+  }
+  for (int v = 0; v < PUBLISH_BENCH_POOL_VARIABLES; ++v) {  // UbidotsPool::shardOf()
+    int len = snprintf(name, sizeof(name), "var%d", v);
+    pool_worker& w = workers[ubidotsNameHash(name, len) % connections];
+    w.variables[w.variable_count++] = v;
+  }
+
+  for (int i = 0; i < connections; ++i) {
+    pool_worker& w = workers[i];
+    MQTTPacket_connectData options = MQTTPacket_connectData_initializer;
+    snprintf(name, sizeof(name), "NETBURNER-BENCH-%d", i);
+    options.clientID.cstring = name;
+    options.keepAliveInterval = 0;
+    w.client = new bench_client_t(w.socket);
+    w.topic = topic;
+    w.qos = qos;
+    w.messages = (w.variable_count > 0) ? messages / connections : 0;
+    w.samples = samples + used;
+    used += w.messages;
+    if (w.socket.connect(host, port) != 0 || w.client->connect(options) != MQTT::SUCCESS) {
+      fprintf(stderr, "cannot connect to %s:%d\n", host, port);
+      rc = 1;
+    }
+  }
+
+  long long start = bench_now_ns();
+  for (int i = 0; rc == 0 && i < connections; ++i)
+    pthread_create(&threads[i], NULL, pool_worker_run, &workers[i]);
+  for (int i = 0; rc == 0 && i < connections; ++i)
+    pthread_join(threads[i], NULL);
+  uint32_t elapsed_us = (uint32_t)((bench_now_ns() - start) / 1000);
+
+  for (int i = 0; i < connections; ++i) {  // gather the samples of every connection, in place
+    memmove(samples + result.messages, workers[i].samples, workers[i].count * sizeof(uint32_t));
+    result.messages += workers[i].count;
+    result.errors += workers[i].errors;
+    workers[i].client->disconnect();
+    workers[i].socket.disconnect();
+    delete workers[i].client;
+  }
+  if (rc == 0) {
+    benchSummarize(samples, result.messages, 15, elapsed_us, result);
+    snprintf(api, sizeof(api), "pool-%d", connections);
+    printf("%-8s %4d %7u %6u %6u %8u %9u %8.1f %8.1f %8.1f %8.1f\n",
+           api, qos, 15, result.messages, result.errors, result.msgPerSec, result.bytesPerSec,
+           result.p50Ns / 1000.0, result.p99Ns / 1000.0, result.p999Ns / 1000.0, result.maxNs / 1000.0);
+  }
+  delete[] samples;
+  delete[] workers;
+  return rc;
+}
+
+#if MQTTCLIENT_PROFILE
+static void print_profile(const bench_client_t& client)
+{
+  NBMQTTProfile profile;
+
+  client.getProfile(profile);
+  printf("\n%-10s %8s %8s %8s %8s\n", "stage", "count", "p50_ns", "p99_ns", "max_ns");
+  for (int i = 0; i < NBMQTT_STAGES; ++i)
+    printf("%-10s %8u %8u %8u %8u\n", NBMQTTProfile::name(i), profile.stages[i].count, profile.stages[i].percentile(50),
+           profile.stages[i].percentile(99), profile.stages[i].max);
+}
+#endif
+
+int main(int argc, char** argv) {
+  const char* host = "127.0.0.1";
+  const char* topic = "/v1.6/devices/bench";
+  const char* captureFile = NULL;
+  int pool = 0;
+  int port = 1883;
+  uint32_t messages = 10000;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "H:p:n:t:c:P:h")) != -1) {
+    switch (opt) {
+      case 'H': host = optarg; break;
+      case 'p': port = atoi(optarg); break;
+      case 'n': messages = (uint32_t)atoi(optarg); break;
+      case 't': topic = optarg; break;
+      case 'c': captureFile = optarg; break;
+      case 'P': pool = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-H host] [-p port] [-n messages] [-t topic] [-c capture] [-P connections]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  if (pool > 0) {
+    if (pool > PUBLISH_BENCH_POOL_MAX)
+      pool = PUBLISH_BENCH_POOL_MAX;
+    printf("Pool benchmark against %s:%d, %u messages per case\n", host, port, messages);
+    printf("%-8s %4s %7s %6s %6s %8s %9s %8s %8s %8s %8s\n",
+           "api", "qos", "payload", "msgs", "errors", "msg/s", "bytes/s", "p50_us", "p99_us", "p999_us", "max_us");
+    for (size_t q = 0; q < sizeof(qos_levels) / sizeof(qos_levels[0]); ++q)
+      for (int n = 1; n <= pool; n *= 2)
+        if (pool_case(host, port, topic, n, qos_levels[q], messages) != 0)
+          return 1;
+    return 0;
+  }
+
+  PosixMQTTSocket socket;
+  static bench_client_t client(socket);
+  MQTTPacket_connectData options = MQTTPacket_connectData_initializer;
+  options.clientID.cstring = (char*)"NETBURNER-BENCH";
+  options.keepAliveInterval = 0;
+
+  unsigned char* captureBuffer = (captureFile != NULL) ? new unsigned char[PUBLISH_BENCH_CAPTURE_LEN] : NULL;
+  NBMQTTCapture capture(captureBuffer, (captureBuffer != NULL) ? PUBLISH_BENCH_CAPTURE_LEN : 0);
+  if (captureFile != NULL)
+    client.setCapture(&capture);
+
+  if (socket.connect(host, port) != 0 || client.connect(options) != MQTT::SUCCESS) {
+    fprintf(stderr, "cannot connect to %s:%d\n", host, port);
+    return 1;
+  }
+
+  printf("Publish benchmark against %s:%d, %u messages per case\n", host, port, messages);
+  printf("%-8s %4s %7s %6s %6s %8s %9s %8s %8s %8s %8s\n",
+         "api", "qos", "payload", "msgs", "errors", "msg/s", "bytes/s", "p50_us", "p99_us", "p999_us", "max_us");
+  for (size_t q = 0; q < sizeof(qos_levels) / sizeof(qos_levels[0]); ++q)
+    for (size_t s = 0; s < sizeof(payload_sizes) / sizeof(payload_sizes[0]); ++s)
+      bench_case(client, topic, qos_levels[q], payload_sizes[s], messages);
+#if MQTTCLIENT_PROFILE
+  print_profile(client);
+#endif
+
+  client.disconnect();
+  socket.disconnect();
+
+  if (captureFile != NULL) {
+    FILE* f = fopen(captureFile, "wb");
+    if (f == NULL || fwrite(capture.data(), 1, capture.size(), f) != capture.size()) {
+      perror(captureFile);
+      return 1;
+    }
+    fclose(f);
+    printf("Captured %u packets to %s, %u left out\n", capture.getPackets(), captureFile, capture.getDropped());
+    delete[] captureBuffer;
+  }
+  return 0;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file value_bench.cpp
+ *
+ * @brief Speed of the Ubidots inbound value parser.
+ *
+ * Parses the two payloads Ubidots sends, a bare /lv number and a
+ * {"value", "timestamp", "context"} object, with ubidotsParseValue
+ * (src/ubidots/ubidotsvalue.cpp) and with what handlers did before: copy the
+ * payload to NUL terminate it, then sscanf or strstr + strtof. Prints ns/op
+ * and the payload size in bytes/op.
+ *
+ *   value-bench [-f filter] [-t ms]
+ */
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <ubidotsvalue.h>
+
+#include "bench.h"
+
+static const char* payloads[] = {
+    "21.37",
+    "{\"value\": 21.37, \"timestamp\": 1700000000000, \"context\": {\"status\": \"on\", \"room\": 4}}",
+};
+static const char* payload_names[] = {"lv", "object"};
+
+typedef struct
+{
+  const char* payload;
+  size_t payloadlen;
+  char copy[256];
+  float value;
+} value_ctx_t;
+
+static int bench_parse(void* ctx)
+{
+  value_ctx_t* c = (value_ctx_t*)ctx;
+  ubidots_value_t v;
+  ubidotsParseValue(c->payload, c->payloadlen, &v);
+  c->value = (float)v.value;
+  return (int)c->payloadlen;
+}
+
+static int bench_sscanf(void* ctx)
+{
+  value_ctx_t* c = (value_ctx_t*)ctx;
+  memcpy(c->copy, c->payload, c->payloadlen);
+  c->copy[c->payloadlen] = '\0';
+  if (c->copy[0] == '{') {
+    long long timestamp;
+    sscanf(c->copy, "{\"value\": %f, \"timestamp\": %lld", &c->value, &timestamp);
+  } else
+    sscanf(c->copy, "%f", &c->value);
+  return (int)c->payloadlen;
+}
+
+static int bench_strtof(void* ctx)
+{
+  value_ctx_t* c = (value_ctx_t*)ctx;
+  memcpy(c->copy, c->payload, c->payloadlen);
+  c->copy[c->payloadlen] = '\0';
+  if (c->copy[0] == '{') {
+    const char* p = strstr(c->copy, "\"value\":");
+    c->value = p ? strtof(p + 8, NULL) : 0;
+    p = strstr(c->copy, "\"timestamp\":");
+    bench_sink += p ? strtoll(p + 12, NULL, 10) : 0;
+  } else
+    c->value = strtof(c->copy, NULL);
+  return (int)c->payloadlen;
+}
+
+int main(int argc, char** argv) {
+  bench_config_t config = {NULL, BENCH_DEFAULT_MIN_MS};
+  static value_ctx_t c;
+  char name[64];
+  int opt;
+
+  while ((opt = getopt(argc, argv, "f:t:h")) != -1) {
+    switch (opt) {
+      case 'f': config.filter = optarg; break;
+      case 't': config.min_ms = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-f filter] [-t ms]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  bench_header();
+  for (size_t p = 0; p < sizeof(payloads) / sizeof(payloads[0]); ++p) {
+    c.payload = payloads[p];
+    c.payloadlen = strlen(payloads[p]);
+
+    snprintf(name, sizeof(name), "parse/%s", payload_names[p]);
+    bench_run(&config, name, bench_parse, &c);
+    snprintf(name, sizeof(name), "sscanf/%s", payload_names[p]);
+    bench_run(&config, name, bench_sscanf, &c);
+    snprintf(name, sizeof(name), "strtof/%s", payload_names[p]);
+    bench_run(&config, name, bench_strtof, &c);
+  }
+  return 0;
+}
@@ -0,0 +1,920 @@
+/**
+ * @file broker.c
+ *
+ * @brief Loopback MQTT broker used to run the Ubidots client offline.
+ *
+ * Single process, single thread, poll() driven. Packets are decoded and
+ * encoded with the bundled mqtt-paho codecs (the same server side functions
+ * shipped in src/mqtt-paho), so the peer behaves deterministically:
+ *
+ *  - CONNECT / CONNACK, with optional token check (rc 5 when it does not match)
+ *  - SUBSCRIBE / SUBACK, UNSUBSCRIBE / UNSUBACK with + and # wildcards
+ *  - PUBLISH QoS0/1/2 with PUBACK or PUBREC / PUBREL / PUBCOMP
+ *  - PINGREQ / PINGRESP, DISCONNECT
+ *
+ * Publishes are forwarded verbatim to every matching subscription. Publishes
+ * to Ubidots device topics (/v1.6/devices/<device>[/<variable>]) are also
+ * expanded the way Ubidots does it: every variable found in the JSON payload
+ * is emitted to /v1.6/devices/<device>/<variable>/lv as a bare number and to
+ * /v1.6/devices/<device>/<variable> as a {"value", "timestamp", "context"}
+ * object.
+ *
+ * Acks can be delayed by a fixed amount per packet family to emulate a remote
+ * broker. Outgoing packets to a client are always written in order, so a
+ * delayed ack also holds back the traffic queued behind it.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "MQTTPacket.h"
+#include "MQTTTopic.h"
+
+/*---------------------  Definitions ---------------------*/
+#define BROKER_DEFAULT_PORT 1883              /*!< Default listening port */
+#define BROKER_MAX_CLIENTS 32                 /*!< Max simultaneous clients */
+#define BROKER_MAX_SUBSCRIPTIONS 64           /*!< Max subscriptions per client */
+#define BROKER_MAX_FILTERS 16                 /*!< Max topic filters per (UN)SUBSCRIBE packet */
+#define BROKER_FILTER_MAX_LEN 256             /*!< Max len of a stored topic filter */
+#define BROKER_RX_BUFFER_SIZE (1024 * 1024)   /*!< Max packet accepted from a client */
+#define BROKER_TOPIC_MAX_LEN 512              /*!< Max len of a generated Ubidots topic */
+#define BROKER_UBIDOTS_PATH "/v1.6/devices/"  /*!< Ubidots device topic root */
+
+typedef struct broker_tx
+{
+	struct broker_tx* next;
+	long long due_us;        /*!< Monotonic time when the packet may be written */
+	int len;
+	int off;                 /*!< Bytes already written */
+	unsigned char data[];
+} broker_tx;
+
+typedef struct
+{
+	int fd;                                  /*!< -1 when the slot is free */
+	int connected;                           /*!< CONNECT received and accepted */
+	char clientid[64];
+	unsigned char* rx;
+	int rxlen;
+	broker_tx* txhead;
+	broker_tx* txtail;
+	struct
+	{
+		char filter[BROKER_FILTER_MAX_LEN];
+		int qos;
+	} subs[BROKER_MAX_SUBSCRIPTIONS];
+	int nsubs;
+	unsigned short nextid;
+} broker_client;
+
+typedef struct
+{
+	int port;
+	const char* bind;
+	const char* token;       /*!< Required username, NULL accepts anything */
+	int connack_ms;          /*!< Delay applied to CONNACK */
+	int suback_ms;           /*!< Delay applied to SUBACK and UNSUBACK */
+	int puback_ms;           /*!< Delay applied to PUBACK, PUBREC and PUBCOMP */
+	int ubidots;             /*!< Expand Ubidots device publishes */
+	int verbose;
+} broker_options;
+/*------------------------------------------------*/
+
+/*---------------------  Globals ---------------------*/
+static broker_client clients[BROKER_MAX_CLIENTS];
+static broker_options options;
+static volatile sig_atomic_t running = 1;
+static long long start_us;
+
+static struct
+{
+	unsigned long packets_in[16];
+	unsigned long packets_out[16];
+	unsigned long long bytes_in;
+	unsigned long long bytes_out;
+	unsigned long expanded;
+} stats;
+/*------------------------------------------------*/
+
+/*---------------------  Private functions ---------------------*/
+static long long now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+
+static void on_signal(int sig)
+{
+	(void)sig;
+	running = 0;
+}
+
+
+/**
+ * Returns the total length of the first packet in a buffer
+ * @return the packet length, 0 if the packet is still incomplete, -1 if malformed
+ */
+static int packet_length(const unsigned char* buf, int avail)
+{
+	int rem_len = 0;
+	int multiplier = 1;
+	int i;
+
+	for (i = 1; i <= 4; ++i)
+	{
+		if (i >= avail)
+			return 0;
+		rem_len += (buf[i] & 127) * multiplier;
+		if ((buf[i] & 128) == 0)
+			return (1 + i + rem_len <= avail) ? 1 + i + rem_len : 0;
+		multiplier *= 128;
+	}
+	return -1;
+}
+
+
+static void log_packet(const char* dir, broker_client* c, unsigned char* buf, int len)
+{
+	char printbuf[200];
+
+	if (!options.verbose)
+		return;
+	memset(printbuf, 0, sizeof(printbuf));
+	if (*dir == '<')
+		MQTTFormat_toServerString(printbuf, sizeof(printbuf) - 1, buf, len);
+	else
+		MQTTFormat_toClientString(printbuf, sizeof(printbuf) - 1, buf, len);
+	printf("%8.3f %s %-16s %s\n", (now_us() - start_us) / 1000.0, dir,
+			c->clientid[0] ? c->clientid : "-", printbuf);
+}
+
+
+/**
+ * Queues a serialized packet to a client. Packets are written in queue order, so
+ * a delayed packet also holds back everything queued after it.
+ */
+static void enqueue(broker_client* c, const unsigned char* buf, int len, int delay_ms)
+{
+	broker_tx* tx;
+	MQTTHeader header = {0};
+
+	if (len <= 0 || (tx = malloc(sizeof(broker_tx) + len)) == NULL)
+		return;
+	memcpy(tx->data, buf, len);
+	tx->len = len;
+	tx->off = 0;
+	tx->next = NULL;
+	tx->due_us = now_us() + (long long)delay_ms * 1000;
+	if (c->txtail)
+		c->txtail->next = tx;
+	else
+		c->txhead = tx;
+	c->txtail = tx;
+
+	header.byte = buf[0];
+	stats.packets_out[header.bits.type]++;
+	log_packet(">", c, tx->data, len);
+}
+
+
+static void client_close(broker_client* c)
+{
+	broker_tx* tx = c->txhead;
+
+	while (tx)
+	{
+		broker_tx* next = tx->next;
+		free(tx);
+		tx = next;
+	}
+	if (c->fd >= 0)
+		close(c->fd);
+	free(c->rx);
+	memset(c, 0, sizeof(*c));
+	c->fd = -1;
+}
+
+
+/**
+ * Writes every packet whose delay has elapsed
+ * @return 0 on success, -1 if the connection failed
+ */
+static int client_flush(broker_client* c, long long now)
+{
+	while (c->txhead && c->txhead->due_us <= now)
+	{
+		broker_tx* tx = c->txhead;
+		ssize_t rc = send(c->fd, tx->data + tx->off, tx->len - tx->off, MSG_NOSIGNAL);
+
+		if (rc < 0)
+			return (errno == EAGAIN || errno == EWOULDBLOCK) ? 0 : -1;
+		stats.bytes_out += rc;
+		tx->off += rc;
+		if (tx->off < tx->len)
+			return 0;
+		c->txhead = tx->next;
+		if (c->txhead == NULL)
+			c->txtail = NULL;
+		free(tx);
+	}
+	return 0;
+}
+
+
+/**
+ * Forwards a publish to every client with a matching subscription, once per client,
+ * at the highest QoS granted among the matching subscriptions (capped at 1).
+ */
+static void route(const char* topic, int topiclen, const unsigned char* payload, int payloadlen, int qos)
+{
+	MQTTString topicName = MQTTString_initializer;
+	int buflen = MQTTPacket_len(2 + topiclen + payloadlen + 2);
+	unsigned char* buf = malloc(buflen);
+	int i, j;
+
+	if (buf == NULL)
+		return;
+	topicName.lenstring.data = (char*)topic;
+	topicName.lenstring.len = topiclen;
+
+	for (i = 0; i < BROKER_MAX_CLIENTS; ++i)
+	{
+		broker_client* c = &clients[i];
+		int subqos = -1;
+		int len;
+
+		if (c->fd < 0 || !c->connected)
+			continue;
+		for (j = 0; j < c->nsubs; ++j)
+		{
+			if (MQTTTopic_matches(c->subs[j].filter, strlen(c->subs[j].filter), topic, topiclen) && c->subs[j].qos > subqos)
+				subqos = c->subs[j].qos;
+		}
+		if (subqos < 0)
+			continue;
+		subqos = (subqos < qos) ? subqos : qos;
+		if (subqos > 1)
+			subqos = 1;
+		if (subqos > 0 && ++c->nextid == 0)
+			c->nextid = 1;
+		len = MQTTSerialize_publish(buf, buflen, 0, subqos, 0, c->nextid, topicName,
+				(unsigned char*)payload, payloadlen);
+		enqueue(c, buf, len, 0);
+	}
+	free(buf);
+}
+/*------------------------------------------------*/
+
+/*---------------------  Ubidots expansion ---------------------*/
+static const char* json_ws(const char* p, const char* end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+		++p;
+	return p;
+}
+
+
+/**
+ * Skips one JSON value (string, number, literal, object or array)
+ * @return pointer past the value, NULL if malformed
+ */
+static const char* json_skip(const char* p, const char* end)
+{
+	int depth = 0;
+
+	p = json_ws(p, end);
+	do
+	{
+		if (p >= end)
+			return NULL;
+		if (*p == '"')
+		{
+			for (++p; p < end && *p != '"'; ++p)
+			{
+				if (*p == '\\')
+					++p;
+			}
+			if (p >= end)
+				return NULL;
+			++p;
+		}
+		else if (*p == '{' || *p == '[')
+		{
+			++depth;
+			++p;
+		}
+		else if (*p == '}' || *p == ']')
+		{
+			--depth;
+			++p;
+		}
+		else if (depth == 0)
+		{
+			while (p < end && *p != ',' && *p != '}' && *p != ']' && *p != ' ')
+				++p;
+		}
+		else
+			++p;
+	} while (depth > 0);
+	return p;
+}
+
+
+/**
+ * Reads a JSON string token
+ * @return pointer past the closing quote, NULL if malformed
+ */
+static const char* json_string(const char* p, const char* end, const char** s, int* slen)
+{
+	p = json_ws(p, end);
+	if (p >= end || *p != '"')
+		return NULL;
+	*s = ++p;
+	while (p < end && *p != '"')
+		p += (*p == '\\') ? 2 : 1;
+	if (p >= end)
+		return NULL;
+	*slen = p - *s;
+	return p + 1;
+}
+
+
+/**
+ * Emits the Ubidots /lv and variable topics for one value
+ */
+static void emit_value(const char* device, int devicelen, const char* var, int varlen,
+		const char* value, int valuelen, const char* timestamp, int timestamplen,
+		const char* context, int contextlen)
+{
+	char topic[BROKER_TOPIC_MAX_LEN];
+	char payload[BROKER_TOPIC_MAX_LEN + 128];
+	char now[24];
+	int topiclen, payloadlen;
+
+	if (valuelen <= 0)
+		return;
+	if (timestamp == NULL)
+	{
+		timestamplen = snprintf(now, sizeof(now), "%lld", (now_us() - start_us) / 1000);
+		timestamp = now;
+	}
+	if (context == NULL)
+	{
+		context = "{}";
+		contextlen = 2;
+	}
+
+	topiclen = snprintf(topic, sizeof(topic), "%s%.*s/%.*s/lv", BROKER_UBIDOTS_PATH, devicelen, device, varlen, var);
+	if (topiclen >= (int)sizeof(topic))
+		return;
+	route(topic, topiclen, (const unsigned char*)value, valuelen, 1);
+
+	topiclen -= 3; /* strip "/lv" */
+	payloadlen = snprintf(payload, sizeof(payload), "{\"value\": %.*s, \"timestamp\": %.*s, \"context\": %.*s}",
+			valuelen, value, timestamplen, timestamp, contextlen, context);
+	if (payloadlen < (int)sizeof(payload))
+		route(topic, topiclen, (const unsigned char*)payload, payloadlen, 1);
+	stats.expanded++;
+}
+
+
+/**
+ * Expands one variable: a bare number, a {"value": ..} object or an array of those
+ * @return pointer past the value, NULL if malformed
+ */
+static const char* expand_variable(const char* device, int devicelen, const char* var, int varlen,
+		const char* p, const char* end)
+{
+	const char* next;
+
+	p = json_ws(p, end);
+	if (p >= end)
+		return NULL;
+
+	if (*p == '[')
+	{
+		p = json_ws(p + 1, end);
+		while (p && p < end && *p != ']')
+		{
+			p = expand_variable(device, devicelen, var, varlen, p, end);
+			if (p && (p = json_ws(p, end)) < end && *p == ',')
+				++p;
+		}
+		return (p && p < end) ? p + 1 : NULL;
+	}
+
+	if (*p == '{')
+	{
+		const char *value = NULL, *timestamp = NULL, *context = NULL;
+		int valuelen = 0, timestamplen = 0, contextlen = 0;
+
+		p = json_ws(p + 1, end);
+		while (p && p < end && *p != '}')
+		{
+			const char* key;
+			int keylen;
+
+			if ((p = json_string(p, end, &key, &keylen)) == NULL)
+				return NULL;
+			p = json_ws(p, end);
+			if (p >= end || *p != ':')
+				return NULL;
+			p = json_ws(p + 1, end);
+			if ((next = json_skip(p, end)) == NULL)
+				return NULL;
+			if (keylen == 5 && memcmp(key, "value", 5) == 0)
+			{
+				value = p;
+				valuelen = next - p;
+			}
+			else if (keylen == 9 && memcmp(key, "timestamp", 9) == 0)
+			{
+				timestamp = p;
+				timestamplen = next - p;
+			}
+			else if (keylen == 7 && memcmp(key, "context", 7) == 0)
+			{
+				context = p;
+				contextlen = next - p;
+			}
+			p = json_ws(next, end);
+			if (p < end && *p == ',')
+				p = json_ws(p + 1, end);
+		}
+		if (p == NULL || p >= end)
+			return NULL;
+		emit_value(device, devicelen, var, varlen, value, valuelen, timestamp, timestamplen, context, contextlen);
+		return p + 1;
+	}
+
+	if ((next = json_skip(p, end)) == NULL)
+		return NULL;
+	emit_value(device, devicelen, var, varlen, p, next - p, NULL, 0, NULL, 0);
+	return next;
+}
+
+
+/**
+ * Applies the Ubidots topic semantics to a publish on a device topic
+ * @param topic topic name of the publish
+ * @param payload JSON payload: {"var": value, ...} for a device topic, a value for a variable topic
+ */
+static void expand_ubidots(const char* topic, int topiclen, const char* payload, int payloadlen)
+{
+	const int pathlen = sizeof(BROKER_UBIDOTS_PATH) - 1;
+	const char* device = topic + pathlen;
+	const char* end = payload + payloadlen;
+	const char* slash;
+	const char* p;
+	int devicelen;
+
+	if (topiclen <= pathlen || memcmp(topic, BROKER_UBIDOTS_PATH, pathlen) != 0)
+		return;
+	devicelen = topiclen - pathlen;
+	slash = memchr(device, '/', devicelen);
+
+	if (slash)
+	{ /* /v1.6/devices/<device>/<variable>: the payload is the value itself */
+		const char* var = slash + 1;
+		int varlen = topic + topiclen - var;
+
+		if (varlen <= 0 || memchr(var, '/', varlen))
+			return; /* /lv and deeper topics are outputs, never inputs */
+		expand_variable(device, slash - device, var, varlen, payload, end);
+		return;
+	}
+
+	p = json_ws(payload, end);
+	if (p >= end || *p != '{')
+		return;
+	p = json_ws(p + 1, end);
+	while (p && p < end && *p != '}')
+	{
+		const char* var;
+		int varlen;
+
+		if ((p = json_string(p, end, &var, &varlen)) == NULL)
+			return;
+		p = json_ws(p, end);
+		if (p >= end || *p != ':')
+			return;
+		p = expand_variable(device, devicelen, var, varlen, p + 1, end);
+		if (p && (p = json_ws(p, end)) < end && *p == ',')
+			p = json_ws(p + 1, end);
+	}
+}
+/*------------------------------------------------*/
+
+/*---------------------  Packet handlers ---------------------*/
+static int handle_connect(broker_client* c, unsigned char* buf, int len)
+{
+	MQTTPacket_connectData data = MQTTPacket_connectData_initializer;
+	unsigned char out[4];
+	unsigned char rc = 0;
+	int n;
+
+	if (c->connected || MQTTDeserialize_connect(&data, buf, len) != 1)
+		return -1;
+
+	n = data.clientID.lenstring.len;
+	if (n >= (int)sizeof(c->clientid))
+		n = sizeof(c->clientid) - 1;
+	memcpy(c->clientid, data.clientID.lenstring.data, n);
+	c->clientid[n] = '\0';
+
+	if (options.token && (data.username.lenstring.data == NULL ||
+			data.username.lenstring.len != (int)strlen(options.token) ||
+			memcmp(data.username.lenstring.data, options.token, data.username.lenstring.len) != 0))
+		rc = 5; /* not authorized */
+
+	if (rc != 0)
+	{ /* due now, the main loop flushes it and closes the connection */
+		enqueue(c, out, MQTTSerialize_connack(out, sizeof(out), rc, 0), 0);
+		return -1;
+	}
+	enqueue(c, out, MQTTSerialize_connack(out, sizeof(out), rc, 0), options.connack_ms);
+	c->connected = 1;
+	return 0;
+}
+
+
+static int handle_publish(broker_client* c, unsigned char* buf, int len)
+{
+	unsigned char dup, retained, *payload;
+	unsigned short packetid = 0;
+	int qos, payloadlen;
+	MQTTString topicName = MQTTString_initializer;
+	unsigned char out[4];
+
+	if (MQTTDeserialize_publish(&dup, &qos, &retained, &packetid, &topicName, &payload, &payloadlen, buf, len) != 1)
+		return -1;
+
+	if (qos == 1)
+		enqueue(c, out, MQTTSerialize_puback(out, sizeof(out), packetid), options.puback_ms);
+	else if (qos == 2)
+		enqueue(c, out, MQTTSerialize_ack(out, sizeof(out), PUBREC, 0, packetid), options.puback_ms);
+
+	route(topicName.lenstring.data, topicName.lenstring.len, payload, payloadlen, qos);
+	if (options.ubidots)
+		expand_ubidots(topicName.lenstring.data, topicName.lenstring.len, (const char*)payload, payloadlen);
+	return 0;
+}
+
+
+static int handle_subscribe(broker_client* c, unsigned char* buf, int len)
+{
+	MQTTString topicFilters[BROKER_MAX_FILTERS];
+	int requestedQoSs[BROKER_MAX_FILTERS];
+	int grantedQoSs[BROKER_MAX_FILTERS];
+	unsigned char out[4 + BROKER_MAX_FILTERS];
+	unsigned short packetid;
+	unsigned char dup;
+	int count = 0;
+	int i, j;
+
+	if (MQTTDeserialize_subscribe(&dup, &packetid, BROKER_MAX_FILTERS, &count, topicFilters, requestedQoSs, buf, len) != 1)
+		return -1;
+
+	for (i = 0; i < count; ++i)
+	{
+		MQTTLenString* f = &topicFilters[i].lenstring;
+
+		grantedQoSs[i] = 0x80; /* failure */
+		if (f->len <= 0 || f->len >= BROKER_FILTER_MAX_LEN || requestedQoSs[i] > 2)
+			continue;
+		for (j = 0; j < c->nsubs; ++j) /* a repeated filter replaces the existing subscription */
+		{
+			if ((int)strlen(c->subs[j].filter) == f->len && memcmp(c->subs[j].filter, f->data, f->len) == 0)
+				break;
+		}
+		if (j == BROKER_MAX_SUBSCRIPTIONS)
+			continue;
+		if (j == c->nsubs)
+			c->nsubs++;
+		memcpy(c->subs[j].filter, f->data, f->len);
+		c->subs[j].filter[f->len] = '\0';
+		c->subs[j].qos = grantedQoSs[i] = requestedQoSs[i];
+	}
+
+	enqueue(c, out, MQTTSerialize_suback(out, sizeof(out), packetid, count, grantedQoSs), options.suback_ms);
+	return 0;
+}
+
+
+static int handle_unsubscribe(broker_client* c, unsigned char* buf, int len)
+{
+	MQTTString topicFilters[BROKER_MAX_FILTERS];
+	unsigned char out[4];
+	unsigned short packetid;
+	unsigned char dup;
+	int count = 0;
+	int i, j;
+
+	if (MQTTDeserialize_unsubscribe(&dup, &packetid, BROKER_MAX_FILTERS, &count, topicFilters, buf, len) != 1)
+		return -1;
+
+	for (i = 0; i < count; ++i)
+	{
+		MQTTLenString* f = &topicFilters[i].lenstring;
+
+		for (j = 0; j < c->nsubs; ++j)
+		{
+			if ((int)strlen(c->subs[j].filter) == f->len && memcmp(c->subs[j].filter, f->data, f->len) == 0)
+			{
+				c->subs[j] = c->subs[--c->nsubs];
+				break;
+			}
+		}
+	}
+
+	enqueue(c, out, MQTTSerialize_unsuback(out, sizeof(out), packetid), options.suback_ms);
+	return 0;
+}
+
+
+/**
+ * Dispatches one complete packet from a client
+ * @return 0 to keep the connection, -1 to drop it
+ */
+static int handle_packet(broker_client* c, unsigned char* buf, int len)
+{
+	MQTTHeader header = {0};
+	unsigned char out[4];
+
+	header.byte = buf[0];
+	stats.packets_in[header.bits.type]++;
+	log_packet("<", c, buf, len);
+
+	if (!c->connected && header.bits.type != CONNECT)
+		return -1;
+
+	switch (header.bits.type)
+	{
+	case CONNECT:
+		return handle_connect(c, buf, len);
+	case PUBLISH:
+		return handle_publish(c, buf, len);
+	case PUBREL:
+	{
+		unsigned char type, dup;
+		unsigned short packetid;
+
+		if (MQTTDeserialize_ack(&type, &dup, &packetid, buf, len) != 1)
+			return -1;
+		enqueue(c, out, MQTTSerialize_pubcomp(out, sizeof(out), packetid), options.puback_ms);
+		return 0;
+	}
+	case PUBACK:
+	case PUBREC:
+	case PUBCOMP:
+		return 0; /* forwarded publishes are fire and forget */
+	case SUBSCRIBE:
+		return handle_subscribe(c, buf, len);
+	case UNSUBSCRIBE:
+		return handle_unsubscribe(c, buf, len);
+	case PINGREQ:
+	{
+		MQTTHeader resp = {0};
+
+		resp.bits.type = PINGRESP;
+		out[0] = resp.byte;
+		out[1] = 0;
+		enqueue(c, out, 2, 0);
+		return 0;
+	}
+	case DISCONNECT:
+	default:
+		return -1;
+	}
+}
+
+
+/**
+ * Reads what is available on a client socket and handles every complete packet
+ * @return 0 to keep the connection, -1 to drop it
+ */
+static int client_read(broker_client* c)
+{
+	ssize_t rc = recv(c->fd, c->rx + c->rxlen, BROKER_RX_BUFFER_SIZE - c->rxlen, 0);
+	int off = 0;
+
+	if (rc <= 0)
+		return (rc < 0 && (errno == EAGAIN || errno == EINTR)) ? 0 : -1;
+	stats.bytes_in += rc;
+	c->rxlen += rc;
+
+	while (off < c->rxlen)
+	{
+		int len = packet_length(c->rx + off, c->rxlen - off);
+
+		if (len < 0)
+			return -1;
+		if (len == 0)
+		{
+			if (c->rxlen - off >= BROKER_RX_BUFFER_SIZE)
+				return -1; /* packet larger than we accept */
+			break;
+		}
+		if (handle_packet(c, c->rx + off, len) != 0)
+			return -1;
+		off += len;
+	}
+	memmove(c->rx, c->rx + off, c->rxlen - off);
+	c->rxlen -= off;
+	return 0;
+}
+
+
+static void client_accept(int listenfd)
+{
+	int fd = accept(listenfd, NULL, NULL);
+	int one = 1;
+	int i;
+
+	if (fd < 0)
+		return;
+	for (i = 0; i < BROKER_MAX_CLIENTS; ++i)
+	{
+		if (clients[i].fd < 0)
+			break;
+	}
+	if (i == BROKER_MAX_CLIENTS || (clients[i].rx = malloc(BROKER_RX_BUFFER_SIZE)) == NULL)
+	{
+		close(fd);
+		return;
+	}
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+	clients[i].fd = fd;
+}
+
+
+static void print_stats(void)
+{
+	int i;
+
+	fprintf(stderr, "packet        in        out\n");
+	for (i = CONNECT; i <= DISCONNECT; ++i)
+	{
+		if (stats.packets_in[i] || stats.packets_out[i])
+			fprintf(stderr, "%-11s %8lu %10lu\n", MQTTPacket_getName(i), stats.packets_in[i], stats.packets_out[i]);
+	}
+	fprintf(stderr, "bytes in %llu, bytes out %llu, ubidots values expanded %lu\n",
+			stats.bytes_in, stats.bytes_out, stats.expanded);
+}
+
+
+static void usage(const char* name)
+{
+	fprintf(stderr,
+			"usage: %s [-p port] [-b addr] [-t token] [-d ms] [-c ms] [-s ms] [-a ms] [-U] [-v]\n"
+			"  -p port   listening port (default %d)\n"
+			"  -b addr   bind address (default 127.0.0.1)\n"
+			"  -t token  reject CONNECT whose username is not this token (rc 5)\n"
+			"  -d ms     delay every ack by ms\n"
+			"  -c ms     delay CONNACK by ms\n"
+			"  -s ms     delay SUBACK and UNSUBACK by ms\n"
+			"  -a ms     delay PUBACK, PUBREC and PUBCOMP by ms\n"
+			"  -U        do not expand Ubidots device publishes\n"
+			"  -v        print every packet\n",
+			name, BROKER_DEFAULT_PORT);
+}
+/*------------------------------------------------*/
+
+int main(int argc, char** argv)
+{
+	struct sockaddr_in addr;
+	struct pollfd fds[BROKER_MAX_CLIENTS + 1];
+	int listenfd;
+	int one = 1;
+	int opt;
+	int i;
+
+	options.port = BROKER_DEFAULT_PORT;
+	options.bind = "127.0.0.1";
+	options.ubidots = 1;
+
+	while ((opt = getopt(argc, argv, "p:b:t:d:c:s:a:Uvh")) != -1)
+	{
+		switch (opt)
+		{
+		case 'p': options.port = atoi(optarg); break;
+		case 'b': options.bind = optarg; break;
+		case 't': options.token = optarg; break;
+		case 'd': options.connack_ms = options.suback_ms = options.puback_ms = atoi(optarg); break;
+		case 'c': options.connack_ms = atoi(optarg); break;
+		case 's': options.suback_ms = atoi(optarg); break;
+		case 'a': options.puback_ms = atoi(optarg); break;
+		case 'U': options.ubidots = 0; break;
+		case 'v': options.verbose = 1; break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+
+	for (i = 0; i < BROKER_MAX_CLIENTS; ++i)
+		clients[i].fd = -1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(options.port);
+	if (inet_pton(AF_INET, options.bind, &addr.sin_addr) != 1)
+	{
+		fprintf(stderr, "invalid bind address %s\n", options.bind);
+		return 2;
+	}
+	if ((listenfd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+			setsockopt(listenfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+			bind(listenfd, (struct sockaddr*)&addr, sizeof(addr)) < 0 ||
+			listen(listenfd, BROKER_MAX_CLIENTS) < 0)
+	{
+		perror("listen");
+		return 1;
+	}
+
+	signal(SIGINT, on_signal);
+	signal(SIGTERM, on_signal);
+	start_us = now_us();
+	fprintf(stderr, "loopback broker listening on %s:%d\n", options.bind, options.port);
+
+	while (running)
+	{
+		long long now = now_us();
+		long long next_due = now + 1000000LL;
+		int nfds = 1;
+		int slot[BROKER_MAX_CLIENTS + 1];
+
+		fds[0].fd = listenfd;
+		fds[0].events = POLLIN;
+		for (i = 0; i < BROKER_MAX_CLIENTS; ++i)
+		{
+			broker_client* c = &clients[i];
+
+			if (c->fd < 0)
+				continue;
+			fds[nfds].fd = c->fd;
+			fds[nfds].events = POLLIN;
+			if (c->txhead)
+			{
+				if (c->txhead->due_us <= now)
+					fds[nfds].events |= POLLOUT;
+				else if (c->txhead->due_us < next_due)
+					next_due = c->txhead->due_us;
+			}
+			slot[nfds++] = i;
+		}
+
+		if (poll(fds, nfds, (int)((next_due - now + 999) / 1000)) < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			break;
+		}
+
+		if (fds[0].revents & POLLIN)
+			client_accept(listenfd);
+
+		for (i = 1; i < nfds; ++i)
+		{
+			broker_client* c = &clients[slot[i]];
+
+			if ((fds[i].revents & (POLLIN | POLLHUP | POLLERR)) && client_read(c) != 0)
+			{
+				client_flush(c, now_us()); /* let a refused CONNACK out before closing */
+				client_close(c);
+			}
+		}
+
+		now = now_us();
+		for (i = 0; i < BROKER_MAX_CLIENTS; ++i)
+		{
+			if (clients[i].fd >= 0 && client_flush(&clients[i], now) != 0)
+				client_close(&clients[i]);
+		}
+	}
+
+	for (i = 0; i < BROKER_MAX_CLIENTS; ++i)
+	{
+		if (clients[i].fd >= 0)
+			client_close(&clients[i]);
+	}
+	close(listenfd);
+	print_stats();
+	return 0;
+}
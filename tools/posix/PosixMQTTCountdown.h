@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include <time.h>
+
+/**
+ * @brief Host (POSIX) counterpart of NBMQTTCountdown, millisecond resolution.
+ */
+class PosixMQTTCountdown
+{
+public:
+  PosixMQTTCountdown()
+  {
+    endTime = 0;
+  }
+
+  PosixMQTTCountdown(int ms)
+  {
+    countdown_ms(ms);
+  }
+
+  bool expired()
+  {
+    return left_ms() == 0;
+  }
+
+  void countdown_ms(int ms)
+  {
+    endTime = now_ms() + ms;
+  }
+
+  void countdown(int seconds)
+  {
+    countdown_ms(seconds * 1000);
+  }
+
+  int left_ms()
+  {
+    int64_t left = endTime - now_ms();
+    return (left > 0) ? static_cast<int>(left) : 0;
+  }
+
+  // Stamp for timing, in microseconds
+  static uint32_t stamp()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint32_t>(static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000);
+  }
+
+  // Microseconds since a stamp
+  static uint32_t us_since(uint32_t since)
+  {
+    return stamp() - since;
+  }
+
+  // Nanoseconds since a stamp, microsecond resolution, capped at 4.29 s
+  static uint32_t ns_since(uint32_t since)
+  {
+    uint64_t ns = static_cast<uint64_t>(stamp() - since) * 1000;
+    return (ns < 0xFFFFFFFFULL) ? static_cast<uint32_t>(ns) : 0xFFFFFFFFU;
+  }
+
+  static int64_t now_ms()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+  }
+
+private:
+  int64_t endTime;
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * @brief Host (POSIX) counterpart of NBMQTTSocket, used by the host tools to
+ * run MQTT::Client on Linux.
+ */
+class PosixMQTTSocket
+{
+public:
+  int mysock;
+
+  PosixMQTTSocket()
+  {
+    mysock = -1;
+  }
+
+  int connect(const char *hostname, int port, int timeout = 10)
+  {
+    struct addrinfo hints, *res = NULL;
+    char service[8];
+    int one = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(service, sizeof(service), "%d", port);
+    if (getaddrinfo(hostname, service, &hints, &res) != 0)
+      return -1;
+
+    mysock = ::socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (mysock >= 0 && ::connect(mysock, res->ai_addr, res->ai_addrlen) != 0)
+    {
+      ::close(mysock);
+      mysock = -1;
+    }
+    freeaddrinfo(res);
+    if (mysock < 0)
+      return -1;
+
+    setsockopt(mysock, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return 0;
+  }
+
+  /**
+   * @brief Read len bytes, waiting at most timeout ms in total.
+   * @return bytes read (less than len on timeout), -1 on error or connection closed
+   */
+  int read(unsigned char *buffer, int len, int timeout)
+  {
+    int got = 0;
+
+    while (got < len)
+    {
+      struct pollfd pfd = {mysock, POLLIN, 0};
+      int rc = poll(&pfd, 1, timeout);
+      if (rc < 0)
+        return -1;
+      if (rc == 0)
+        break; // timed out
+      rc = ::recv(mysock, buffer + got, len - got, 0);
+      if (rc <= 0)
+        return -1;
+      got += rc;
+    }
+    return got;
+  }
+
+  // Bytes of received data waiting, so a read will not block
+  int available()
+  {
+    int pending = 0;
+    return (ioctl(mysock, FIONREAD, &pending) == 0) ? pending : 0;
+  }
+
+  int write(unsigned char *buffer, int len, int timeout)
+  {
+    return ::send(mysock, buffer, len, MSG_NOSIGNAL);
+  }
+
+  int disconnect()
+  {
+    int result = (mysock >= 0) ? ::close(mysock) : 0;
+    mysock = -1;
+    return result;
+  }
+};
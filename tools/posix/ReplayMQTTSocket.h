@@ -0,0 +1,319 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "MQTTPacket.h"
+#include "NBMQTTCapture.h"
+
+/**
+ * @brief Network policy replaying a capture (NBMQTTCapture) to an MQTT::Client.
+ *
+ * The client reads the packets the broker sent, each one once every packet
+ * before it in the capture has been replayed and not before its captured time,
+ * scaled by speed (0: no waiting). What the client writes is compared with the
+ * packets it sent, byte for byte once CONNECT credentials are masked.
+ *
+ * Pings depend on the pace of the replay, so captured PINGREQ and PINGRESP are
+ * skipped and a PINGREQ the client writes is answered here.
+ */
+class ReplayMQTTSocket
+{
+public:
+  struct Counters
+  {
+    uint32_t matched;    // packets written as captured
+    uint32_t mismatched; // packets written, not as captured
+    uint32_t unexpected; // packets written while the capture expected a read
+    uint32_t skipped;    // captured packets given up, see skip()
+  };
+
+  ReplayMQTTSocket(const unsigned char *capture, uint32_t len, double speed, bool verbose = false)
+  {
+    NBMQTTCaptureRecord record = {};
+    uint32_t pos = 0;
+
+    count = 0;
+    while (NBMQTTCapture::next(capture, len, pos, record))
+      count++;
+    records = new NBMQTTCaptureRecord[count];
+    memset(&record, 0, sizeof(record));
+    pos = 0;
+    for (uint32_t i = 0; i < count; i++)
+    {
+      NBMQTTCapture::next(capture, len, pos, record);
+      records[i] = record;
+    }
+    bytes = pos;
+
+    this->speed = speed;
+    this->verbose = verbose;
+    cursor = 0;
+    readOffset = 0;
+    pongs = 0;
+    pongOffset = 0;
+    dropDisconnect = false;
+    written = NULL;
+    writtenLen = writtenSize = 0;
+    memset(&counters, 0, sizeof(counters));
+    startUs = nowUs();
+  }
+
+  ~ReplayMQTTSocket()
+  {
+    delete[] records;
+    free(written);
+  }
+
+  // Captured packets and the bytes they took, a capture cut short is read to its last whole packet
+  uint32_t size() const { return count; }
+  uint32_t captureBytes() const { return bytes; }
+
+  // Restart the replay clock, the captured times count from here
+  void start()
+  {
+    startUs = nowUs();
+  }
+
+  bool done()
+  {
+    skipPings();
+    return cursor >= count;
+  }
+
+  // The next packet to replay, NULL at the end
+  const NBMQTTCaptureRecord *peek()
+  {
+    skipPings();
+    return (cursor < count) ? &records[cursor] : NULL;
+  }
+
+  uint32_t position() const { return cursor; }
+
+  // Captured time of the last packet
+  uint64_t durationUs() const { return (count > 0) ? records[count - 1].atUs : 0; }
+
+  // The connection was lost in the capture: the next DISCONNECT the client writes is not compared
+  void connectionLost()
+  {
+    dropDisconnect = true;
+  }
+
+  // Microseconds from now until a packet is due, 0 when it is
+  int64_t dueInUs(const NBMQTTCaptureRecord &record) const
+  {
+    if (speed <= 0)
+      return 0;
+    int64_t due = startUs + (int64_t)(record.atUs / speed);
+    int64_t now = nowUs();
+    return (due > now) ? due - now : 0;
+  }
+
+  // Give up on the next packet, the client did not write or read it
+  void skip()
+  {
+    if (cursor < count)
+    {
+      if (verbose)
+        print("skipped", records[cursor].packet, records[cursor].len, records[cursor].direction);
+      cursor++;
+      readOffset = 0;
+      counters.skipped++;
+    }
+  }
+
+  const Counters &getCounters() const { return counters; }
+
+  int connect(const char *hostname, int port, int timeout = 10)
+  {
+    return 0;
+  }
+
+  /**
+   * @brief Read the next captured broker packet, once due.
+   * @return bytes read, less than len when nothing was due within timeout
+   */
+  int read(unsigned char *buffer, int len, int timeout)
+  {
+    int64_t end = nowUs() + (int64_t)timeout * 1000;
+    int got = 0;
+
+    while (got < len)
+    {
+      if (pongs > 0)
+      {
+        static const unsigned char pingresp[2] = {PINGRESP << 4, 0};
+        buffer[got++] = pingresp[pongOffset++];
+        if (pongOffset == sizeof(pingresp))
+        {
+          pongs--;
+          pongOffset = 0;
+        }
+        continue;
+      }
+
+      const NBMQTTCaptureRecord *record = peek();
+      int64_t wait = (int64_t)timeout * 1000;
+      if (record != NULL && record->direction == NBMQTT_CAPTURE_RECEIVED && (wait = dueInUs(*record)) == 0)
+      {
+        int n = record->len - readOffset;
+        if (n > len - got)
+          n = len - got;
+        memcpy(buffer + got, record->packet + readOffset, n);
+        got += n;
+        readOffset += n;
+        if (readOffset == record->len)
+        {
+          if (verbose)
+            print("<", record->packet, record->len, NBMQTT_CAPTURE_RECEIVED);
+          cursor++;
+          readOffset = 0;
+        }
+        continue;
+      }
+
+      // nothing to read yet: the client has to write first, or the packet is not due
+      int64_t left = end - nowUs();
+      if (left <= 0)
+        break;
+      sleepUs((wait < left) ? wait : left);
+    }
+    return got;
+  }
+
+  int available()
+  {
+    const NBMQTTCaptureRecord *record = peek();
+
+    if (pongs > 0)
+      return 2 - pongOffset;
+    if (record == NULL || record->direction != NBMQTT_CAPTURE_RECEIVED || dueInUs(*record) > 0)
+      return 0;
+    return record->len - readOffset;
+  }
+
+  // Compare what the client writes with the captured packets, a whole packet at a time
+  int write(unsigned char *buffer, int len, int timeout)
+  {
+    uint32_t remaining, packetLen;
+    int n;
+
+    if (writtenLen + len > writtenSize)
+    {
+      writtenSize = (writtenLen + len) * 2;
+      written = (unsigned char *)realloc(written, writtenSize);
+    }
+    memcpy(written + writtenLen, buffer, len);
+    writtenLen += len;
+
+    while (writtenLen >= 2 && (n = NBMQTTCapture::decode(written + 1, writtenLen - 1, 4, remaining)) > 0 &&
+           (packetLen = 1 + n + remaining) <= writtenLen)
+    {
+      compare(written, packetLen);
+      memmove(written, written + packetLen, writtenLen - packetLen);
+      writtenLen -= packetLen;
+    }
+    return len;
+  }
+
+  int disconnect()
+  {
+    return 0;
+  }
+
+private:
+  static int64_t nowUs()
+  {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  }
+
+  static void sleepUs(int64_t us)
+  {
+    struct timespec ts = {(time_t)(us / 1000000), (long)(us % 1000000) * 1000};
+    nanosleep(&ts, NULL);
+  }
+
+  static bool isPing(const NBMQTTCaptureRecord &record)
+  {
+    int type = record.packet[0] >> 4;
+    return type == PINGREQ || type == PINGRESP;
+  }
+
+  void skipPings()
+  {
+    while (cursor < count && readOffset == 0 && isPing(records[cursor]))
+      cursor++;
+  }
+
+  void compare(unsigned char *packet, uint32_t len)
+  {
+    const NBMQTTCaptureRecord *record;
+
+    if ((packet[0] >> 4) == PINGREQ)
+    {
+      pongs++;
+      return;
+    }
+    if ((packet[0] >> 4) == DISCONNECT && dropDisconnect)
+    {
+      dropDisconnect = false;
+      return;
+    }
+    if ((packet[0] >> 4) == CONNECT)
+      NBMQTTCapture::maskCredentials(packet, len);
+
+    record = peek();
+    if (record == NULL || record->direction != NBMQTT_CAPTURE_SENT)
+    {
+      counters.unexpected++;
+      print("unexpected", packet, len, NBMQTT_CAPTURE_SENT);
+      return;
+    }
+    if (record->len == len && memcmp(record->packet, packet, len) == 0)
+    {
+      counters.matched++;
+      if (verbose)
+        print(">", packet, len, NBMQTT_CAPTURE_SENT);
+    }
+    else
+    {
+      counters.mismatched++;
+      print("captured", record->packet, record->len, NBMQTT_CAPTURE_SENT);
+      print("written ", packet, len, NBMQTT_CAPTURE_SENT);
+    }
+    cursor++;
+  }
+
+  void print(const char *what, const unsigned char *packet, uint32_t len, uint8_t direction)
+  {
+    char line[200];
+
+    memset(line, 0, sizeof(line));
+    if (direction == NBMQTT_CAPTURE_SENT)
+      MQTTFormat_toServerString(line, sizeof(line) - 1, (unsigned char *)packet, len);
+    else
+      MQTTFormat_toClientString(line, sizeof(line) - 1, (unsigned char *)packet, len);
+    printf("%10.3f %5u %-10s %s\n", (nowUs() - startUs) / 1000.0, cursor, what,
+           line[0] ? line : ((packet[0] >> 4) < 15) ? MQTTPacket_getName(packet[0] >> 4) : "AUTH");
+  }
+
+  NBMQTTCaptureRecord *records;
+  uint32_t count;
+  uint32_t bytes;
+  uint32_t cursor;     // next record to replay
+  uint32_t readOffset; // bytes of the record at cursor already read
+  int pongs;           // PINGRESP owed to the client
+  int pongOffset;
+  bool dropDisconnect;
+  unsigned char *written; // client bytes not yet a whole packet
+  uint32_t writtenLen, writtenSize;
+  double speed;
+  bool verbose;
+  int64_t startUs;
+  Counters counters;
+};
@@ -0,0 +1,296 @@
+/**
+ * @file replay.cpp
+ *
+ * @brief Replay an MQTT capture (NBMQTTCapture, capture.bin of the module)
+ * through MQTT::Client on Linux.
+ *
+ *   mqtt-replay [-s speed] [-v] capture.bin
+ *
+ * The application calls are taken from the packets the module sent: CONNECT,
+ * PUBLISH, SUBSCRIBE, UNSUBSCRIBE and DISCONNECT are made again, each at its
+ * captured time divided by speed (-s 0 as fast as possible); the client acks
+ * the captured broker packets by itself. ReplayMQTTSocket feeds the broker
+ * packets back and compares every packet written with the captured one, so a
+ * field issue runs again the same way, and a change of the client shows up as
+ * a mismatch or in the timings printed at the end.
+ *
+ * Built with MQTTCLIENT_PROFILE, the summary also gives the time of each
+ * client stage, so a capture is a repeatable input to profile the hot path.
+ *
+ * The client has the default MQTTCLIENT_ options and the module packet size;
+ * build with the ones of the capture for the packets to match.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <MQTTClient.h>
+#include <PosixMQTTCountdown.h>
+#include <ReplayMQTTSocket.h>
+
+#define REPLAY_PACKET_SIZE 1000       /* same as UBIDOTS_MSG_MAX_LEN */
+#define REPLAY_STALL_MS 5000          /* a packet not replayed this long after it is due is skipped */
+#define REPLAY_TOPIC_ALIASES 16       /* MQTT 5 topic aliases followed */
+#define REPLAY_TOPIC_MAX_LEN 256
+
+typedef MQTT::Client<ReplayMQTTSocket, PosixMQTTCountdown, REPLAY_PACKET_SIZE> replay_client_t;
+
+static uint32_t delivered;
+static unsigned char mqttVersion = 4;
+static char topicAliases[REPLAY_TOPIC_ALIASES + 1][REPLAY_TOPIC_MAX_LEN];
+
+static void on_message(MQTT::MessageData& md)
+{
+  delivered++;
+}
+
+static int read_string(const unsigned char* packet, uint32_t len, uint32_t& pos, MQTTString& out)
+{
+  if (pos + 2 > len)
+    return 0;
+  out.cstring = NULL;
+  out.lenstring.len = (packet[pos] << 8) | packet[pos + 1];
+  out.lenstring.data = (char*)packet + pos + 2;
+  pos += 2 + out.lenstring.len;
+  return pos <= len;
+}
+
+static int skip_properties(const unsigned char* packet, uint32_t len, uint32_t& pos)
+{
+  uint32_t value = 0;
+  int n;
+
+  if (mqttVersion != 5)
+    return 1;
+  n = (pos < len) ? NBMQTTCapture::decode(packet + pos, len - pos, 4, value) : 0;
+  pos += n + value;
+  return n > 0 && pos <= len;
+}
+
+/* the client takes C strings, the packets hold length prefixed ones */
+static char* copy_string(const MQTTString& s, char* buf, size_t size)
+{
+  size_t len = ((size_t)s.lenstring.len < size) ? (size_t)s.lenstring.len : size - 1;
+
+  memcpy(buf, s.lenstring.data, len);
+  buf[len] = '\0';
+  return buf;
+}
+
+static int replay_connect(replay_client_t& client, const NBMQTTCaptureRecord& r)
+{
+  static char clientId[REPLAY_TOPIC_MAX_LEN], willTopic[REPLAY_TOPIC_MAX_LEN], willMessage[REPLAY_TOPIC_MAX_LEN];
+  static char username[REPLAY_TOPIC_MAX_LEN], password[REPLAY_TOPIC_MAX_LEN];
+  MQTTPacket_connectData options = MQTTPacket_connectData_initializer;
+  MQTTString name, s;
+  uint32_t remaining, pos;
+  unsigned char flags;
+
+  pos = 1 + NBMQTTCapture::decode(r.packet + 1, r.len - 1, 4, remaining);
+  if (!read_string(r.packet, r.len, pos, name) || pos + 4 > r.len)
+    return -1;
+  mqttVersion = r.packet[pos];
+  flags = r.packet[pos + 1];
+  options.MQTTVersion = mqttVersion;
+  options.cleansession = (flags >> 1) & 1;
+  options.keepAliveInterval = (r.packet[pos + 2] << 8) | r.packet[pos + 3];
+  pos += 4;
+  if (!skip_properties(r.packet, r.len, pos) || !read_string(r.packet, r.len, pos, s))
+    return -1;
+  options.clientID.cstring = copy_string(s, clientId, sizeof(clientId));
+  if (flags & 0x04) {
+    options.willFlag = 1;
+    options.will.qos = (flags >> 3) & 3;
+    options.will.retained = (flags >> 5) & 1;
+    if (!skip_properties(r.packet, r.len, pos) || !read_string(r.packet, r.len, pos, s))
+      return -1;
+    options.will.topicName.cstring = copy_string(s, willTopic, sizeof(willTopic));
+    if (!read_string(r.packet, r.len, pos, s))
+      return -1;
+    options.will.message.cstring = copy_string(s, willMessage, sizeof(willMessage));
+  }
+  if ((flags & 0x80) && read_string(r.packet, r.len, pos, s))  // masked, the written CONNECT is masked the same way
+    options.username.cstring = copy_string(s, username, sizeof(username));
+  if ((flags & 0x40) && read_string(r.packet, r.len, pos, s))
+    options.password.cstring = copy_string(s, password, sizeof(password));
+  memset(topicAliases, 0, sizeof(topicAliases));
+  return client.connect(options);
+}
+
+struct stream_context {
+  const unsigned char* payload;
+};
+
+static int produce(void* context, unsigned char* buf, int len, size_t offset)
+{
+  memcpy(buf, ((stream_context*)context)->payload + offset, len);
+  return len;
+}
+
+static int replay_publish(replay_client_t& client, const NBMQTTCaptureRecord& r)
+{
+  static char topic[REPLAY_TOPIC_MAX_LEN];
+  unsigned char dup, retained, *payload;
+  unsigned short id;
+  int qos, payloadlen;
+  MQTTString topicName = MQTTString_initializer;
+  MQTTProperties properties = MQTTProperties_initializer;
+
+  if (MQTTV5Deserialize_publish(&dup, &qos, &retained, &id, &topicName, (mqttVersion == 5) ? &properties : NULL,
+                                &payload, &payloadlen, (unsigned char*)r.packet, r.len) != 1)
+    return -1;
+  copy_string(topicName, topic, sizeof(topic));
+  if (properties.topicAlias > 0 && properties.topicAlias <= REPLAY_TOPIC_ALIASES) {
+    if (topic[0] == '\0')
+      strcpy(topic, topicAliases[properties.topicAlias]);  // the client sends the topic again, or not, by itself
+    else
+      strcpy(topicAliases[properties.topicAlias], topic);
+  }
+  if (r.len > REPLAY_PACKET_SIZE) {  // only the streamed publish sends more than the packet size
+    stream_context context = {payload};
+    return client.publish(topic, payloadlen, produce, &context, (MQTT::QoS)qos, retained);
+  }
+  return client.publish(topic, payload, payloadlen, (MQTT::QoS)qos, retained);
+}
+
+static int replay_subscribe(replay_client_t& client, const NBMQTTCaptureRecord& r, bool subscribe)
+{
+  static char filter[REPLAY_TOPIC_MAX_LEN];
+  uint32_t remaining, pos;
+  MQTTString s;
+  int rc = 0;
+
+  pos = 1 + NBMQTTCapture::decode(r.packet + 1, r.len - 1, 4, remaining) + 2;  // after the packet id
+  if (!skip_properties(r.packet, r.len, pos))
+    return -1;
+  while (rc == 0 && pos < r.len && read_string(r.packet, r.len, pos, s)) {
+    copy_string(s, filter, sizeof(filter));
+    if (subscribe) {
+      if (pos >= r.len)
+        return -1;
+      rc = client.subscribe(filter, (MQTT::QoS)(r.packet[pos++] & 3), on_message);
+    } else
+      rc = client.unsubscribe(filter);
+  }
+  return rc;
+}
+
+static void usage(const char* name)
+{
+  fprintf(stderr,
+          "usage: %s [-s speed] [-v] capture\n"
+          "  -s speed  1 at the captured pace (default), 10 ten times faster, 0 without waiting\n"
+          "  -v        print every packet\n",
+          name);
+}
+
+int main(int argc, char** argv)
+{
+  double speed = 1;
+  bool verbose = false;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:vh")) != -1) {
+    switch (opt) {
+      case 's': speed = atof(optarg); break;
+      case 'v': verbose = true; break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (optind != argc - 1) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  FILE* f = fopen(argv[optind], "rb");
+  if (f == NULL) {
+    perror(argv[optind]);
+    return 1;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  unsigned char* capture = new unsigned char[size > 0 ? size : 1];
+  if (size <= 0 || fread(capture, 1, size, f) != (size_t)size) {
+    fprintf(stderr, "%s: cannot read\n", argv[optind]);
+    return 1;
+  }
+  fclose(f);
+
+  ReplayMQTTSocket socket(capture, (uint32_t)size, speed, verbose);
+  static replay_client_t client(socket, REPLAY_STALL_MS);
+  if (socket.size() == 0) {
+    fprintf(stderr, "%s: not a capture, or empty\n", argv[optind]);
+    return 1;
+  }
+  printf("Replaying %u packets, %.3f s captured, speed %g\n", socket.size(), socket.durationUs() / 1e6, speed);
+  client.setDefaultMessageHandler(on_message);
+
+  long long start = PosixMQTTCountdown::now_ms(), progress = start;
+  uint32_t errors = 0, last = 0;
+  socket.start();
+  while (!socket.done()) {
+    const NBMQTTCaptureRecord* r = socket.peek();
+    uint32_t at = socket.position();
+    int type = r->packet[0] >> 4;
+    int rc = 0;
+
+    if (at != last || socket.dueInUs(*r) > 0) {
+      last = at;
+      progress = PosixMQTTCountdown::now_ms();
+    }
+    if (r->direction == NBMQTT_CAPTURE_SENT &&
+        (type == CONNECT || type == PUBLISH || type == SUBSCRIBE || type == UNSUBSCRIBE || type == DISCONNECT)) {
+      int64_t wait = socket.dueInUs(*r);
+      if (wait > 0)
+        usleep((useconds_t)wait);
+      if (type == CONNECT) {
+        if (client.isConnected()) {  // the module lost the connection and connects again
+          socket.connectionLost();
+          client.disconnect();
+        }
+        rc = replay_connect(client, *r);
+      } else if (type == PUBLISH)
+        rc = replay_publish(client, *r);
+      else if (type == DISCONNECT)
+        rc = client.disconnect();
+      else
+        rc = replay_subscribe(client, *r, type == SUBSCRIBE);
+      if (rc != 0) {
+        errors++;
+        if (verbose)
+          printf("%5u call for %s returned %d\n", at, MQTTPacket_getName(type), rc);
+      }
+    } else if (client.isConnected())
+      client.yield(10);  // broker packets, and the acks the client writes for them
+    else
+      usleep(1000);
+
+    if (socket.position() == at && !socket.done() && PosixMQTTCountdown::now_ms() - progress > REPLAY_STALL_MS)
+      socket.skip();  // due for a while, the client will not write or read it
+  }
+  long long elapsed = PosixMQTTCountdown::now_ms() - start;
+
+  const ReplayMQTTSocket::Counters& c = socket.getCounters();
+  printf("Replayed %u packets in %.3f s (captured %.3f s)\n", socket.size(), elapsed / 1000.0, socket.durationUs() / 1e6);
+  printf("  written  %u as captured, %u different, %u unexpected\n", c.matched, c.mismatched, c.unexpected);
+  printf("  skipped  %u, calls failed %u, messages delivered %u\n", c.skipped, errors, delivered);
+#if MQTTCLIENT_STATS
+  NBMQTTStats stats;
+  client.getStats(stats);
+  printf("  send us  p50 %u p99 %u max %u\n", stats.sendUs.percentile(50), stats.sendUs.percentile(99), stats.sendUs.max);
+  printf("  ack us   p50 %u p99 %u max %u\n", stats.ackUs.percentile(50), stats.ackUs.percentile(99), stats.ackUs.max);
+#endif
+#if MQTTCLIENT_PROFILE
+  NBMQTTProfile profile;
+  client.getProfile(profile);
+  for (int i = 0; i < NBMQTT_STAGES; i++)
+    printf("  %-9s ns p50 %u p99 %u max %u, %u times\n", NBMQTTProfile::name(i), profile.stages[i].percentile(50),
+           profile.stages[i].percentile(99), profile.stages[i].max, profile.stages[i].count);
+#endif
+  delete[] capture;
+  return (c.mismatched || c.unexpected || c.skipped) ? 3 : 0;
+}